@@ -49,8 +49,183 @@
 
 (require 'cl-lib)
 
-(defvar gg-to-java-mappings nil
-  "Mappings to Java objects")
+(defgroup gargoyle nil
+  "Java in Emacs."
+  :group 'languages)
+
+(defcustom gg-release-batch-size 1024
+  "Number of collected Java objects released per module call.
+Objects collected by Emacs GC are queued and their references
+released in batches of this size at later calls into the module and
+when Emacs is idle (c.f. `gg-release-idle-delay')."
+  :type 'integer
+  :set (lambda (symbol value)
+         (gg--set-release-batch-size value)
+         (set-default symbol value))
+  :group 'gargoyle)
+
+(defvar gg--release-timer nil)
+
+(defun gg--start-release-timer ()
+  (when gg--release-timer
+    (cancel-timer gg--release-timer))
+  (setq gg--release-timer
+        (run-with-idle-timer gg-release-idle-delay t #'gg--drain-releases)))
+
+(defcustom gg-release-idle-delay 2
+  "Seconds of idle time before all queued Java object releases are
+done (c.f. `gg-release-batch-size')."
+  :type 'number
+  :set (lambda (symbol value)
+         (set-default symbol value)
+         (gg--start-release-timer))
+  :group 'gargoyle)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; JVM control
+
+(defcustom gg-java-options nil
+  "Extra JVM options used by `gg-java-start', e.g. (\"-Xmx1g\"
+\"-XX:+UseSerialGC\")."
+  :type '(repeat string)
+  :group 'gargoyle)
+
+(defcustom gg-java-classpath nil
+  "Class path entries (directories and jars) for the JVM."
+  :type '(repeat file)
+  :group 'gargoyle)
+
+(defcustom gg-java-properties nil
+  "System properties for the JVM as an alist of (NAME . VALUE)."
+  :type '(alist :key-type string :value-type string)
+  :group 'gargoyle)
+
+(defcustom gg-java-check-jni nil
+  "Run the JVM with -Xcheck:jni. Useful when working on the module,
+but it adds checking overhead to every JNI call."
+  :type 'boolean
+  :group 'gargoyle)
+
+(defcustom gg-java-cds-archive nil
+  "File name of an AppCDS archive of the classes used from Lisp.
+If the file exists, the JVM maps classes from it at startup.
+Otherwise the classes loaded in this session are written to it when
+the JVM is stopped (or Emacs exits), so later sessions start faster.
+Delete the file to regenerate it. Requires JDK 13 or later."
+  :type '(choice (const :tag "None" nil) file)
+  :group 'gargoyle)
+
+(defcustom gg-class-metadata-cache nil
+  "File name of a cache of class metadata (methods, fields,
+modifiers and supertypes) kept across sessions. Classes of the JDK
+and of jars on `gg-java-classpath' are added as they're first
+inspected, and warm sessions read them from the file instead of
+reflecting on them. Entries of a jar are dropped when the jar
+changes and those of the JDK when another JDK is used."
+  :type '(choice (const :tag "None" nil) file)
+  :group 'gargoyle)
+
+(defun gg--stop-for-cds-archive ()
+  "Stop the JVM at Emacs exit so the CDS archive is written."
+  (when (gg-java-running)
+    (gg-java-stop)))
+
+(defun gg--java-cds-options ()
+  (when gg-java-cds-archive
+    (let ((archive (expand-file-name gg-java-cds-archive)))
+      (if (file-exists-p archive)
+          (list (concat "-XX:SharedArchiveFile=" archive) "-Xshare:auto")
+        (list (concat "-XX:ArchiveClassesAtExit=" archive))))))
+
+(defun gg--java-cds-hook (options)
+  "Stop the JVM at Emacs exit if it was started with OPTIONS that
+write a CDS archive when it stops."
+  (when (cl-some (lambda (option) (string-prefix-p "-XX:ArchiveClassesAtExit=" option))
+                 options)
+    (add-hook 'kill-emacs-hook #'gg--stop-for-cds-archive)))
+
+(defun gg--java-launch-options (options)
+  "All options for starting the JVM, ending with OPTIONS."
+  (append
+   (when gg-java-check-jni
+     '("-Xcheck:jni"))
+   (when gg-java-classpath
+     (list (concat "-Djava.class.path="
+                   (mapconcat #'expand-file-name gg-java-classpath path-separator))))
+   (mapcar (lambda (property) (format "-D%s=%s" (car property) (cdr property)))
+           gg-java-properties)
+   (gg--java-cds-options)
+   gg-java-options
+   options))
+
+(defun gg--java-prepare-start ()
+  "Set up the class path index and metadata cache for a new JVM."
+  (gg--classpath-index)
+  (when gg-class-metadata-cache
+    (add-hook 'kill-emacs-hook #'gg--class-store-save))
+  (gg--class-store-open (and gg-class-metadata-cache
+                             (expand-file-name gg-class-metadata-cache))))
+
+(defun gg-java-start (&optional options)
+  "Start the JVM. The options are built from `gg-java-options',
+`gg-java-classpath', `gg-java-properties', `gg-java-check-jni' and
+`gg-java-cds-archive', followed by the list of strings OPTIONS."
+  (gg--java-prepare-start)
+  (let ((launch-options (gg--java-launch-options options)))
+    (prog1 (gg--java-start-raw launch-options)
+      (gg--java-cds-hook launch-options))))
+
+(define-error 'java-starting "Gargoyle JVM is starting")
+
+(defvar gg-java-started-hook nil
+  "Hook run when a JVM started by `gg-java-start-async' is ready.")
+
+(defvar gg--start-timer nil)
+
+(defun gg--poll-java-start (callback)
+  (unless (eq (gg-java-status) 'starting)
+    (cancel-timer gg--start-timer)
+    (setq gg--start-timer nil)
+    (condition-case err
+        (progn
+          (gg--java-finish-start)
+          (run-hooks 'gg-java-started-hook)
+          (when callback
+            (funcall callback t)))
+      (error
+       (if callback
+           (funcall callback err)
+         (message "Gargoyle JVM failed to start: %s" (error-message-string err)))))))
+
+(defun gg-java-start-async (&optional options callback)
+  "Start the JVM (as with `gg-java-start') without blocking Emacs.
+The JVM is created on a background thread. When it's ready
+`gg-java-started-hook' is run and CALLBACK (if non-nil) is called
+with t, or with the error if the start failed. Calls that need the
+JVM before then wait briefly and then signal `java-starting'."
+  (gg--java-prepare-start)
+  (let ((launch-options (gg--java-launch-options options)))
+    (gg--java-start-async-raw launch-options)
+    (gg--java-cds-hook launch-options))
+  (setq gg--start-timer (run-with-timer 0.05 0.05 #'gg--poll-java-start callback)))
+
+(defun gg-java-wait-for-start (&optional timeout)
+  "Wait up to TIMEOUT seconds (forever if nil) for an async start.
+Return non-nil if the JVM is running."
+  (let ((deadline (and timeout (+ (float-time) timeout))))
+    (while (and (eq (gg-java-status) 'starting)
+                (or (not deadline) (< (float-time) deadline)))
+      (sleep-for 0.01))
+    (when gg--start-timer
+      (gg--poll-java-start nil))
+    (gg-java-running)))
+
+(defvar gg-to-java-mappings
+  '((java.lang.String stringp gg-new-string))
+  "Mappings to Java objects (c.f. type-mapping.org).
+Each element is (JAVA-TYPE PREDICATE MAPPING-FUNCTION). Predicates
+should only depend on the Lisp type of the value as method selection
+results are cached by argument types (c.f. `gg--call-cache').")
 
 (defvar gg--class-hierarchy (make-hash-table)
   "Class hierarchy (c.f. internals.org)")
@@ -78,27 +253,16 @@
   "Return t if `type' is a Java class type."
   (eq (type-of type) 'symbol))
 
-;; object type predicates
-(defun gg-objectp (object)
-  "Return t if `object' is a Java object."
-  (and
-   (listp object)
-   (eq (car object) 'gg-obj)))
-
+;; object type predicates (`gg-objectp' is native)
 (defun gg-classp (class)
   "Return t if `class' is a Java class."
   (and
-   (listp class)
-   (eq (car class) 'gg-obj)
-   (eq (nth 2 class) 'java.lang.Class)))
-
-(defun gg--new-object (ptr class-name-sym)
-  "Create a new object from a raw JNI pointer."
-  (list 'gg-obj ptr class-name-sym))
+   (gg-objectp class)
+   (eq (gg--object-class class) 'java.lang.Class)))
 
 (defun gg-toString (obj)
   "Return the string representation of the object."
-  (gg--toString-raw (cadr obj)))
+  (gg--toString-raw obj))
 
 (defun gg-new (class-or-name &rest ctor-args)
   "Create a new instance."
@@ -108,22 +272,721 @@
 				(t (signal 'wrong-type-argument `("Expected class object or class name string:"
 												  ,(type-of class-or-name)
 												  ,class-or-name))))))
-	(gg--new-raw (cadr class))))
+	(gg--new-raw class)))
 
-(define-error 'java-exception
-  "A Java exception. The cdr is the exception.")
+(define-error 'java-exception "Java exception")
+
+(defcustom gg-java-print-exceptions nil
+  "Print Java exceptions (with stack trace) to stderr when they are
+signaled as `java-exception' errors."
+  :type 'boolean
+  :set (lambda (symbol value)
+         (gg--set-print-exceptions value)
+         (set-default symbol value))
+  :group 'gargoyle)
+
+;; A `java-exception' error is (java-exception CLASS MESSAGE THROWABLE)
+(defun gg-java-exception-class (err)
+  "Return the class name symbol of the Java exception ERR."
+  (nth 1 err))
+
+(defun gg-java-exception-message (err)
+  "Return the message of the Java exception ERR (nil if it has none)."
+  (nth 2 err))
+
+(defun gg-java-exception-object (err)
+  "Return the throwable of the Java exception ERR."
+  (nth 3 err))
+
+(defvar gg--stack-traces (make-hash-table :test 'eq :weakness 'key)
+  "Stack traces converted by `gg-java-exception-stack-trace'.")
+
+(defun gg-java-exception-stack-trace (err)
+  "Return the stack trace of the Java exception ERR as a list of
+strings. It is only converted from Java when first asked for."
+  (let ((throwable (gg-java-exception-object err)))
+    (or (gethash throwable gg--stack-traces)
+        (puthash throwable (gg--get-stack-trace-raw throwable) gg--stack-traces))))
 
 (defun gg--class-add-by-name (class-name-sym)
   "Add a class to the class hierarchy by providing the name of the class"
-  (unless (gethash class-name-sym gg--class-hierarchy)))
+  (unless (gethash class-name-sym gg--class-hierarchy)
+    ;; one call brings in all missing supertypes too
+    (dolist (class-struct (gg--get-class-structs class-name-sym gg--class-hierarchy))
+      (puthash (plist-get class-struct :name) class-struct gg--class-hierarchy)
+      (when gg-define-method-functions
+        (gg--define-method-functions class-struct))))
+  (gethash class-name-sym gg--class-hierarchy))
+
+(defun gg--class-add-by-obj (class)
+  "Add a class to the class hierarchy by providing the class object"
+  (gg--class-add-by-name (gg-get-class-name class)))
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Method calls (c.f. "Target Method Selection Algorithm" in type-mapping.org)
+
+(defvar gg--call-cache (make-hash-table :test 'equal)
+  "Memoized target method selection.
+Keys are (CLASS METHOD-NAME STATIC ARG-TYPES) where ARG-TYPES is a
+vector of `gg--arg-type's. Values are (METHOD-ID . PLAN) where PLAN
+is a vector with an entry per argument, c.f. `gg--marshal-args'.")
+
+(defvar gg--class-bindings (make-hash-table :test 'eq)
+  "Method bindings by class name, c.f. `gg--class-bindings'.")
+
+(defvar gg--call-cache-mappings nil
+  "The `gg-to-java-mappings' that `gg--call-cache' was built with.")
+
+(defvar gg--call-cache-hits 0
+  "Number of method selections answered from `gg--call-cache'.")
+
+(defvar gg--call-cache-misses 0
+  "Number of method selections that had to run the selection algorithm.")
+
+(defun gg-call-cache-stats ()
+  "Return a plist describing the method selection cache."
+  (list :hits gg--call-cache-hits
+        :misses gg--call-cache-misses
+        :size (hash-table-count gg--call-cache)))
+
+(defun gg-call-cache-clear ()
+  "Empty the method selection cache and reset its counters."
+  (clrhash gg--call-cache)
+  (clrhash gg--class-bindings)
+  (setq gg--call-cache-hits 0
+        gg--call-cache-misses 0))
+
+(defun gg--arg-type (arg)
+  "The type of a Lisp argument for method selection purposes."
+  (cond
+   ((null arg) 'null)
+   ((gg-objectp arg) (gg--object-class arg))
+   (t (type-of arg))))
+
+(defun gg--normalize-class-name (class-name-sym)
+  "Class names as used in type descriptors, i.e. inner classes
+separated by `.' instead of `$'."
+  (let ((name (symbol-name class-name-sym)))
+    (if (string-match-p "\\$" name)
+        (intern (replace-regexp-in-string "\\$" "." name))
+      class-name-sym)))
+
+(defun gg--class-supertypes (class-name-sym)
+  "Return (SUPERCLASS . INTERFACES) of a class, from the index of
+loaded classes when possible to avoid reflecting on it."
+  (or (gg--class-index-supertypes class-name-sym)
+      (let ((class-struct (gg--class-add-by-name class-name-sym)))
+        (cons (plist-get class-struct :superclass)
+              (plist-get class-struct :interfaces)))))
+
+(defun gg--type-distance (class-name-sym type)
+  "Number of inheritance steps from CLASS-NAME-SYM to TYPE or nil if
+CLASS-NAME-SYM isn't a subtype of TYPE."
+  (let ((queue (list (cons class-name-sym 0)))
+        seen
+        distance)
+    (while (and queue (not distance))
+      (let* ((entry (pop queue))
+             (class (car entry)))
+        (cond
+         ((eq (gg--normalize-class-name class) type)
+          (setq distance (cdr entry)))
+         ((memq class seen))
+         (t
+          (push class seen)
+          (dolist (super (gg--class-supertypes class))
+            (when super
+              (setq queue (append queue (list (cons super (1+ (cdr entry))))))))))))
+    (or distance
+        ;; interfaces don't have java.lang.Object as a supertype
+        (and (eq type 'java.lang.Object) 1))))
+
+(defconst gg--primitive-conversions
+  '((integer (I . 0) (J . 1) (S . 2) (B . 3) (C . 4) (D . 5) (F . 6))
+    (float (D . 0) (F . 1))
+    (symbol (Z . 0))
+    (null (Z . 0)))
+  "Lisp types that can be passed as primitives and the cost of each
+conversion. Lower cost conversions win during method selection.")
+
+(defun gg--arg-conversion (arg param-type)
+  "How ARG can be passed as PARAM-TYPE without a mapping.
+Returns (COST . PLAN-ENTRY) or nil if it can't."
+  (let ((arg-type (gg--arg-type arg)))
+    (cond
+     ((gg--type-primitivep param-type)
+      (let ((conversion (assq (cdr param-type)
+                              (cdr (assq arg-type gg--primitive-conversions)))))
+        (when conversion
+          (cons (cdr conversion)
+                (intern (downcase (symbol-name (cdr param-type))))))))
+     ((eq arg-type 'null)
+      (cons 0 'l))
+     ((and (gg-objectp arg) (gg--type-classp param-type))
+      (let ((distance (gg--type-distance arg-type param-type)))
+        (when distance
+          (cons distance 'l)))))))
+
+(defun gg--arg-mapping (arg param-type)
+  "How ARG can be passed as PARAM-TYPE using `gg-to-java-mappings'.
+Returns (COST . (l . MAPPING-FUNCTION)) or nil."
+  (when (gg--type-classp param-type)
+    (cl-loop for (type predicate function) in gg-to-java-mappings
+             for distance = (and (funcall predicate arg)
+                                 (gg--type-distance type param-type))
+             when distance
+             return (cons distance (cons 'l function)))))
+
+(defun gg--candidate-methods (class-name-sym method-name arity static)
+  "Methods named METHOD-NAME taking ARITY arguments found by walking
+up from CLASS-NAME-SYM. Returns a list of (CLASS . METHOD-STRUCT).
+Overridden methods are only returned once."
+  (let ((queue (list class-name-sym))
+        seen
+        signatures
+        candidates)
+    (while queue
+      (let ((class (pop queue)))
+        (unless (memq class seen)
+          (push class seen)
+          (let ((class-struct (gg--class-add-by-name class)))
+            (dolist (method (plist-get class-struct :methods))
+              (let ((modifiers (plist-get method :modifiers)))
+                (when (and (eq method-name (plist-get method :name))
+                           (= arity (length (plist-get method :accepts)))
+                           (eq static (and (memq 'static modifiers) t))
+                           (not (memq 'bridge modifiers))
+                           (not (member (plist-get method :signature) signatures)))
+                  (push (plist-get method :signature) signatures)
+                  (push (cons class method) candidates))))
+            (setq queue (append queue
+                                (delq nil (cons (plist-get class-struct :superclass)
+                                                (copy-sequence (plist-get class-struct :interfaces))))))))))
+    (nreverse candidates)))
+
+(defun gg--choose-method (candidates args)
+  "Choose from CANDIDATES, a list of (KEY . ACCEPTS), the method to
+call with ARGS. Returns (KEY . PLAN), nil if there is no match or
+`ambiguous'."
+  (let (best best-score ambiguous)
+    (dolist (candidate candidates)
+      (let ((mappings 0)
+            (cost 0)
+            (plan nil)
+            (compatible t))
+        (cl-loop for arg in args
+                 for param-type in (cdr candidate)
+                 while compatible
+                 do (let ((conversion (gg--arg-conversion arg param-type)))
+                      (unless conversion
+                        (setq conversion (gg--arg-mapping arg param-type))
+                        (when conversion
+                          (setq mappings (1+ mappings))))
+                      (if (not conversion)
+                          (setq compatible nil)
+                        (setq cost (+ cost (car conversion)))
+                        (push (cdr conversion) plan))))
+        (when compatible
+          (let ((score (cons mappings cost)))
+            (cond
+             ((or (null best-score)
+                  (< mappings (car best-score))
+                  (and (= mappings (car best-score)) (< cost (cdr best-score))))
+              (setq best (cons (car candidate) (vconcat (nreverse plan)))
+                    best-score score
+                    ambiguous nil))
+             ((equal score best-score)
+              (setq ambiguous t)))))))
+    (if ambiguous 'ambiguous best)))
+
+(defun gg--select-method (class-name-sym method-name static args)
+  "Run the target method selection algorithm.
+Returns (METHOD-ID . PLAN) for the chosen method."
+  (let ((best (gg--choose-method
+               (mapcar (lambda (candidate)
+                         (cons candidate (plist-get (cdr candidate) :accepts)))
+                       (gg--candidate-methods class-name-sym method-name (length args) static))
+               args)))
+    (cond
+     ((null best)
+      (error "No method %s matching arguments on %s" method-name class-name-sym))
+     ((eq best 'ambiguous)
+      (error "Ambiguous call to method %s on %s" method-name class-name-sym)))
+    (let* ((candidate (car best))
+           (declaring-class (gg-find-class (symbol-name (car candidate))))
+           (method (cdr candidate)))
+      (cons (gg--get-method-id-raw declaring-class
+                                   (symbol-name method-name)
+                                   (plist-get method :signature)
+                                   static)
+            (cdr best)))))
+
+(defun gg--check-mappings ()
+  "Drop cached method selections if `gg-to-java-mappings' changed."
+  (unless (eq gg--call-cache-mappings gg-to-java-mappings)
+    (clrhash gg--call-cache)
+    (clrhash gg--class-bindings)
+    (setq gg--call-cache-mappings gg-to-java-mappings)))
+
+(defun gg--resolve-method (class-name-sym method-name static args)
+  "Return (METHOD-ID . PLAN) for a call, consulting `gg--call-cache'."
+  (gg--check-mappings)
+  (let* ((key (list class-name-sym method-name static
+                    (apply #'vector (mapcar #'gg--arg-type args))))
+         (resolved (gethash key gg--call-cache)))
+    (if resolved
+        (setq gg--call-cache-hits (1+ gg--call-cache-hits))
+      (setq gg--call-cache-misses (1+ gg--call-cache-misses))
+      (setq resolved (gg--select-method class-name-sym method-name static args))
+      (puthash key resolved gg--call-cache))
+    resolved))
+
+(defun gg--marshal-args (plan args)
+  "Convert ARGS to the typed argument vector taken by
+`gg--call-method-raw'. Each PLAN entry is a type symbol (i, l, ...)
+or (l . MAPPING-FUNCTION)."
+  (let ((typed-args (make-vector (* 2 (length plan)) nil))
+        (i 0))
+    (dolist (arg args)
+      (let ((entry (aref plan i)))
+        (aset typed-args (* 2 i) (if (consp entry) 'l entry))
+        (aset typed-args (1+ (* 2 i))
+              (if (consp entry) (funcall (cdr entry) arg) arg)))
+      (setq i (1+ i)))
+    typed-args))
+
+;; Interruptible calls
+
+(define-error 'java-timeout "Java call timed out")
+
+(defcustom gg-java-call-timeout nil
+  "Seconds a Java call may take before it's interrupted and
+`java-timeout' is signaled, nil for no limit. Setting this makes
+calls interruptible (c.f. `gg-java-interruptible-calls'). Can be
+bound around calls, c.f. `gg-with-timeout'."
+  :type '(choice (const :tag "No limit" nil) number)
+  :group 'gargoyle)
+
+(defcustom gg-java-interruptible-calls nil
+  "Make Java calls on a helper thread so they can be quit with
+\[keyboard-quit] (Emacs 26 or later). The Java thread is interrupted,
+which stops blocking operations and code checking
+Thread.interrupted(). This adds a thread handoff to every call."
+  :type 'boolean
+  :group 'gargoyle)
+
+(defmacro gg-with-timeout (seconds &rest body)
+  "Run BODY with Java calls interrupted after SECONDS."
+  (declare (indent 1))
+  `(let ((gg-java-call-timeout ,seconds))
+     ,@body))
+
+(defun gg--call-method (target method-id typed-args)
+  (if (or gg-java-interruptible-calls gg-java-call-timeout)
+      (gg--call-method-interruptible-raw target method-id typed-args nil
+                                         gg-java-call-timeout)
+    (gg--call-method-raw target method-id typed-args)))
+
+(defun gg-call (object method-name &rest args)
+  "Call the instance method METHOD-NAME (a symbol) on OBJECT."
+  (let ((resolved (gg--resolve-method (gg--object-class object) method-name nil args)))
+    (gg--call-method object (car resolved)
+                     (gg--marshal-args (cdr resolved) args))))
+
+(defun gg-call-static (class-or-name method-name &rest args)
+  "Call the static method METHOD-NAME (a symbol) on a class given as
+a class object or class name symbol."
+  (let* ((class-name-sym (if (gg-objectp class-or-name)
+                             (gg-get-class-name class-or-name)
+                           class-or-name))
+         (resolved (gg--resolve-method class-name-sym method-name t args)))
+    (gg--call-method nil (car resolved)
+                     (gg--marshal-args (cdr resolved) args))))
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Method functions, e.g. (/add list x) (c.f. YT-28)
+
+(defcustom gg-define-method-functions nil
+  "Define a function /NAME for each Java method NAME of the classes
+used from Lisp. (/NAME OBJECT ARGS...) calls the instance method on
+OBJECT, (/NAME CLASS-NAME-SYMBOL ARGS...) calls the static method.
+Existing functions aren't redefined. The functions are global and
+unprefixed, so this is off by default (c.f. `gg-define-class-methods'
+to define them for one class)."
+  :type 'boolean
+  :group 'gargoyle)
+
+(cl-defstruct (gg--binding (:constructor gg--make-binding (name methods)))
+  "The methods of a class with the same name. Classes share the
+binding of their superclass (or interface) unless they declare
+methods with the name."
+  name
+  methods                               ; list of [METHOD-ID STATIC SIGNATURE ACCEPTS]
+  dispatchers)                          ; alist of (KEY . DISPATCHER), c.f. `gg--dispatcher'
+
+(cl-defstruct (gg--dispatcher (:constructor gg--make-dispatcher (candidates)))
+  "Calls of a binding with a given arity, instance or static."
+  candidates                            ; list of (METHOD-ID . ACCEPTS)
+  (plans (make-hash-table :test 'equal))) ; ARG-TYPES -> (METHOD-ID . PLAN)
+
+(defun gg--define-method-functions (class-struct)
+  (dolist (method (plist-get class-struct :methods))
+    (let* ((method-name (plist-get method :name))
+           (function (intern (concat "/" (symbol-name method-name)))))
+      (unless (or (fboundp function)
+                  (memq method-name '(<init> <clinit>)))
+        (defalias function (apply-partially #'gg--invoke-binding method-name)
+          (format "Call the Java method %s on an object or class name symbol." method-name))))))
+
+(defun gg--binding-add (bindings method-name method)
+  "Add METHOD, replacing a method with the same signature, to the
+binding of METHOD-NAME in BINDINGS, which must be the class' own."
+  (let* ((binding (gethash method-name bindings))
+         (methods (cl-remove (aref method 2) (gg--binding-methods binding)
+                             :key (lambda (m) (aref m 2)) :test #'equal)))
+    (setf (gg--binding-methods binding) (cons method methods))))
+
+(defun gg--make-class-bindings (class-name-sym)
+  "Build the bindings of a class from those of its supertypes and
+the methods it declares."
+  (let* ((class-struct (gg--class-add-by-name class-name-sym))
+         (supertypes (delq nil (cons (plist-get class-struct :superclass)
+                                     (copy-sequence (plist-get class-struct :interfaces)))))
+         (bindings (make-hash-table :test 'eq))
+         (own nil)
+         class)
+    ;; inherited: share the binding if only one supertype has the name
+    (dolist (super supertypes)
+      (maphash (lambda (name binding)
+                 (let ((existing (gethash name bindings)))
+                   (cond
+                    ((null existing)
+                     (puthash name binding bindings))
+                    ((not (eq existing binding))
+                     (unless (memq name own)
+                       (push name own)
+                       (puthash name (gg--make-binding name (gg--binding-methods existing)) bindings))
+                     (dolist (method (gg--binding-methods binding))
+                       (unless (cl-find (aref method 2) (gg--binding-methods (gethash name bindings))
+                                        :key (lambda (m) (aref m 2)) :test #'equal)
+                         (push method (gg--binding-methods (gethash name bindings)))))))))
+               (gg--class-bindings super)))
+    (dolist (method (plist-get class-struct :methods))
+      (let ((name (plist-get method :name))
+            (modifiers (plist-get method :modifiers)))
+        (unless (or (memq 'bridge modifiers) (memq name '(<init> <clinit>)))
+          (unless (memq name own)
+            (push name own)
+            (puthash name (gg--make-binding name (and (gethash name bindings)
+                                                      (gg--binding-methods (gethash name bindings))))
+                     bindings))
+          (unless class
+            (setq class (gg-find-class (symbol-name class-name-sym))))
+          (let ((static (and (memq 'static modifiers) t)))
+            (gg--binding-add bindings name
+                             (vector (gg--get-method-id-raw class (symbol-name name)
+                                                            (plist-get method :signature)
+                                                            static)
+                                     static
+                                     (plist-get method :signature)
+                                     (plist-get method :accepts)))))))
+    bindings))
+
+(defun gg--class-bindings (class-name-sym)
+  "Return the method bindings of a class as a hash table of
+METHOD-NAME -> `gg--binding'. They're built on first use."
+  (or (gethash class-name-sym gg--class-bindings)
+      (puthash class-name-sym (gg--make-class-bindings class-name-sym) gg--class-bindings)))
+
+(defun gg--binding-dispatcher (binding arity static)
+  (let ((key (+ (* 2 arity) (if static 1 0))))
+    (or (cdr (assq key (gg--binding-dispatchers binding)))
+        (let ((dispatcher
+               (gg--make-dispatcher
+                (cl-loop for method in (gg--binding-methods binding)
+                         when (and (eq static (aref method 1))
+                                   (= arity (length (aref method 3))))
+                         collect (cons (aref method 0) (aref method 3))))))
+          (push (cons key dispatcher) (gg--binding-dispatchers binding))
+          dispatcher))))
+
+(defun gg--invoke-binding (method-name target &rest args)
+  "Call METHOD-NAME on TARGET, an object or class name symbol for
+static methods, using the bindings of its class."
+  (gg--check-mappings)
+  (let* ((static (and target (symbolp target)))
+         (class-name-sym (if static target (gg--object-class target)))
+         (binding (gethash method-name (gg--class-bindings class-name-sym)))
+         (dispatcher (and binding (gg--binding-dispatcher binding (length args) static)))
+         (types (apply #'vector (mapcar #'gg--arg-type args)))
+         (resolved (and dispatcher (gethash types (gg--dispatcher-plans dispatcher)))))
+    (unless resolved
+      (setq resolved (and dispatcher (gg--choose-method (gg--dispatcher-candidates dispatcher) args)))
+      (cond
+       ((null resolved)
+        (error "No method %s matching arguments on %s" method-name class-name-sym))
+       ((eq resolved 'ambiguous)
+        (error "Ambiguous call to method %s on %s" method-name class-name-sym)))
+      (puthash types resolved (gg--dispatcher-plans dispatcher)))
+    (let ((result (gg--call-method (if static nil target) (car resolved)
+                                   (gg--marshal-args (cdr resolved) args))))
+      ;; so the methods of the result can be called too
+      (when (and gg-define-method-functions (gg-objectp result))
+        (gg--class-add-by-name (gg--object-class result)))
+      result)))
+
+(defun gg-define-class-methods (class-or-name)
+  "Define the method functions (c.f. `gg-define-method-functions') of
+a class given as a class object or class name symbol and of its
+supertypes. This works whether or not `gg-define-method-functions'
+is set."
+  (let ((queue (list (if (gg-objectp class-or-name)
+                         (gg-get-class-name class-or-name)
+                       class-or-name)))
+        seen)
+    (while queue
+      (let ((class-name-sym (pop queue)))
+        (unless (memq class-name-sym seen)
+          (push class-name-sym seen)
+          (let ((class-struct (gg--class-add-by-name class-name-sym)))
+            (gg--define-method-functions class-struct)
+            (setq queue (append (delq nil (cons (plist-get class-struct :superclass)
+                                                (copy-sequence (plist-get class-struct :interfaces))))
+                                queue)))))))
+  nil)
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Asynchronous calls
+
+(defcustom gg-java-worker-threads 4
+  "Number of threads making asynchronous calls (c.f. `gg-call-async').
+Takes effect when the JVM is (re)started."
+  :type 'integer
+  :set (lambda (symbol value)
+         (gg--set-worker-threads value)
+         (set-default symbol value))
+  :group 'gargoyle)
+
+(defvar gg--notify-hook nil
+  "Functions run on the Emacs thread when native threads have
+something for Lisp (c.f. notify.c).")
+
+(defvar gg--notify-process nil)
+
+(defvar gg--notify-timer nil
+  "Polls for notifications when there is no `gg--notify-process'.")
+
+(defun gg--run-notify-hook (&rest _)
+  (run-hooks 'gg--notify-hook))
+
+(defun gg--notify-setup ()
+  "Set up the notification pipe, or a polling timer on Emacs versions
+without `open_channel' in the module API."
+  (unless (or (process-live-p gg--notify-process) gg--notify-timer)
+    (setq gg--notify-process
+          (make-pipe-process :name " *gargoyle-notify*"
+                             :coding 'binary
+                             :noquery t
+                             :filter #'gg--run-notify-hook))
+    (unless (gg--notify-open gg--notify-process)
+      (delete-process gg--notify-process)
+      (setq gg--notify-process nil)
+      (setq gg--notify-timer (run-with-timer 0.02 0.02 #'gg--run-notify-hook)))))
+
+(cl-defstruct (gg-future (:constructor gg--make-future (id)))
+  "The result of an asynchronous Java call."
+  id
+  (state 'pending)
+  value
+  error
+  callbacks)
+
+(defvar gg--futures (make-hash-table)
+  "Pending futures by call ID.")
+
+(defun gg--collect-futures ()
+  "Resolve the futures of completed calls and run their callbacks."
+  (when (and (> (hash-table-count gg--futures) 0) (gg-java-running))
+    (dolist (completed (gg--collect-completed-raw))
+      (let ((future (gethash (car completed) gg--futures)))
+        (when future
+          (remhash (car completed) gg--futures)
+          (if (nth 1 completed)
+              (setf (gg-future-state future) 'done
+                    (gg-future-value future) (nth 2 completed))
+            (setf (gg-future-state future) 'failed
+                  (gg-future-error future) (nth 2 completed)))
+          (dolist (callback (nreverse (gg-future-callbacks future)))
+            (with-demoted-errors "Error in gg-future callback: %S"
+              (funcall callback future)))
+          (setf (gg-future-callbacks future) nil))))))
+
+(add-hook 'gg--notify-hook #'gg--collect-futures)
+
+(defun gg--call-async (object resolved args)
+  (gg--notify-setup)
+  (let ((future (gg--make-future
+                 (gg--call-method-async-raw object (car resolved)
+                                            (gg--marshal-args (cdr resolved) args)))))
+    (puthash (gg-future-id future) future gg--futures)
+    future))
+
+(defun gg-call-async (object method-name &rest args)
+  "Like `gg-call' but the call is made on a worker thread. Returns a
+`gg-future' right away (c.f. `gg-future-get', `gg-future-then')."
+  (gg--call-async object
+                  (gg--resolve-method (gg--object-class object) method-name nil args)
+                  args))
+
+(defun gg-call-static-async (class-or-name method-name &rest args)
+  "Like `gg-call-static' but the call is made on a worker thread.
+Returns a `gg-future' right away."
+  (let ((class-name-sym (if (gg-objectp class-or-name)
+                            (gg-get-class-name class-or-name)
+                          class-or-name)))
+    (gg--call-async nil (gg--resolve-method class-name-sym method-name t args) args)))
+
+(defun gg-future-done-p (future)
+  "Return non-nil if the call of FUTURE has completed (or failed)."
+  (not (eq (gg-future-state future) 'pending)))
+
+(defun gg-future-then (future callback)
+  "Call CALLBACK with FUTURE on the Emacs thread once it's done."
+  (if (gg-future-done-p future)
+      (funcall callback future)
+    (push callback (gg-future-callbacks future)))
+  future)
+
+(defun gg-future-get (future &optional timeout)
+  "Wait up to TIMEOUT seconds (forever if nil) for FUTURE and return
+its value. The Java exception of a failed call is signaled."
+  (let ((deadline (and timeout (+ (float-time) timeout))))
+    (while (not (gg-future-done-p future))
+      (gg--collect-futures)
+      (unless (gg-future-done-p future)
+        (unless (gg-java-running)
+          (error "JVM stopped before Java call %d completed" (gg-future-id future)))
+        (when (and deadline (>= (float-time) deadline))
+          (signal 'java-timeout (list timeout)))
+        (sleep-for 0.005))))
+  (if (eq (gg-future-state future) 'failed)
+      (signal (car (gg-future-error future)) (cdr (gg-future-error future)))
+    (gg-future-value future)))
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Events from Java
+
+(defcustom gg-event-capacity 8192
+  "Number of events posted from Java that are buffered until Emacs
+takes them. Further events are dropped (c.f. `gg-events-dropped').
+Takes effect when the JVM is (re)started."
+  :type 'integer
+  :set (lambda (symbol value)
+         (gg--set-event-capacity value)
+         (set-default symbol value))
+  :group 'gargoyle)
+
+(defcustom gg-event-batch-size 1024
+  "Maximum number of events from Java handled at once. The rest are
+handled after Emacs has had a chance to run."
+  :type 'integer
+  :group 'gargoyle)
+
+(defvar gg--event-handlers (make-hash-table :test 'eq)
+  "Lists of handler functions by event type symbol.")
+
+(defun gg-add-event-handler (type function)
+  "Call FUNCTION with the data of each event of TYPE (a symbol)
+posted from Java with gargoyle.Events.post(type, data). String data
+is passed as a Lisp string, other objects as Java objects."
+  (gg--notify-setup)
+  (cl-pushnew function (gethash type gg--event-handlers)))
+
+(defun gg-remove-event-handler (type function)
+  (let ((handlers (delq function (gethash type gg--event-handlers))))
+    (if handlers
+        (puthash type handlers gg--event-handlers)
+      (remhash type gg--event-handlers))))
+
+(defun gg--dispatch-events ()
+  (when (gg-java-running)
+    (dolist (event (gg--drain-events-raw gg-event-batch-size))
+      (dolist (handler (gethash (car event) gg--event-handlers))
+        (with-demoted-errors "Error in gg event handler: %S"
+          (funcall handler (cdr event)))))))
+
+(add-hook 'gg--notify-hook #'gg--dispatch-events)
+
+;; Loaded classes (`gg-loaded-classes' and `gg-package-classes' are native)
+(defvar gg--classpath-indexed nil
+  "The jars of `gg-java-classpath' in the class path index.")
+
+(defun gg--classpath-index ()
+  "Rebuild the class path index if `gg-java-classpath' changed.
+Only jars are indexed, not directories."
+  (let ((jars (cl-remove-if-not
+               (lambda (entry)
+                 (and (string-match-p "\\.[jJ][aA][rR]\\'" entry)
+                      (file-regular-p entry)))
+               (mapcar #'expand-file-name gg-java-classpath))))
+    (unless (equal jars gg--classpath-indexed)
+      (gg--jar-index-clear)
+      (setq gg--classpath-indexed nil)
+      (dolist (jar jars)
+        (with-demoted-errors "Gargoyle: %S"
+          (gg--jar-index-add jar)))
+      (setq gg--classpath-indexed jars))))
+
+(defun gg-classpath-classes (&optional prefix)
+  "Return the names of the classes in the jars of
+`gg-java-classpath' (starting with the string PREFIX) as a sorted
+list of symbols. This reads the jars' directories only, the JVM
+doesn't have to be running and no class is loaded."
+  (gg--classpath-index)
+  (gg--jar-index-query prefix))
+
+(defun gg--class-name-completion-table (string pred action)
+  (complete-with-action action
+                        (delete-dups
+                         (mapcar #'symbol-name
+                                 (append (when (gg-java-running)
+                                           (gg-loaded-classes string))
+                                         (gg-classpath-classes string))))
+                        string pred))
+
+(defun gg-read-class-name (prompt &optional initial-input)
+  "Read the name of a loaded Java class or a class on
+`gg-java-classpath' in the minibuffer, with completion, and return
+it as a symbol. Completion doesn't load any classes."
+  (intern (completing-read prompt #'gg--class-name-completion-table
+                           nil nil initial-input)))
+
+(defun gg-array-to-vector (array &optional start end)
+  "Copy the elements of the primitive ARRAY (optionally the range
+START to END) to a new vector."
+  (gg--array-to-vector-raw array start end))
+
+(defun gg-vector-to-array (type vector &optional start end)
+  "Create a new primitive array of TYPE (one of z, b, c, s, i, j, f
+or d) from the elements of VECTOR (optionally the range START to
+END)."
+  (gg--vector-to-array-raw type vector start end))
+
+(defun gg-byte-array-to-string (array &optional start end)
+  "Copy the byte ARRAY (optionally the range START to END) to a new
+unibyte string."
+  (gg--byte-array-to-string-raw array start end))
 
-(defun gg--class-add-by-obj (class))
+(defun gg-string-to-byte-array (string)
+  "Create a new byte array from STRING. Unibyte strings are copied
+byte for byte, multibyte strings are encoded as UTF-8."
+  (gg--string-to-byte-array-raw string))
 
 (defun gg-get-class-name (class)
-  (gg--get-class-name-raw (cadr class)))
+  (gg--get-class-name-raw class))
 
 (defun gg-get-superclass (class)
-  (gg--get-superclass-raw (cadr class)))
+  (gg--get-superclass-raw class))
 
 (provide 'gargoyle)
 
@@ -0,0 +1,395 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emacs-module.h>
+#include <jni.h>
+
+#include "array.h"
+#include "ctrl.h"
+#include "el_util.h"
+#include "handle.h"
+
+/*
+ * Number of elements copied per JNI region call. Large arrays are
+ * moved to and from vectors in chunks of this size so we never need a
+ * second full copy of the array on the C side. (Byte arrays and
+ * strings are handled separately, c.f. `Fgg_byte_array_to_string_raw'.)
+ */
+#define CHUNK_SIZE 4096
+
+/* Chunk buffer, only used from the Emacs thread */
+static union {
+    jboolean z[CHUNK_SIZE];
+    jbyte b[CHUNK_SIZE];
+    jchar c[CHUNK_SIZE];
+    jshort s[CHUNK_SIZE];
+    jint i[CHUNK_SIZE];
+    jlong j[CHUNK_SIZE];
+    jfloat f[CHUNK_SIZE];
+    jdouble d[CHUNK_SIZE];
+} chunk;
+
+/*
+ * Element type of a primitive array as a descriptor char, or 0 if it's
+ * not a primitive array
+ */
+static char array_kind(jarray array)
+{
+    if ((*g_jni)->IsInstanceOf(g_jni, array, g_byte_array_class)) return 'B';
+    if ((*g_jni)->IsInstanceOf(g_jni, array, g_int_array_class)) return 'I';
+    if ((*g_jni)->IsInstanceOf(g_jni, array, g_long_array_class)) return 'J';
+    if ((*g_jni)->IsInstanceOf(g_jni, array, g_double_array_class)) return 'D';
+    if ((*g_jni)->IsInstanceOf(g_jni, array, g_char_array_class)) return 'C';
+    if ((*g_jni)->IsInstanceOf(g_jni, array, g_short_array_class)) return 'S';
+    if ((*g_jni)->IsInstanceOf(g_jni, array, g_float_array_class)) return 'F';
+    if ((*g_jni)->IsInstanceOf(g_jni, array, g_boolean_array_class)) return 'Z';
+    return 0;
+}
+
+/*
+ * Element type given as one of the `gg--call-method-raw' type symbols
+ */
+static char type_symbol_kind(emacs_env *env, emacs_value type)
+{
+    if (env->eq(env, type, Qz)) return 'Z';
+    if (env->eq(env, type, Qb)) return 'B';
+    if (env->eq(env, type, Qc)) return 'C';
+    if (env->eq(env, type, Qs)) return 'S';
+    if (env->eq(env, type, Qi)) return 'I';
+    if (env->eq(env, type, Qj)) return 'J';
+    if (env->eq(env, type, Qf)) return 'F';
+    if (env->eq(env, type, Qd)) return 'D';
+    return 0;
+}
+
+/*
+ * Resolve the optional START and END arguments (at `args[first]' and
+ * `args[first + 1]') against `length'. Returns 0 with a pending
+ * `args-out-of-range' if they're invalid.
+ */
+static int get_range(emacs_env *env, ptrdiff_t nargs, emacs_value args[], int first,
+                     jsize length, jsize *start, jsize *end)
+{
+    intmax_t s = 0, e = length;
+
+    if (nargs > first && env->is_not_nil(env, args[first])) {
+        s = env->extract_integer(env, args[first]);
+    }
+    if (nargs > first + 1 && env->is_not_nil(env, args[first + 1])) {
+        e = env->extract_integer(env, args[first + 1]);
+    }
+    if (env->non_local_exit_check(env) != emacs_funcall_exit_return) {
+        return 0;
+    }
+    if (s < 0 || e < s || e > length) {
+        env->non_local_exit_signal(env, Qargs_out_of_range,
+                                   list(env, 3, env->make_integer(env, length),
+                                        env->make_integer(env, s), env->make_integer(env, e)));
+        return 0;
+    }
+    *start = s;
+    *end = e;
+    return 1;
+}
+
+static jarray get_primitive_array(emacs_env *env, emacs_value value, char *kind)
+{
+    static const char *errmsg = "Expected primitive array:";
+    jarray array;
+
+    array = handle_get(env, value);
+    if (!array) {
+        return NULL;
+    }
+    *kind = array_kind(array);
+    if (!*kind) {
+        env->non_local_exit_signal(env, Qwrong_type_argument,
+                                   list(env, 2, env->make_string(env, errmsg, strlen(errmsg)), value));
+        return NULL;
+    }
+    return array;
+}
+
+/*
+ * (gg--array-to-vector-raw ARRAY &optional START END)
+ *
+ * Copy (a range of) a raw primitive array to a new Lisp vector.
+ */
+emacs_value
+Fgg_array_to_vector_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    jarray array;
+    char kind;
+    jsize start, end, i, j, n;
+    emacs_value make_vector_args[2];
+    emacs_value vector;
+
+    ASSERT_JVM_RUNNING(env);
+
+    array = get_primitive_array(env, args[0], &kind);
+    if (!array ||
+        !get_range(env, nargs, args, 1, (*g_jni)->GetArrayLength(g_jni, array), &start, &end)) {
+        return NULL;
+    }
+
+    make_vector_args[0] = env->make_integer(env, end - start);
+    make_vector_args[1] = Qnil;
+    vector = env->funcall(env, Qmake_vector, 2, make_vector_args);
+
+#define COPY_OUT(TYPE, FIELD, TO_LISP)                                  \
+    (*g_jni)->Get##TYPE##ArrayRegion(g_jni, array, i, n, chunk.FIELD);  \
+    for (j = 0; j < n; ++j) {                                           \
+        env->vec_set(env, vector, i - start + j, TO_LISP(chunk.FIELD[j])); \
+    }
+#define BOOLEAN_TO_LISP(X) ((X) ? Qt : Qnil)
+#define INTEGER_TO_LISP(X) env->make_integer(env, (X))
+#define FLOAT_TO_LISP(X) env->make_float(env, (X))
+
+    for (i = start; i < end; i += n) {
+        n = end - i < CHUNK_SIZE ? end - i : CHUNK_SIZE;
+        switch (kind) {
+        case 'Z': COPY_OUT(Boolean, z, BOOLEAN_TO_LISP); break;
+        case 'B': COPY_OUT(Byte, b, INTEGER_TO_LISP); break;
+        case 'C': COPY_OUT(Char, c, INTEGER_TO_LISP); break;
+        case 'S': COPY_OUT(Short, s, INTEGER_TO_LISP); break;
+        case 'I': COPY_OUT(Int, i, INTEGER_TO_LISP); break;
+        case 'J': COPY_OUT(Long, j, INTEGER_TO_LISP); break;
+        case 'F': COPY_OUT(Float, f, FLOAT_TO_LISP); break;
+        case 'D': COPY_OUT(Double, d, FLOAT_TO_LISP); break;
+        }
+        if (handle_exception(env)) { return NULL; }
+    }
+#undef COPY_OUT
+
+    return vector;
+}
+
+/*
+ * (gg--vector-to-array-raw TYPE VECTOR &optional START END)
+ *
+ * Create a new primitive array from (a range of) a Lisp vector. TYPE
+ * is one of the `gg--call-method-raw' primitive type symbols.
+ */
+emacs_value
+Fgg_vector_to_array_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    static const char *errmsg = "Expected primitive type symbol:";
+    char kind;
+    jsize start, end, i, j, n;
+    jarray array = NULL;
+    emacs_value wrapped;
+    emacs_value value;
+
+    ASSERT_JVM_RUNNING(env);
+
+    kind = type_symbol_kind(env, args[0]);
+    if (!kind) {
+        env->non_local_exit_signal(env, Qwrong_type_argument,
+                                   list(env, 2, env->make_string(env, errmsg, strlen(errmsg)), args[0]));
+        return NULL;
+    }
+    if (!type_is(env, args[1], Qvector) ||
+        !get_range(env, nargs, args, 2, env->vec_size(env, args[1]), &start, &end)) {
+        return NULL;
+    }
+
+    switch (kind) {
+    case 'Z': array = (*g_jni)->NewBooleanArray(g_jni, end - start); break;
+    case 'B': array = (*g_jni)->NewByteArray(g_jni, end - start); break;
+    case 'C': array = (*g_jni)->NewCharArray(g_jni, end - start); break;
+    case 'S': array = (*g_jni)->NewShortArray(g_jni, end - start); break;
+    case 'I': array = (*g_jni)->NewIntArray(g_jni, end - start); break;
+    case 'J': array = (*g_jni)->NewLongArray(g_jni, end - start); break;
+    case 'F': array = (*g_jni)->NewFloatArray(g_jni, end - start); break;
+    case 'D': array = (*g_jni)->NewDoubleArray(g_jni, end - start); break;
+    }
+    if (handle_exception(env)) { return NULL; }
+
+#define COPY_IN(TYPE, FIELD, FROM_LISP)                                 \
+    for (j = 0; j < n; ++j) {                                           \
+        value = env->vec_get(env, args[1], i + j);                      \
+        chunk.FIELD[j] = FROM_LISP(value);                              \
+    }                                                                   \
+    if (env->non_local_exit_check(env) == emacs_funcall_exit_return) {  \
+        (*g_jni)->Set##TYPE##ArrayRegion(g_jni, array, i - start, n, chunk.FIELD); \
+    }
+#define BOOLEAN_FROM_LISP(X) env->is_not_nil(env, (X))
+#define INTEGER_FROM_LISP(X) env->extract_integer(env, (X))
+#define FLOAT_FROM_LISP(X) (env->eq(env, env->type_of(env, (X)), Qinteger) ? \
+                            env->extract_integer(env, (X)) : env->extract_float(env, (X)))
+
+    for (i = start; i < end; i += n) {
+        n = end - i < CHUNK_SIZE ? end - i : CHUNK_SIZE;
+        switch (kind) {
+        case 'Z': COPY_IN(Boolean, z, BOOLEAN_FROM_LISP); break;
+        case 'B': COPY_IN(Byte, b, INTEGER_FROM_LISP); break;
+        case 'C': COPY_IN(Char, c, INTEGER_FROM_LISP); break;
+        case 'S': COPY_IN(Short, s, INTEGER_FROM_LISP); break;
+        case 'I': COPY_IN(Int, i, INTEGER_FROM_LISP); break;
+        case 'J': COPY_IN(Long, j, INTEGER_FROM_LISP); break;
+        case 'F': COPY_IN(Float, f, FLOAT_FROM_LISP); break;
+        case 'D': COPY_IN(Double, d, FLOAT_FROM_LISP); break;
+        }
+        if (env->non_local_exit_check(env) != emacs_funcall_exit_return || handle_exception(env)) {
+            (*g_jni)->DeleteLocalRef(g_jni, array);
+            return NULL;
+        }
+    }
+#undef COPY_IN
+
+    wrapped = new_java_object(env, array, NULL);
+    (*g_jni)->DeleteLocalRef(g_jni, array);
+    return wrapped;
+}
+
+/*
+ * (gg--byte-array-to-string-raw ARRAY &optional START END)
+ *
+ * Copy (a range of) a raw byte[] to a new unibyte string.
+ *
+ * On Emacs 28+ the string is made straight from the pinned array, so
+ * there is no copy besides the string. Older Emacs can only make
+ * multibyte strings: the bytes are converted to a Latin-1 string
+ * through a UTF-8 buffer of up to twice the range and then encoded,
+ * which costs up to two more copies of the range while encoding.
+ */
+emacs_value
+Fgg_byte_array_to_string_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    static const char *errmsg = "Expected byte array:";
+    jarray array;
+    char kind;
+    jsize start, end;
+    char *bytes;
+    emacs_value string;
+    jsize i, j, n;
+    ptrdiff_t length = 0;
+    int non_ascii = 0;
+    emacs_value encode_args[2];
+    unsigned char byte;
+
+    ASSERT_JVM_RUNNING(env);
+
+    array = get_primitive_array(env, args[0], &kind);
+    if (!array) {
+        return NULL;
+    }
+    if (kind != 'B') {
+        env->non_local_exit_signal(env, Qwrong_type_argument,
+                                   list(env, 2, env->make_string(env, errmsg, strlen(errmsg)), args[0]));
+        return NULL;
+    }
+    if (!get_range(env, nargs, args, 1, (*g_jni)->GetArrayLength(g_jni, array), &start, &end)) {
+        return NULL;
+    }
+
+#if defined(EMACS_MAJOR_VERSION) && EMACS_MAJOR_VERSION >= 28
+    /* the module may be loaded into an older Emacs */
+    if (env->size >= sizeof(struct emacs_env_28)) {
+        /* no JNI calls until it's released, making the string doesn't
+         * call back into Java (finalized handles are only queued) */
+        bytes = (*g_jni)->GetPrimitiveArrayCritical(g_jni, array, NULL);
+        if (!bytes) {
+            handle_exception(env);
+            return NULL;
+        }
+        string = env->make_unibyte_string(env, bytes + start, end - start);
+        (*g_jni)->ReleasePrimitiveArrayCritical(g_jni, array, bytes, JNI_ABORT);
+        return string;
+    }
+#endif
+
+    /* No unibyte strings in the module API: build a Latin-1 string
+     * (one char per byte) and encode it. */
+    bytes = malloc(2 * (end - start) + 1);
+    assert(bytes);
+    for (i = start; i < end; i += n) {
+        n = end - i < CHUNK_SIZE ? end - i : CHUNK_SIZE;
+        (*g_jni)->GetByteArrayRegion(g_jni, array, i, n, chunk.b);
+        if (handle_exception(env)) {
+            free(bytes);
+            return NULL;
+        }
+        for (j = 0; j < n; ++j) {
+            byte = chunk.b[j];
+            if (byte < 0x80) {
+                bytes[length++] = byte;
+            } else {
+                bytes[length++] = 0xC0 | (byte >> 6);
+                bytes[length++] = 0x80 | (byte & 0x3F);
+                non_ascii = 1;
+            }
+        }
+    }
+    string = env->make_string(env, bytes, length);
+    free(bytes);
+    if (non_ascii) {
+        encode_args[0] = string;
+        encode_args[1] = Qlatin_1;
+        string = env->funcall(env, Qencode_coding_string, 2, encode_args);
+    }
+    return string;
+}
+
+/*
+ * (gg--string-to-byte-array-raw STRING)
+ *
+ * Create a new byte[] from a string. Unibyte strings are copied byte
+ * for byte, multibyte strings as UTF-8.
+ */
+emacs_value
+Fgg_string_to_byte_array_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    ptrdiff_t size = 0;
+    char *bytes;
+    jarray array;
+    emacs_value wrapped;
+
+    if (!type_is(env, args[0], Qstring)) {
+        return NULL;
+    }
+
+    ASSERT_JVM_RUNNING(env);
+
+    env->copy_string_contents(env, args[0], NULL, &size);
+    bytes = malloc(size);
+    assert(bytes);
+    env->copy_string_contents(env, args[0], bytes, &size);
+
+    /* size includes the terminating NUL */
+    array = (*g_jni)->NewByteArray(g_jni, size - 1);
+    if (array) {
+        (*g_jni)->SetByteArrayRegion(g_jni, array, 0, size - 1, (jbyte *) bytes);
+    }
+    free(bytes);
+    if (handle_exception(env)) { return NULL; }
+
+    wrapped = new_java_object(env, array, NULL);
+    (*g_jni)->DeleteLocalRef(g_jni, array);
+    return wrapped;
+}
@@ -0,0 +1,34 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Bulk transfer of primitive arrays between Java and Lisp
+ */
+
+#include <emacs-module.h>
+
+emacs_value Fgg_array_to_vector_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_vector_to_array_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_byte_array_to_string_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_string_to_byte_array_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
@@ -0,0 +1,484 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emacs-module.h>
+#include <jvmti.h>
+#include <jni.h>
+#include <classfile_constants.h>
+
+#include "call.h"
+#include "ctrl.h"
+#include "el_util.h"
+#include "handle.h"
+#include "hashtab.h"
+#include "sig.h"
+
+#define MAX_METHOD_NAME_SIZE 256
+#define MAX_METHOD_SIG_SIZE 1024
+
+/* jmethodID -> struct call_info * */
+static struct hashtab *call_infos;
+
+/* Method ID user-ptrs are distinguished from objects by their finalizer */
+static void method_id_finalizer(void *x)
+{
+}
+
+static void free_call_info(void *x)
+{
+    struct call_info *info = x;
+    int i;
+    if (info->declaring_class && g_jni) {
+        (*g_jni)->DeleteGlobalRef(g_jni, info->declaring_class);
+    }
+    for (i = 0; info->arg_classes && i < info->sig->arg_count; ++i) {
+        if (info->arg_classes[i] && g_jni) {
+            (*g_jni)->DeleteGlobalRef(g_jni, info->arg_classes[i]);
+        }
+    }
+    free(info->arg_classes);
+    free(info);
+}
+
+void call_info_flush_all()
+{
+    if (call_infos) {
+        hashtab_clear(call_infos, free_call_info);
+    }
+}
+
+/*
+ * Resolve the classes of a method's object parameters, so arguments
+ * can be checked before the call. The method's own view of them
+ * (through reflection) accounts for its class loader. Returns 0 with a
+ * pending signal on failure.
+ */
+static int resolve_arg_classes(emacs_env *env, struct call_info *info, jmethodID method)
+{
+    jobject reflected;
+    jobjectArray types;
+    jobject type;
+    int i;
+
+    info->arg_classes = calloc(info->sig->arg_count ? info->sig->arg_count : 1, sizeof(jclass));
+    assert(info->arg_classes);
+    for (i = 0; i < info->sig->arg_count && info->sig->args[i].kind != 'L'; ++i) {
+    }
+    if (i == info->sig->arg_count) {
+        return 1;
+    }
+
+    reflected = (*g_jni)->ToReflectedMethod(g_jni, info->declaring_class, method, info->is_static);
+    types = reflected ? (*g_jni)->CallObjectMethod(g_jni, reflected, g_mid_Executable_getParameterTypes) : NULL;
+    if (!types) {
+        handle_exception(env);
+        return 0;
+    }
+    /* synthetic parameters (e.g. of enum constructors) may be missing,
+     * leave those arguments unchecked rather than guess */
+    if ((*g_jni)->GetArrayLength(g_jni, types) == info->sig->arg_count) {
+        for (i = 0; i < info->sig->arg_count; ++i) {
+            if (info->sig->args[i].kind == 'L') {
+                type = (*g_jni)->GetObjectArrayElement(g_jni, types, i);
+                info->arg_classes[i] = (*g_jni)->NewGlobalRef(g_jni, type);
+                (*g_jni)->DeleteLocalRef(g_jni, type);
+            }
+        }
+    }
+    (*g_jni)->DeleteLocalRef(g_jni, types);
+    (*g_jni)->DeleteLocalRef(g_jni, reflected);
+    return 1;
+}
+
+static struct call_info *get_call_info(emacs_env *env, jmethodID method)
+{
+    struct call_info *info;
+    const struct sig *sig;
+    jint modifiers;
+    jclass declaring_class;
+
+    if (!call_infos) {
+        call_infos = hashtab_new(HASHTAB_POINTER_KEYS);
+    }
+    info = hashtab_get(call_infos, method);
+    if (info) {
+        return info;
+    }
+
+    sig = sig_for_method(env, method);
+    if (!sig) {
+        return NULL;
+    }
+    g_jvmtiError = (*g_jvmti)->GetMethodModifiers(g_jvmti, method, &modifiers);
+    if (check_jvmti_error(env)) {
+        return NULL;
+    }
+    g_jvmtiError = (*g_jvmti)->GetMethodDeclaringClass(g_jvmti, method, &declaring_class);
+    if (check_jvmti_error(env)) {
+        return NULL;
+    }
+
+    info = calloc(1, sizeof(struct call_info));
+    assert(info);
+    info->sig = sig;
+    info->is_static = (modifiers & JVM_ACC_STATIC) != 0;
+    info->declaring_class = (*g_jni)->NewGlobalRef(g_jni, declaring_class);
+    (*g_jni)->DeleteLocalRef(g_jni, declaring_class);
+    if (!resolve_arg_classes(env, info, method)) {
+        free_call_info(info);
+        return NULL;
+    }
+
+    hashtab_put(call_infos, method, info);
+    return info;
+}
+
+/*
+ * The type symbol (as used in `gg--call-method-raw' args) expected for
+ * a descriptor kind
+ */
+static emacs_value kind_type_symbol(char kind)
+{
+    switch (kind) {
+    case 'Z': return Qz;
+    case 'B': return Qb;
+    case 'C': return Qc;
+    case 'S': return Qs;
+    case 'I': return Qi;
+    case 'J': return Qj;
+    case 'F': return Qf;
+    case 'D': return Qd;
+    default: return Ql;
+    }
+}
+
+/*
+ * Convert a typed Lisp value to a jvalue for an argument of the given
+ * kind (and class, if it's known for an object). Returns 0 with a
+ * pending non-local exit on failure.
+ */
+static int lisp_to_jvalue(emacs_env *env, char kind, jclass class, emacs_value type, emacs_value value, jvalue *jv)
+{
+    static const char *errmsg = "Argument type doesn't match method signature:";
+    static const char *class_errmsg = "Argument isn't an instance of the parameter type:";
+    emacs_value expected = kind_type_symbol(kind);
+    emacs_value value_type;
+
+    if (!env->eq(env, type, expected)) {
+        env->non_local_exit_signal(env, Qwrong_type_argument,
+                                   list(env, 3, env->make_string(env, errmsg, strlen(errmsg)), expected, type));
+        return 0;
+    }
+
+    switch (kind) {
+    case 'Z':
+        value_type = env->type_of(env, value);
+        if (env->eq(env, value_type, Qinteger)) {
+            jv->z = env->extract_integer(env, value) != 0;
+        } else {
+            jv->z = env->is_not_nil(env, value);
+        }
+        break;
+    case 'B': jv->b = env->extract_integer(env, value); break;
+    case 'C': jv->c = env->extract_integer(env, value); break;
+    case 'S': jv->s = env->extract_integer(env, value); break;
+    case 'I': jv->i = env->extract_integer(env, value); break;
+    case 'J': jv->j = env->extract_integer(env, value); break;
+    case 'F':
+    case 'D':
+        value_type = env->type_of(env, value);
+        if (env->eq(env, value_type, Qinteger)) {
+            jv->d = env->extract_integer(env, value);
+        } else {
+            jv->d = env->extract_float(env, value);
+        }
+        if (kind == 'F') {
+            jv->f = (jfloat) jv->d;
+        }
+        break;
+    default:
+        if (!env->is_not_nil(env, value)) {
+            jv->l = NULL;
+        } else if (!(jv->l = handle_get(env, value))) {
+            return 0;
+        } else if (class && !(*g_jni)->IsInstanceOf(g_jni, jv->l, class)) {
+            /* the JVM doesn't check, passing it would be undefined behavior */
+            env->non_local_exit_signal(env, Qwrong_type_argument,
+                                       list(env, 2, env->make_string(env, class_errmsg, strlen(class_errmsg)), value));
+            return 0;
+        }
+    }
+    return env->non_local_exit_check(env) == emacs_funcall_exit_return;
+}
+
+void call_invoke(JNIEnv *jni, const struct call_info *info, jmethodID method,
+                 jobject target, int nonvirtual, jvalue *jargs, jvalue *result)
+{
+    jclass class = info->declaring_class;
+
+#define INVOKE(TYPE, FIELD)                                             \
+    if (info->is_static) {                                              \
+        result->FIELD = (*jni)->CallStatic##TYPE##MethodA(jni, target, method, jargs); \
+    } else if (nonvirtual) {                                            \
+        result->FIELD = (*jni)->CallNonvirtual##TYPE##MethodA(jni, target, class, method, jargs); \
+    } else {                                                            \
+        result->FIELD = (*jni)->Call##TYPE##MethodA(jni, target, method, jargs); \
+    }
+
+    switch (info->sig->returns.kind) {
+    case 'Z': INVOKE(Boolean, z); break;
+    case 'B': INVOKE(Byte, b); break;
+    case 'C': INVOKE(Char, c); break;
+    case 'S': INVOKE(Short, s); break;
+    case 'I': INVOKE(Int, i); break;
+    case 'J': INVOKE(Long, j); break;
+    case 'F': INVOKE(Float, f); break;
+    case 'D': INVOKE(Double, d); break;
+    case 'V':
+        if (info->is_static) {
+            (*jni)->CallStaticVoidMethodA(jni, target, method, jargs);
+        } else if (nonvirtual) {
+            (*jni)->CallNonvirtualVoidMethodA(jni, target, class, method, jargs);
+        } else {
+            (*jni)->CallVoidMethodA(jni, target, method, jargs);
+        }
+        result->l = NULL;
+        break;
+    default: INVOKE(Object, l); break;
+    }
+#undef INVOKE
+}
+
+emacs_value call_primitive_to_lisp(emacs_env *env, char kind, jvalue value)
+{
+    switch (kind) {
+    case 'Z': return value.z ? Qt : Qnil;
+    case 'B': return env->make_integer(env, value.b);
+    case 'C': return env->make_integer(env, value.c);
+    case 'S': return env->make_integer(env, value.s);
+    case 'I': return env->make_integer(env, value.i);
+    case 'J': return env->make_integer(env, value.j);
+    case 'F': return env->make_float(env, value.f);
+    case 'D': return env->make_float(env, value.d);
+    default: return Qnil;
+    }
+}
+
+int call_prepare(emacs_env *env, ptrdiff_t nargs, emacs_value args[], struct call *call)
+{
+    emacs_value flat_args;
+    emacs_value apply_args[2];
+    ptrdiff_t i;
+    static const char *arity_errmsg = "Wrong number of arguments for method:";
+    static const char *target_errmsg = "Target isn't an instance of the method's class:";
+
+    call->args = call->stack_args;
+    call->nonvirtual = nargs > 3 && env->is_not_nil(env, args[3]);
+
+    if (!type_is(env, args[1], Quser_ptr)) {
+        return 0;
+    }
+    if (env->get_user_finalizer(env, args[1]) != method_id_finalizer) {
+        env->non_local_exit_signal(env, Qwrong_type_argument,
+                                   list(env, 2, env->make_string(env, "Expected method ID:", 19), args[1]));
+        return 0;
+    }
+    call->method = env->get_user_ptr(env, args[1]);
+
+    call->info = get_call_info(env, call->method);
+    if (!call->info) {
+        return 0;
+    }
+
+    /* target, the JVM doesn't check it */
+    if (call->info->is_static) {
+        if (env->is_not_nil(env, args[0]) &&
+            (!(call->target = handle_get(env, args[0])) ||
+             !(*g_jni)->IsInstanceOf(g_jni, call->target, g_java_lang_Class))) {
+            if (env->non_local_exit_check(env) == emacs_funcall_exit_return) {
+                env->non_local_exit_signal(env, Qwrong_type_argument,
+                                           list(env, 2, env->make_string(env, "Expected class for static method:", 33), args[0]));
+            }
+            return 0;
+        }
+        /* static methods are always invoked on their declaring class */
+        call->target = call->info->declaring_class;
+    } else if (!(call->target = handle_get(env, args[0]))) {
+        return 0;
+    } else if (!(*g_jni)->IsInstanceOf(g_jni, call->target, call->info->declaring_class)) {
+        env->non_local_exit_signal(env, Qwrong_type_argument,
+                                   list(env, 2, env->make_string(env, target_errmsg, strlen(target_errmsg)), args[0]));
+        return 0;
+    }
+
+    /* args, flattened to [type value type value ...] */
+    if (env->eq(env, env->type_of(env, args[2]), Qvector)) {
+        flat_args = args[2];
+    } else {
+        apply_args[0] = Qvconcat;
+        apply_args[1] = args[2];
+        flat_args = env->funcall(env, Qapply, 2, apply_args);
+        if (env->non_local_exit_check(env) != emacs_funcall_exit_return) {
+            return 0;
+        }
+    }
+    if (env->vec_size(env, flat_args) != 2 * call->info->sig->arg_count) {
+        env->non_local_exit_signal(env, Qwrong_number_of_arguments,
+                                   list(env, 3, env->make_string(env, arity_errmsg, strlen(arity_errmsg)),
+                                        env->make_integer(env, call->info->sig->arg_count), args[2]));
+        return 0;
+    }
+
+    if (call->info->sig->arg_count > STACK_ARGS) {
+        call->args = malloc(sizeof(jvalue) * call->info->sig->arg_count);
+        assert(call->args);
+    }
+    for (i = 0; i < call->info->sig->arg_count; ++i) {
+        if (!lisp_to_jvalue(env, call->info->sig->args[i].kind, call->info->arg_classes[i],
+                            env->vec_get(env, flat_args, 2 * i),
+                            env->vec_get(env, flat_args, 2 * i + 1),
+                            &call->args[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void call_release(struct call *call)
+{
+    if (call->args != call->stack_args) {
+        free(call->args);
+        call->args = call->stack_args;
+    }
+}
+
+/*
+ * (gg--call-method-raw TARGET METHOD-ID ARGS &optional NONVIRTUAL)
+ *
+ * Call a method. TARGET is an object (or nil or a class, which is only
+ * checked, for static methods). ARGS is a list of (TYPE VALUE) pairs
+ * as described in type-mapping.org, or a vector of alternating types
+ * and values. Objects must be instances of the declared types. If
+ * NONVIRTUAL is non-nil, the implementation in the method's declaring
+ * class is called regardless of overriding.
+ *
+ * Primitive return values are returned as Lisp numbers (t/nil for
+ * booleans).
+ */
+emacs_value
+Fgg_call_method_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    struct call call;
+    jvalue value;
+    emacs_value result = NULL;
+
+    ASSERT_JVM_RUNNING(env);
+
+    if (!call_prepare(env, nargs, args, &call)) {
+        call_release(&call);
+        return NULL;
+    }
+
+    call_invoke(g_jni, call.info, call.method, call.target, call.nonvirtual, call.args, &value);
+    call_release(&call);
+    if (handle_exception(env)) { return NULL; }
+
+    if (call.info->sig->returns.kind != 'L') {
+        result = call_primitive_to_lisp(env, call.info->sig->returns.kind, value);
+    } else if (!value.l) {
+        result = Qnil;
+    } else {
+        result = new_java_object(env, value.l, NULL);
+        (*g_jni)->DeleteLocalRef(g_jni, value.l);
+    }
+    return result;
+}
+
+/*
+ * (gg--get-method-id-raw CLASS NAME SIGNATURE &optional STATIC)
+ *
+ * Look up a method ID given the raw class, method name and JVM
+ * signature, e.g. "(I)Ljava/lang/Object;".
+ */
+emacs_value
+Fgg_get_method_id_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    char name_buffer[MAX_METHOD_NAME_SIZE], sig_buffer[MAX_METHOD_SIG_SIZE];
+    char *name = name_buffer, *sig = sig_buffer;
+    ptrdiff_t name_size, sig_size;
+    jclass class;
+    jmethodID method = NULL;
+
+    if (!type_is(env, args[1], Qstring) ||
+        !type_is(env, args[2], Qstring)) {
+        return NULL;
+    }
+
+    ASSERT_JVM_RUNNING(env);
+
+    /* the buffers are only a fast path, there's no length limit */
+    env->copy_string_contents(env, args[1], NULL, &name_size);
+    env->copy_string_contents(env, args[2], NULL, &sig_size);
+    if (name_size > MAX_METHOD_NAME_SIZE) {
+        name = malloc(name_size);
+        assert(name);
+    }
+    if (sig_size > MAX_METHOD_SIG_SIZE) {
+        sig = malloc(sig_size);
+        assert(sig);
+    }
+    if (!env->copy_string_contents(env, args[1], name, &name_size) ||
+        !env->copy_string_contents(env, args[2], sig, &sig_size)) {
+        goto done;
+    }
+
+    class = handle_get(env, args[0]);
+    if (!class) {
+        goto done;
+    }
+    if (nargs > 3 && env->is_not_nil(env, args[3])) {
+        method = (*g_jni)->GetStaticMethodID(g_jni, class, name, sig);
+    } else {
+        method = (*g_jni)->GetMethodID(g_jni, class, name, sig);
+    }
+    if (!method) {
+        handle_exception(env);
+    }
+
+done:
+    if (name != name_buffer) {
+        free(name);
+    }
+    if (sig != sig_buffer) {
+        free(sig);
+    }
+    if (!method) {
+        return NULL;
+    }
+    return env->make_user_ptr(env, method_id_finalizer, method);
+}
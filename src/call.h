@@ -0,0 +1,85 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Java method invocation (c.f. "Implementation" in type-mapping.org)
+ */
+
+#include <emacs-module.h>
+
+#include <jni.h>
+
+#include "sig.h"
+
+/*
+ * Number of arguments marshalled without allocation
+ */
+#define STACK_ARGS 16
+
+/*
+ * What we need to know to invoke a method. Built once per method from
+ * JVMTI.
+ */
+struct call_info {
+    const struct sig *sig;  /* owned by the descriptor cache (sig.c) */
+    int is_static;
+    jclass declaring_class; /* global ref */
+    jclass *arg_classes;    /* global refs of the object parameter types, NULL for primitives */
+};
+
+/*
+ * A resolved and marshalled call (c.f. `call_prepare')
+ */
+struct call {
+    jmethodID method;
+    struct call_info *info;
+    jobject target;         /* the declaring class for static methods */
+    int nonvirtual;
+    jvalue *args;           /* `stack_args' unless there are too many */
+    jvalue stack_args[STACK_ARGS];
+};
+
+emacs_value Fgg_get_method_id_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_call_method_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+void call_info_flush_all();
+
+/*
+ * Resolve and marshal a call from the `gg--call-method-raw'
+ * arguments. Returns 0 with a pending signal on failure. Either way
+ * `call_release' must be called when done.
+ */
+int call_prepare(emacs_env *env, ptrdiff_t nargs, emacs_value args[], struct call *call);
+void call_release(struct call *call);
+
+/*
+ * Invoke a method on the given JNI env (any thread). Exceptions are
+ * left pending and an object result is a local ref.
+ */
+void call_invoke(JNIEnv *jni, const struct call_info *info, jmethodID method,
+                 jobject target, int nonvirtual, jvalue *jargs, jvalue *result);
+
+/*
+ * Convert a primitive (or void) result of the given descriptor kind
+ */
+emacs_value call_primitive_to_lisp(emacs_env *env, char kind, jvalue value);
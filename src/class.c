@@ -31,36 +31,39 @@
 #include <jni.h>
 #include <classfile_constants.h>
 
+#include "class_cache.h"
+#include "class_store.h"
 #include "ctrl.h"
 #include "el_util.h"
-
-#define GG_ARRAY_TAG "gg-array"
-#define GG_PRIMITIVE_TAG "gg-prim"
+#include "handle.h"
+#include "hashtab.h"
+#include "jar_index.h"
 
 /*
  * An arbitrary number
  */
 #define MAX_CLASS_NAME_SIZE 128
 
-static void class_name_to_fq(char *class_name)
-{
-    int i;
-    for (i = 0; i < MAX_CLASS_NAME_SIZE && class_name[i]; ++i) {
-        if (class_name[i] == '/' || class_name[i] == '$') {
-            class_name[i] = '.';
-        }
-    }
-}
-
 /*
  * Convert (in-place) a class name to internal format, i.e. replace
  * '.' with '/' and handle inner classes:
  * java.lang.Object -> java/lang/Object
  * com.x.Y.Z -> com/x/Y$Z
+ * Inner classes are found in the jar index if it has the class,
+ * otherwise they're assumed to start after the first capitalized
+ * name.
  */
 static void class_name_to_internal(char *class_name)
 {
     int i;
+    if (jar_index_resolve(class_name)) {
+        for (i = 0; class_name[i]; ++i) {
+            if (class_name[i] == '.') {
+                class_name[i] = '/';
+            }
+        }
+        return;
+    }
     /* Are we past the class when transforming class name string? If
      * so, use "$" instead of "/". Eg. com.x.Class.Other ->
      * com/x/Class$Other
@@ -86,18 +89,17 @@ Fgg_get_superclass_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], voi
     jclass class;
     jclass superclass;
 
-    if (!type_is(env, args[0], "user-ptr")) {
-        return NULL;
-    }
-
     ASSERT_JVM_RUNNING(env);
 
-    class = env->get_user_ptr(env, args[0]);
+    class = handle_get(env, args[0]);
+    if (!class) {
+        return NULL;
+    }
 
     superclass = (*g_jni)->GetSuperclass(g_jni, class);
     if (handle_exception(env)) { return NULL; }
     if (superclass == NULL) {
-        return env->intern (env, "nil");
+        return Qnil;
     } else {
         return new_java_object(env, superclass, NULL);
     }
@@ -112,7 +114,7 @@ Fgg_find_class (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
     jclass class;
     emacs_value retval;
 
-    if (!type_is(env, args[0], "string")) {
+    if (!type_is(env, args[0], Qstring)) {
         return NULL;
     }
 
@@ -137,214 +139,196 @@ Fgg_find_class (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
 emacs_value
 Fgg_get_class_name_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
 {
+    jclass class;
+
     /* TODO, we could also check the pointer is a class, otherwise
      * GetMethodID will fail */
 
-    if (!type_is(env, args[0], "user-ptr")) {
-        return NULL;
-    }
-
     ASSERT_JVM_RUNNING(env);
 
-    return jclass_to_symbol(env, env->get_user_ptr(env, args[0]));
+    class = handle_get(env, args[0]);
+    if (!class) {
+        return NULL;
+    }
+    return jclass_to_symbol(env, class);
 }
 
-static emacs_value wrap_type(emacs_env *env, emacs_value type, const char *wrap_symbol)
+static emacs_value wrap_type(emacs_env *env, emacs_value type, emacs_value wrap_symbol)
 {
     emacs_value args[2];
-    args[0] = env->intern(env, wrap_symbol);
+    args[0] = wrap_symbol;
     args[1] = type;
-    return env->funcall(env, env->intern(env, "cons"), 2, args);
+    return env->funcall(env, Qcons, 2, args);
 }
 
 /*
- * method structure generate - helper method for `Fgg_get_class_struct'
+ * Lisp representation of a parsed type - helper method for `Fgg_get_class_struct'
  */
-#define fieldID_to_struct_LIST_ARGS 4
-static emacs_value fieldID_to_struct(emacs_env *env, jclass class, jfieldID field)
+static emacs_value type_to_lisp(emacs_env *env, const char *descriptor, const struct sig_type *type)
 {
-    emacs_value list_args[fieldID_to_struct_LIST_ARGS];
-    char *name;
-    char *sig;
-    char *orig_sig;
-    int is_array_type = 0;
-    emacs_value field_struct;
-
-    g_jvmtiError = (*g_jvmti)->GetFieldName(g_jvmti, class, field, &name, &sig, NULL);
-    if (check_jvmti_error(env)) {
-        return NULL;
-    }
-    list_args[0] = env->intern(env, ":name");
-    list_args[1] = env->intern(env, name);
-    list_args[2] = env->intern(env, ":type");
-    orig_sig = sig;
-    if (*sig == '[') {
-        is_array_type = 1;
-        sig++;
-    }
-    if (*sig == 'L') {
-        sig++;
-        sig[strlen(sig)-1] = 0; /* remove trailing ; */
-        list_args[3] = env->intern(env, sig);
+    char buffer[MAX_CLASS_NAME_SIZE];
+    char *class_name = buffer;
+    emacs_value lisp_type;
+    int i;
+
+    if (type->element == 'L') {
+        /* fully qualified, i.e. java/util/Map$Entry -> java.util.Map.Entry */
+        if (type->name_length >= MAX_CLASS_NAME_SIZE) {
+            class_name = malloc(type->name_length + 1);
+            assert(class_name);
+        }
+        for (i = 0; i < type->name_length; ++i) {
+            class_name[i] = descriptor[type->name_start + i];
+            if (class_name[i] == '/' || class_name[i] == '$') {
+                class_name[i] = '.';
+            }
+        }
+        class_name[i] = 0;
+        lisp_type = env->intern(env, class_name);
+        if (class_name != buffer) {
+            free(class_name);
+        }
     } else {
-        list_args[3] = wrap_type(env, env->intern(env, sig), GG_PRIMITIVE_TAG);
+        lisp_type = wrap_type(env, primitive_type_symbol(type->element), Qgg_prim);
     }
-    if (is_array_type) {
-        list_args[3] = wrap_type(env, list_args[3], GG_ARRAY_TAG);
+    if (type->array_depth) {
+        lisp_type = wrap_type(env, lisp_type, Qgg_array);
     }
-    is_array_type = 0;
+    return lisp_type;
+}
+
+/*
+ * field structure generate - helper method for `Fgg_get_class_struct'
+ */
+#define field_to_struct_LIST_ARGS 4
+static emacs_value field_to_struct(emacs_env *env, struct field_info *field)
+{
+    emacs_value list_args[field_to_struct_LIST_ARGS];
+
+    list_args[0] = QCname;
+    list_args[1] = env->intern(env, field->name);
+    list_args[2] = QCtype;
+    list_args[3] = type_to_lisp(env, field->sig, &field->type);
 
-    field_struct = env->funcall(env, env->intern(env, "list"), fieldID_to_struct_LIST_ARGS, list_args);
-    (*g_jvmti)->Deallocate(g_jvmti, (void *) name);
-    (*g_jvmti)->Deallocate(g_jvmti, (void *) orig_sig);
-    return field_struct;
+    return env->funcall(env, Qlist, field_to_struct_LIST_ARGS, list_args);
 }
 
 /*
  * method structure generate - helper method for `Fgg_get_class_struct'
  */
-#define methodID_to_struct_LIST_ARGS 8
-static emacs_value methodID_to_struct(emacs_env *env, jmethodID method)
+#define method_to_struct_LIST_ARGS 10
+static emacs_value method_to_struct(emacs_env *env, struct method_info *method)
 {
-    emacs_value list_args[methodID_to_struct_LIST_ARGS];
-    char *name;
-    char *sig;
-    char *return_type_name = NULL;
-    emacs_value method_struct;
-    int i, j;
-    size_t sig_len;
-    static char class_name[MAX_CLASS_NAME_SIZE];
-    int arg_count = 0;
+    emacs_value list_args[method_to_struct_LIST_ARGS];
     emacs_value *arg_types;
-    emacs_value return_type;
-    /* TODO realloc() when this limit is hit */
-    int MAX_ARGS = 10;
-    int is_array_type = 0;
-    char prim_type[2] = {0, 0};
-    jint modifiers;
-    emacs_value modifiers_array[12];
-    emacs_value modifiers_list;
-    int modifiers_count = 0;
-
-    g_jvmtiError = (*g_jvmti)->GetMethodName(g_jvmti, method, &name, &sig, NULL);
-    if (check_jvmti_error(env)) {
-        return NULL;
+    const struct sig *sig = method->sig;
+    int i;
+
+    arg_types = malloc(sizeof(emacs_value) * (sig->arg_count ? sig->arg_count : 1));
+    assert(arg_types);
+    for (i = 0; i < sig->arg_count; ++i) {
+        arg_types[i] = type_to_lisp(env, sig->descriptor, &sig->args[i]);
     }
 
-    sig_len = strlen(sig);
-    arg_types = malloc(sizeof(emacs_value) * MAX_ARGS);
-    /* start at 1, skip the '(' */
-    for (i = 1; i < sig_len; ++i) {
-        if (sig[i] == '[') {
-            is_array_type = 1;
-            continue;
-        } else if (sig[i] == 'L') {
-            j = 0;
-            while (sig[++i] != ';') {
-                class_name[j++] = sig[i];
-            }
-            class_name[j] = 0;
-            class_name_to_fq(class_name);
-            arg_types[arg_count] = env->intern(env, class_name);
-        } else if (sig[i] == ')') {
-            return_type_name = sig + i + 1;
-            if (*return_type_name == '[') {
-                is_array_type = 1;
-                return_type_name++;
-            }
-            if (*return_type_name == 'L') {
-                return_type_name++;
-                *strchr(return_type_name, ';') = 0;
-                class_name_to_fq(return_type_name);
-                return_type = env->intern(env, return_type_name);
-            } else {
-                prim_type[0] = *return_type_name;
-                return_type = wrap_type(env, env->intern(env, prim_type), GG_PRIMITIVE_TAG);
-            }
-            if (is_array_type) {
-                return_type = wrap_type(env, return_type, GG_ARRAY_TAG);
-            }
-            break;
-        } else {
-            prim_type[0] = sig[i];
-            arg_types[arg_count] = wrap_type(env, env->intern(env, prim_type), GG_PRIMITIVE_TAG);
-        }
-        /* post-process the argument, if necessary */
-        if (is_array_type) {
-            arg_types[arg_count] = wrap_type(env, arg_types[arg_count], GG_ARRAY_TAG);
-        }
-        is_array_type = 0;
-        arg_count++;
-        assert(arg_count <= MAX_ARGS);
+    list_args[0] = QCname;
+    list_args[1] = env->intern (env, method->name);
+    list_args[2] = QCreturns;
+    list_args[3] = type_to_lisp(env, sig->descriptor, &sig->returns);
+    list_args[4] = QCaccepts;
+    list_args[5] = env->funcall(env, Qlist, sig->arg_count, arg_types);
+    free(arg_types);
+    list_args[6] = QCmodifiers;
+    list_args[7] = modifiers_to_list(env, method->modifiers, 0);
+    list_args[8] = QCsignature;
+    list_args[9] = env->make_string(env, sig->descriptor, strlen(sig->descriptor));
+
+    return env->funcall(env, Qlist, method_to_struct_LIST_ARGS, list_args);
+}
+
+/*
+ * Build the Lisp class structure from cached class metadata. `name'
+ * is the symbol to use as :name.
+ */
+#define class_info_to_struct_LIST_ARGS 12
+static emacs_value class_info_to_struct(emacs_env *env, struct class_info *info, emacs_value name)
+{
+    int i;
+    emacs_value superclass_sym;
+    emacs_value list_args[class_info_to_struct_LIST_ARGS];
+    emacs_value interfaces_list;
+    emacs_value methods_list;
+    emacs_value fields_list;
+    /* args for calling (list) to construct interface/method/field lists */
+    emacs_value *dynamic_args;
+
+    /* Superclass */
+    if (info->superclass) {
+        superclass_sym = env->intern(env, info->superclass);
+    } else {
+        superclass_sym = Qnil;
     }
 
-    g_jvmtiError = (*g_jvmti)->GetMethodModifiers(g_jvmti, method, &modifiers);
-    if (check_jvmti_error(env)) {
-        free(arg_types);
-        return NULL;
+    /* Interfaces */
+    dynamic_args = malloc(sizeof(emacs_value) * (info->interface_count + 1));
+    assert(dynamic_args);
+    for (i = 0; i < info->interface_count; ++i) {
+        dynamic_args[i] = env->intern(env, info->interfaces[i]);
     }
-    /* Access flags here: https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.6 */
-    if (modifiers & JVM_ACC_PUBLIC) { modifiers_array[modifiers_count++] = env->intern(env, "public"); }
-    if (modifiers & JVM_ACC_PRIVATE) { modifiers_array[modifiers_count++] = env->intern(env, "private"); }
-    if (modifiers & JVM_ACC_PROTECTED) { modifiers_array[modifiers_count++] = env->intern(env, "protected"); }
-    if (modifiers & JVM_ACC_STATIC) { modifiers_array[modifiers_count++] = env->intern(env, "static"); }
-    if (modifiers & JVM_ACC_FINAL) { modifiers_array[modifiers_count++] = env->intern(env, "final"); }
-    if (modifiers & JVM_ACC_SYNCHRONIZED) { modifiers_array[modifiers_count++] = env->intern(env, "synchronized"); }
-    if (modifiers & JVM_ACC_BRIDGE) { modifiers_array[modifiers_count++] = env->intern(env, "bridge"); }
-    if (modifiers & JVM_ACC_VARARGS) { modifiers_array[modifiers_count++] = env->intern(env, "varargs"); }
-    if (modifiers & JVM_ACC_NATIVE) { modifiers_array[modifiers_count++] = env->intern(env, "native"); }
-    if (modifiers & JVM_ACC_ABSTRACT) { modifiers_array[modifiers_count++] = env->intern(env, "abstract"); }
-    if (modifiers & JVM_ACC_STRICT) { modifiers_array[modifiers_count++] = env->intern(env, "strictfp"); }
-    if (modifiers & JVM_ACC_SYNTHETIC) { modifiers_array[modifiers_count++] = env->intern(env, "synthetic"); }
-    modifiers_list = env->funcall(env, env->intern(env, "list"), modifiers_count, modifiers_array);
-
-    list_args[0] = env->intern (env, ":name");
-    list_args[1] = env->intern (env, name);
-    list_args[2] = env->intern (env, ":returns");
-    list_args[3] = return_type;
-    list_args[4] = env->intern (env, ":accepts");
-    list_args[5] = env->funcall(env, env->intern(env, "list"), arg_count, arg_types);
-    free(arg_types);
-    list_args[6] = env->intern (env, ":modifiers");
-    list_args[7] = modifiers_list;
+    interfaces_list = env->funcall(env, Qlist, info->interface_count, dynamic_args);
+    free(dynamic_args);
+
+    /* Methods */
+    dynamic_args = malloc(sizeof(emacs_value) * (info->method_count + 1));
+    assert(dynamic_args);
+    for (i = 0; i < info->method_count; ++i) {
+        dynamic_args[i] = method_to_struct(env, &info->methods[i]);
+    }
+    methods_list = env->funcall(env, Qlist, info->method_count, dynamic_args);
+    free(dynamic_args);
+
+    /* Fields */
+    dynamic_args = malloc(sizeof(emacs_value) * (info->field_count + 1));
+    assert(dynamic_args);
+    for (i = 0; i < info->field_count; ++i) {
+        dynamic_args[i] = field_to_struct(env, &info->fields[i]);
+    }
+    fields_list = env->funcall(env, Qlist, info->field_count, dynamic_args);
+    free(dynamic_args);
+
+    /* Create result structure */
+    list_args[0] = QCname;
+    list_args[1] = name;
+    list_args[2] = QCsuperclass;
+    list_args[3] = superclass_sym;
+    list_args[4] = QCinterfaces;
+    list_args[5] = interfaces_list;
+    list_args[6] = QCmethods;
+    list_args[7] = methods_list;
+    list_args[8] = QCfields;
+    list_args[9] = fields_list;
+    list_args[10] = QCmodifiers;
+    list_args[11] = modifiers_to_list(env, info->modifiers, 1);
 
-    method_struct = env->funcall(env, env->intern(env, "list"), methodID_to_struct_LIST_ARGS, list_args);
-    (*g_jvmti)->Deallocate(g_jvmti, (void *) name);
-    (*g_jvmti)->Deallocate(g_jvmti, (void *) sig);
-    return method_struct;
+    return env->funcall(env, Qlist, class_info_to_struct_LIST_ARGS, list_args);
 }
 
 /*
  * Generate the class structure for the class named by the given
  * symbol. c.f. "internals.org" file (and tests) for a description of
  * the structure
+ *
+ * The class metadata is cached natively (c.f. class_cache.c) so only
+ * the Lisp structure is built on subsequent calls.
  */
-#define Fgg_get_class_struct_LIST_ARGS 12
 emacs_value
 Fgg_get_class_struct (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
 {
-    jclass class, superclass;
     static char class_name[MAX_CLASS_NAME_SIZE];
     ptrdiff_t size = MAX_CLASS_NAME_SIZE;
-    jint modifiers;
-    int modifiers_count = 0;
-    emacs_value modifiers_array[8];
-    emacs_value modifiers_list;
+    struct class_info *info;
     bool ok;
-    int i;
-    jclass *interfaces;
-    jmethodID *methods;
-    jfieldID *fields;
-    jint count;
-    emacs_value superclass_sym;
-    emacs_value list_args[10];
-    emacs_value interfaces_list;
-    emacs_value methods_list;
-    emacs_value fields_list;
-    /* args for calling (list) to construct interface/method/field lists */
-    emacs_value *dynamic_args;
 
-    if (!type_is(env, args[0], "symbol")) {
+    if (!type_is(env, args[0], Qsymbol)) {
         return NULL;
     }
 
@@ -355,106 +339,182 @@ Fgg_get_class_struct (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void
     assert(ok);
 
     class_name_to_internal(class_name);
-    class = (*g_jni)->FindClass(g_jni, class_name);
-    if (!class) {
-        handle_exception(env);
+    info = class_cache_get(env, class_name);
+    if (!info) {
         return NULL;
     }
 
-    /* modifiers */
-    g_jvmtiError = (*g_jvmti)->GetClassModifiers(g_jvmti, class, &modifiers);
-    if (check_jvmti_error(env)) {
-        (*g_jni)->DeleteLocalRef(g_jni, class);
-        return NULL;
-    }
-    if (modifiers & JVM_ACC_PUBLIC) { modifiers_array[modifiers_count++] = env->intern(env, "public"); }
-    if (modifiers & JVM_ACC_FINAL) { modifiers_array[modifiers_count++] = env->intern(env, "final"); }
-    if (modifiers & JVM_ACC_SUPER) { modifiers_array[modifiers_count++] = env->intern(env, "super"); }
-    if (modifiers & JVM_ACC_INTERFACE) { modifiers_array[modifiers_count++] = env->intern(env, "interface"); }
-    if (modifiers & JVM_ACC_ABSTRACT) { modifiers_array[modifiers_count++] = env->intern(env, "abstract"); }
-    if (modifiers & JVM_ACC_SYNTHETIC) { modifiers_array[modifiers_count++] = env->intern(env, "synthetic"); }
-    if (modifiers & JVM_ACC_ANNOTATION) { modifiers_array[modifiers_count++] = env->intern(env, "annotation"); }
-    if (modifiers & JVM_ACC_ENUM) { modifiers_array[modifiers_count++] = env->intern(env, "enum"); }
-    modifiers_list = env->funcall(env, env->intern(env, "list"), modifiers_count, modifiers_array);
+    return class_info_to_struct(env, info, args[0]);
+}
 
-    /* Superclass */
-    superclass = (*g_jni)->GetSuperclass(g_jni, class);
-    if (superclass) {
-        superclass_sym = jclass_to_symbol(env, superclass);
-    } else {
-        superclass_sym = env->intern (env, "nil");
+/*
+ * Convert a name as returned by Class.getName() to an internal name
+ * (newly allocated). No inner class guessing is needed here as
+ * getName() already uses '$'.
+ */
+static char *binary_name_to_internal(const char *binary_name)
+{
+    char *internal = strdup(binary_name);
+    char *c;
+    assert(internal);
+    for (c = internal; *c; ++c) {
+        if (*c == '.') {
+            *c = '/';
+        }
     }
+    return internal;
+}
 
-    /* Interfaces */
-    g_jvmtiError = (*g_jvmti)->GetImplementedInterfaces(g_jvmti, class, &count, &interfaces);
-    if (check_jvmti_error(env)) {
-        (*g_jni)->DeleteLocalRef(g_jni, class);
-        return NULL;
-    }
-    dynamic_args = malloc(sizeof(emacs_value) * count);
-    assert(dynamic_args);
-    for (i = 0; i < count; ++i) {
-        dynamic_args[i] = jclass_to_symbol(env, interfaces[i]);
-    }
-    interfaces_list = env->funcall(env, env->intern(env, "list"), count, dynamic_args);
-    (*g_jvmti)->Deallocate(g_jvmti, (void *) interfaces);
-    free(dynamic_args);
+/*
+ * Return the class structures of the named class(es) and all their
+ * supertypes (transitively) in a single call. `args[0]' is a class
+ * name symbol or a list of them. The optional `args[1]' is a hash
+ * table of classes already loaded (e.g. `gg--class-hierarchy'); these
+ * classes (and therefore their supertypes) are skipped.
+ */
+emacs_value
+Fgg_get_class_structs (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    static char class_name[MAX_CLASS_NAME_SIZE];
+    ptrdiff_t size;
+    emacs_value names;
+    emacs_value loaded = NULL;
+    emacs_value gethash_args[2];
+    emacs_value name_sym;
+    emacs_value result = NULL;
+    emacs_value *structs = NULL;
+    int struct_count = 0;
+    /* worklist of internal names (malloc'd), NULL entries are requested
+     * names taken from `names' */
+    char **work = NULL;
+    emacs_value *work_syms = NULL;
+    int work_count = 0, work_capacity;
+    struct hashtab *visited;
+    struct class_info *info;
+    ptrdiff_t i, name_count;
+    int j;
+    bool ok;
 
-    /* Methods */
-    g_jvmtiError = (*g_jvmti)->GetClassMethods(g_jvmti, class, &count, &methods);
-    if (check_jvmti_error(env)) {
-        (*g_jni)->DeleteLocalRef(g_jni, class);
-        return NULL;
-    }
-    dynamic_args = malloc(sizeof(emacs_value) * count);
-    assert(dynamic_args);
-    for (i = 0; i < count; ++i) {
-        dynamic_args[i] = methodID_to_struct(env, methods[i]);
-        if (!dynamic_args[i]) {
-            (*g_jni)->DeleteLocalRef(g_jni, class);
-            (*g_jvmti)->Deallocate(g_jvmti, (void *) methods);
+    ASSERT_JVM_RUNNING(env);
+
+    if (nargs > 1 && env->is_not_nil(env, args[1])) {
+        if (!type_is(env, args[1], Qhash_table)) {
             return NULL;
         }
+        loaded = args[1];
     }
-    methods_list = env->funcall(env, env->intern(env, "list"), count, dynamic_args);
-    (*g_jvmti)->Deallocate(g_jvmti, (void *) methods);
-    free(dynamic_args);
 
-    /* Fields */
-    g_jvmtiError = (*g_jvmti)->GetClassFields(g_jvmti, class, &count, &fields);
-    if (check_jvmti_error(env)) {
-        (*g_jni)->DeleteLocalRef(g_jni, class);
-        return NULL;
-    }
-    dynamic_args = malloc(sizeof(emacs_value) * count);
-    assert(dynamic_args);
-    for (i = 0; i < count; ++i) {
-        dynamic_args[i] = fieldID_to_struct(env, class, fields[i]);
-        if (!dynamic_args[i]) {
-            (*g_jni)->DeleteLocalRef(g_jni, class);
-            (*g_jvmti)->Deallocate(g_jvmti, (void *) fields);
+    if (env->eq(env, env->type_of(env, args[0]), Qsymbol)) {
+        names = env->funcall(env, Qvector, 1, args);
+    } else {
+        names = env->funcall(env, Qvconcat, 1, args);
+        if (env->non_local_exit_check(env) != emacs_funcall_exit_return) {
             return NULL;
         }
     }
-    fields_list = env->funcall(env, env->intern(env, "list"), count, dynamic_args);
-    (*g_jvmti)->Deallocate(g_jvmti, (void *) fields);
-    free(dynamic_args);
+    name_count = env->vec_size(env, names);
+
+    work_capacity = name_count + 16;
+    work = malloc(sizeof(char *) * work_capacity);
+    work_syms = malloc(sizeof(emacs_value) * work_capacity);
+    assert(work && work_syms);
+    for (i = 0; i < name_count; ++i) {
+        name_sym = env->vec_get(env, names, i);
+        if (!type_is(env, name_sym, Qsymbol)) {
+            goto cleanup;
+        }
+        size = MAX_CLASS_NAME_SIZE;
+        ok = symbol_to_string(env, name_sym, class_name, &size);
+        assert(ok);
+        class_name_to_internal(class_name);
+        work[work_count] = strdup(class_name);
+        assert(work[work_count]);
+        work_syms[work_count++] = name_sym;
+    }
 
-    /* Create result structure */
-    list_args[0] = env->intern (env, ":name");
-    list_args[1] = args[0];
-    list_args[2] = env->intern (env, ":superclass");
-    list_args[3] = superclass_sym;
-    list_args[4] = env->intern (env, ":interfaces");
-    list_args[5] = interfaces_list;
-    list_args[6] = env->intern (env, ":methods");
-    list_args[7] = methods_list;
-    list_args[8] = env->intern (env, ":fields");
-    list_args[9] = fields_list;
-    list_args[10] = env->intern(env, ":modifiers");
-    list_args[11] = modifiers_list;
+    visited = hashtab_new(HASHTAB_STRING_KEYS);
+    gethash_args[1] = loaded;
 
-    (*g_jni)->DeleteLocalRef(g_jni, class);
+    /* the worklist grows as supertypes are discovered */
+    for (i = 0; i < work_count; ++i) {
+        if (hashtab_get(visited, work[i])) {
+            continue;
+        }
+        hashtab_put(visited, work[i], work[i]);
+
+        if (loaded) {
+            gethash_args[0] = work_syms[i];
+            if (env->is_not_nil(env, env->funcall(env, Qgethash, 2, gethash_args))) {
+                continue;
+            }
+        }
 
-    return env->funcall(env, env->intern(env, "list"), Fgg_get_class_struct_LIST_ARGS, list_args);
+        info = class_cache_get(env, work[i]);
+        if (!info) {
+            hashtab_free(visited, NULL);
+            goto cleanup;
+        }
+
+        structs = realloc(structs, sizeof(emacs_value) * (struct_count + 1));
+        assert(structs);
+        structs[struct_count++] = class_info_to_struct(env, info, work_syms[i]);
+
+        /* queue supertypes */
+        if (work_count + info->interface_count + 1 > work_capacity) {
+            work_capacity = (work_count + info->interface_count + 1) * 2;
+            work = realloc(work, sizeof(char *) * work_capacity);
+            work_syms = realloc(work_syms, sizeof(emacs_value) * work_capacity);
+            assert(work && work_syms);
+        }
+        if (info->superclass) {
+            work[work_count] = binary_name_to_internal(info->superclass);
+            work_syms[work_count++] = env->intern(env, info->superclass);
+        }
+        for (j = 0; j < info->interface_count; ++j) {
+            work[work_count] = binary_name_to_internal(info->interfaces[j]);
+            work_syms[work_count++] = env->intern(env, info->interfaces[j]);
+        }
+    }
+    hashtab_free(visited, NULL);
+
+    result = env->funcall(env, Qlist, struct_count, structs);
+
+cleanup:
+    for (i = 0; i < work_count; ++i) {
+        free(work[i]);
+    }
+    free(work);
+    free(work_syms);
+    free(structs);
+    return result;
+}
+
+/*
+ * Drop the named class (or all classes if nil) from the native class
+ * metadata cache and the persistent store. Needed when a class is
+ * redefined.
+ */
+emacs_value
+Fgg_flush_class_cache (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    static char class_name[MAX_CLASS_NAME_SIZE];
+    ptrdiff_t size = MAX_CLASS_NAME_SIZE;
+    bool ok;
+
+    if (nargs == 0 || !env->is_not_nil(env, args[0])) {
+        class_cache_flush_all();
+        class_store_forget(NULL);
+        return Qt;
+    }
+
+    if (!type_is(env, args[0], Qsymbol)) {
+        return NULL;
+    }
+
+    ok = symbol_to_string(env, args[0], class_name, &size);
+    assert(ok);
+    class_name_to_internal(class_name);
+    class_cache_flush(class_name);
+    class_store_forget(class_name);
+    return Qt;
 }
@@ -0,0 +1,298 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emacs-module.h>
+#include <jvmti.h>
+#include <jni.h>
+
+#include "class_cache.h"
+#include "class_store.h"
+#include "ctrl.h"
+#include "el_util.h"
+#include "hashtab.h"
+
+/*
+ * Internal class name (char *) -> struct class_info *
+ *
+ * Everything `Fgg_get_class_struct' needs is extracted from the JVM
+ * once and kept here. Entries live until flushed or the JVM is
+ * stopped.
+ */
+static struct hashtab *cache;
+
+static void free_class_info(void *x)
+{
+    struct class_info *info = x;
+    int i;
+
+    if (!info) {
+        return;
+    }
+    if (info->class && g_jni) {
+        (*g_jni)->DeleteGlobalRef(g_jni, info->class);
+    }
+    for (i = 0; i < info->interface_count; ++i) {
+        free(info->interfaces[i]);
+    }
+    for (i = 0; i < info->method_count; ++i) {
+        free(info->methods[i].name);
+    }
+    for (i = 0; i < info->field_count; ++i) {
+        free(info->fields[i].name);
+        free(info->fields[i].sig);
+    }
+    free(info->interfaces);
+    free(info->methods);
+    free(info->fields);
+    free(info->superclass);
+    free(info->name);
+    free(info);
+}
+
+/*
+ * Copy a class's name (as given by Class.getName()) to a malloc()'d string
+ */
+static char *class_name_dup(emacs_env *env, jclass class)
+{
+    jstring name;
+    const char *bytes;
+    char *copy;
+
+    name = get_class_name(env, class);
+    if (!name) {
+        return NULL;
+    }
+    bytes = (*g_jni)->GetStringUTFChars(g_jni, name, NULL);
+    if (handle_exception(env)) {
+        (*g_jni)->DeleteLocalRef(g_jni, name);
+        return NULL;
+    }
+    copy = strdup(bytes);
+    assert(copy);
+    (*g_jni)->ReleaseStringUTFChars(g_jni, name, bytes);
+    (*g_jni)->DeleteLocalRef(g_jni, name);
+    return copy;
+}
+
+static int load_methods(emacs_env *env, struct class_info *info)
+{
+    jint count;
+    jmethodID *methods;
+    struct method_info *method;
+    char *name, *sig;
+    int i;
+
+    g_jvmtiError = (*g_jvmti)->GetClassMethods(g_jvmti, info->class, &count, &methods);
+    if (check_jvmti_error(env)) {
+        return 0;
+    }
+    info->methods = calloc(count ? count : 1, sizeof(struct method_info));
+    assert(info->methods);
+    for (i = 0; i < count; ++i) {
+        method = &info->methods[i];
+        method->id = methods[i];
+        g_jvmtiError = (*g_jvmti)->GetMethodName(g_jvmti, methods[i], &name, &sig, NULL);
+        if (check_jvmti_error(env)) {
+            (*g_jvmti)->Deallocate(g_jvmti, (void *) methods);
+            return 0;
+        }
+        method->name = strdup(name);
+        assert(method->name);
+        method->sig = sig_intern(methods[i], sig);
+        assert(method->sig);
+        (*g_jvmti)->Deallocate(g_jvmti, (void *) name);
+        (*g_jvmti)->Deallocate(g_jvmti, (void *) sig);
+        info->method_count++;
+
+        g_jvmtiError = (*g_jvmti)->GetMethodModifiers(g_jvmti, methods[i], &method->modifiers);
+        if (check_jvmti_error(env)) {
+            (*g_jvmti)->Deallocate(g_jvmti, (void *) methods);
+            return 0;
+        }
+    }
+    (*g_jvmti)->Deallocate(g_jvmti, (void *) methods);
+    return 1;
+}
+
+static int load_fields(emacs_env *env, struct class_info *info)
+{
+    jint count;
+    jfieldID *fields;
+    struct field_info *field;
+    char *name, *sig;
+    const char *p;
+    int ok;
+    int i;
+
+    g_jvmtiError = (*g_jvmti)->GetClassFields(g_jvmti, info->class, &count, &fields);
+    if (check_jvmti_error(env)) {
+        return 0;
+    }
+    info->fields = calloc(count ? count : 1, sizeof(struct field_info));
+    assert(info->fields);
+    for (i = 0; i < count; ++i) {
+        field = &info->fields[i];
+        field->id = fields[i];
+        g_jvmtiError = (*g_jvmti)->GetFieldName(g_jvmti, info->class, fields[i], &name, &sig, NULL);
+        if (check_jvmti_error(env)) {
+            (*g_jvmti)->Deallocate(g_jvmti, (void *) fields);
+            return 0;
+        }
+        field->name = strdup(name);
+        field->sig = strdup(sig);
+        assert(field->name && field->sig);
+        (*g_jvmti)->Deallocate(g_jvmti, (void *) name);
+        (*g_jvmti)->Deallocate(g_jvmti, (void *) sig);
+        info->field_count++;
+        p = field->sig;
+        ok = sig_parse_type(field->sig, &p, &field->type);
+        assert(ok);
+    }
+    (*g_jvmti)->Deallocate(g_jvmti, (void *) fields);
+    return 1;
+}
+
+static struct class_info *load_class_info(emacs_env *env, const char *internal_name)
+{
+    struct class_info *info;
+    jclass class, superclass;
+    jclass *interfaces;
+    jint count;
+    int i;
+
+    class = (*g_jni)->FindClass(g_jni, internal_name);
+    if (!class) {
+        handle_exception(env);
+        return NULL;
+    }
+
+    info = calloc(1, sizeof(struct class_info));
+    assert(info);
+    info->name = strdup(internal_name);
+    assert(info->name);
+    info->class = (*g_jni)->NewGlobalRef(g_jni, class);
+    assert(info->class);
+    (*g_jni)->DeleteLocalRef(g_jni, class);
+
+    /* modifiers */
+    g_jvmtiError = (*g_jvmti)->GetClassModifiers(g_jvmti, info->class, &info->modifiers);
+    if (check_jvmti_error(env)) {
+        free_class_info(info);
+        return NULL;
+    }
+
+    /* superclass */
+    superclass = (*g_jni)->GetSuperclass(g_jni, info->class);
+    if (superclass) {
+        info->superclass = class_name_dup(env, superclass);
+        (*g_jni)->DeleteLocalRef(g_jni, superclass);
+        if (!info->superclass) {
+            free_class_info(info);
+            return NULL;
+        }
+    }
+
+    /* interfaces */
+    g_jvmtiError = (*g_jvmti)->GetImplementedInterfaces(g_jvmti, info->class, &count, &interfaces);
+    if (check_jvmti_error(env)) {
+        free_class_info(info);
+        return NULL;
+    }
+    info->interfaces = calloc(count ? count : 1, sizeof(char *));
+    assert(info->interfaces);
+    for (i = 0; i < count; ++i) {
+        if (info->interface_count == i) {
+            info->interfaces[i] = class_name_dup(env, interfaces[i]);
+            if (info->interfaces[i]) {
+                info->interface_count++;
+            }
+        }
+        (*g_jni)->DeleteLocalRef(g_jni, interfaces[i]);
+    }
+    (*g_jvmti)->Deallocate(g_jvmti, (void *) interfaces);
+    if (info->interface_count != count) {
+        free_class_info(info);
+        return NULL;
+    }
+
+    if (!load_methods(env, info) || !load_fields(env, info)) {
+        free_class_info(info);
+        return NULL;
+    }
+
+    return info;
+}
+
+/*
+ * Get the metadata for the class with the given internal name
+ * (e.g. java/util/ArrayList), from the persistent store (class_store.c)
+ * or else the JVM if it's not cached. Returns NULL with a pending
+ * non-local exit on failure.
+ */
+struct class_info *class_cache_get(emacs_env *env, const char *internal_name)
+{
+    struct class_info *info;
+
+    if (!cache) {
+        cache = hashtab_new(HASHTAB_STRING_KEYS);
+    }
+
+    info = hashtab_get(cache, internal_name);
+    if (info) {
+        return info;
+    }
+
+    info = class_store_get(internal_name);
+    if (!info) {
+        info = load_class_info(env, internal_name);
+        if (info) {
+            class_store_add(info);
+        }
+    }
+    if (info) {
+        hashtab_put(cache, internal_name, info);
+    }
+    return info;
+}
+
+/*
+ * Drop a class from the cache, e.g. after it's been redefined
+ */
+void class_cache_flush(const char *internal_name)
+{
+    if (cache) {
+        free_class_info(hashtab_remove(cache, internal_name));
+    }
+}
+
+void class_cache_flush_all()
+{
+    if (cache) {
+        hashtab_clear(cache, free_class_info);
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Native cache of class metadata (c.f. `Fgg_get_class_struct')
+ */
+
+#ifndef GG_CLASS_CACHE_H
+#define GG_CLASS_CACHE_H
+
+#include <emacs-module.h>
+
+#include <jni.h>
+
+#include "sig.h"
+
+struct method_info {
+    jmethodID id;
+    char *name;
+    const struct sig *sig;  /* owned by the descriptor cache (sig.c) */
+    jint modifiers;
+};
+
+struct field_info {
+    jfieldID id;
+    char *name;
+    char *sig;
+    struct sig_type type;   /* spans are relative to `sig' */
+};
+
+struct class_info {
+    char *name;             /* internal name, e.g. java/util/ArrayList */
+    jclass class;           /* global ref */
+    jint modifiers;
+    char *superclass;       /* as returned by Class.getName(), NULL for none */
+    int interface_count;
+    char **interfaces;
+    int method_count;
+    struct method_info *methods;
+    int field_count;
+    struct field_info *fields;
+};
+
+struct class_info *class_cache_get(emacs_env *env, const char *internal_name);
+void class_cache_flush(const char *internal_name);
+void class_cache_flush_all();
+
+#endif
@@ -0,0 +1,428 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emacs-module.h>
+#include <jvmti.h>
+#include <jni.h>
+
+#include "class_index.h"
+#include "ctrl.h"
+#include "el_util.h"
+#include "hashtab.h"
+
+#define MAX_CLASS_NAME_SIZE 1024
+
+/*
+ * Classes are added as they're prepared (c.f. `class_prepare') and
+ * removed when unloaded, if the VM offers an unload event. Names are
+ * binary names, as returned by Class.getName().
+ */
+struct indexed_class {
+    char *superclass;           /* NULL for none */
+    int interface_count;
+    char **interfaces;
+};
+
+/* binary name -> struct indexed_class *, guarded by `index_lock' */
+static struct hashtab *index_table;
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* whether the unload extension event passes the class name rather than the class */
+static int unload_by_name;
+static jint unload_event_index = -1;
+
+static void free_indexed_class(void *x)
+{
+    struct indexed_class *entry = x;
+    int i;
+
+    if (!entry) {
+        return;
+    }
+    for (i = 0; i < entry->interface_count; ++i) {
+        free(entry->interfaces[i]);
+    }
+    free(entry->interfaces);
+    free(entry->superclass);
+    free(entry);
+}
+
+/*
+ * Convert a class signature (e.g. Ljava/util/Map$Entry;) to a
+ * malloc()'d binary name. Returns NULL for arrays and primitives.
+ */
+static char *signature_to_name(const char *signature)
+{
+    size_t length = strlen(signature);
+    char *name;
+    size_t i;
+
+    if (signature[0] != 'L' || signature[length - 1] != ';') {
+        return NULL;
+    }
+    name = strndup(signature + 1, length - 2);
+    assert(name);
+    for (i = 0; name[i]; ++i) {
+        if (name[i] == '/') {
+            name[i] = '.';
+        }
+    }
+    return name;
+}
+
+static char *class_name(jclass class)
+{
+    char *signature;
+    char *name;
+
+    if ((*g_jvmti)->GetClassSignature(g_jvmti, class, &signature, NULL) != JVMTI_ERROR_NONE) {
+        return NULL;
+    }
+    name = signature_to_name(signature);
+    (*g_jvmti)->Deallocate(g_jvmti, (void *) signature);
+    return name;
+}
+
+static void index_class(JNIEnv *jni, jclass class)
+{
+    struct indexed_class *entry;
+    char *name;
+    jclass superclass;
+    jclass *interfaces;
+    jint count;
+    int i;
+
+    name = class_name(class);
+    if (!name) {
+        return;
+    }
+    entry = calloc(1, sizeof(struct indexed_class));
+    assert(entry);
+
+    superclass = (*jni)->GetSuperclass(jni, class);
+    if (superclass) {
+        entry->superclass = class_name(superclass);
+        (*jni)->DeleteLocalRef(jni, superclass);
+    }
+    if ((*g_jvmti)->GetImplementedInterfaces(g_jvmti, class, &count, &interfaces) == JVMTI_ERROR_NONE) {
+        entry->interfaces = calloc(count ? count : 1, sizeof(char *));
+        assert(entry->interfaces);
+        for (i = 0; i < count; ++i) {
+            entry->interfaces[entry->interface_count] = class_name(interfaces[i]);
+            if (entry->interfaces[entry->interface_count]) {
+                entry->interface_count++;
+            }
+            (*jni)->DeleteLocalRef(jni, interfaces[i]);
+        }
+        (*g_jvmti)->Deallocate(g_jvmti, (void *) interfaces);
+    }
+
+    pthread_mutex_lock(&index_lock);
+    free_indexed_class(hashtab_remove(index_table, name));
+    hashtab_put(index_table, name, entry);
+    pthread_mutex_unlock(&index_lock);
+    free(name);
+}
+
+static void JNICALL class_prepare(jvmtiEnv *jvmti, JNIEnv *jni, jthread thread, jclass class)
+{
+    index_class(jni, class);
+}
+
+static void unindex(const char *name)
+{
+    pthread_mutex_lock(&index_lock);
+    free_indexed_class(hashtab_remove(index_table, name));
+    pthread_mutex_unlock(&index_lock);
+}
+
+/*
+ * The HotSpot ClassUnload extension event. Its parameters differ
+ * between JDK versions: (JNIEnv*, const char *name) or (JNIEnv*,
+ * jthread, jclass).
+ */
+static void JNICALL class_unload(jvmtiEnv *jvmti, ...)
+{
+    va_list ap;
+    char *name;
+    const char *signature;
+    jclass class;
+
+    va_start(ap, jvmti);
+    va_arg(ap, JNIEnv *);
+    if (unload_by_name) {
+        signature = va_arg(ap, const char *);
+        name = signature ? signature_to_name(signature) : NULL;
+    } else {
+        va_arg(ap, jthread);
+        class = va_arg(ap, jclass);
+        name = class ? class_name(class) : NULL;
+    }
+    va_end(ap);
+    if (name) {
+        unindex(name);
+        free(name);
+    }
+}
+
+static void enable_unload_event()
+{
+    jvmtiExtensionEventInfo *events;
+    jint count;
+    int i, j;
+
+    if ((*g_jvmti)->GetExtensionEvents(g_jvmti, &count, &events) != JVMTI_ERROR_NONE) {
+        return;
+    }
+    for (i = 0; i < count; ++i) {
+        if (!strcmp(events[i].id, "com.sun.hotspot.events.ClassUnload")) {
+            unload_event_index = events[i].extension_event_index;
+            for (j = 0; j < events[i].param_count; ++j) {
+                if (events[i].params[j].base_type == JVMTI_TYPE_CCHAR) {
+                    unload_by_name = 1;
+                }
+            }
+        }
+        for (j = 0; j < events[i].param_count; ++j) {
+            (*g_jvmti)->Deallocate(g_jvmti, (void *) events[i].params[j].name);
+        }
+        (*g_jvmti)->Deallocate(g_jvmti, (void *) events[i].params);
+        (*g_jvmti)->Deallocate(g_jvmti, (void *) events[i].id);
+        (*g_jvmti)->Deallocate(g_jvmti, (void *) events[i].short_description);
+    }
+    (*g_jvmti)->Deallocate(g_jvmti, (void *) events);
+
+    if (unload_event_index >= 0 &&
+        (*g_jvmti)->SetExtensionEventCallback(g_jvmti, unload_event_index,
+                                              (jvmtiExtensionEvent) class_unload) != JVMTI_ERROR_NONE) {
+        unload_event_index = -1;
+    }
+}
+
+int class_index_init(JNIEnv *jni)
+{
+    jvmtiEventCallbacks callbacks;
+    jclass *classes;
+    jint count, status;
+    int i;
+
+    pthread_mutex_lock(&index_lock);
+    if (!index_table) {
+        index_table = hashtab_new(HASHTAB_STRING_KEYS);
+    }
+    pthread_mutex_unlock(&index_lock);
+
+    /* events first, so no class is missed between the two */
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.ClassPrepare = class_prepare;
+    if ((*g_jvmti)->SetEventCallbacks(g_jvmti, &callbacks, sizeof(callbacks)) != JVMTI_ERROR_NONE ||
+        (*g_jvmti)->SetEventNotificationMode(g_jvmti, JVMTI_ENABLE, JVMTI_EVENT_CLASS_PREPARE, NULL) != JVMTI_ERROR_NONE) {
+        return JNI_ERR;
+    }
+    enable_unload_event();
+
+    if ((*g_jvmti)->GetLoadedClasses(g_jvmti, &count, &classes) != JVMTI_ERROR_NONE) {
+        return JNI_ERR;
+    }
+    for (i = 0; i < count; ++i) {
+        if ((*g_jvmti)->GetClassStatus(g_jvmti, classes[i], &status) == JVMTI_ERROR_NONE &&
+            (status & JVMTI_CLASS_STATUS_PREPARED)) {
+            index_class(jni, classes[i]);
+        }
+        (*jni)->DeleteLocalRef(jni, classes[i]);
+    }
+    (*g_jvmti)->Deallocate(g_jvmti, (void *) classes);
+    return JNI_OK;
+}
+
+void class_index_stop()
+{
+    (*g_jvmti)->SetEventNotificationMode(g_jvmti, JVMTI_DISABLE, JVMTI_EVENT_CLASS_PREPARE, NULL);
+    if (unload_event_index >= 0) {
+        (*g_jvmti)->SetExtensionEventCallback(g_jvmti, unload_event_index, NULL);
+        unload_event_index = -1;
+    }
+    pthread_mutex_lock(&index_lock);
+    if (index_table) {
+        hashtab_clear(index_table, free_indexed_class);
+    }
+    pthread_mutex_unlock(&index_lock);
+}
+
+/*
+ * Matching names collected under the lock and interned after
+ */
+struct matches {
+    const char *prefix;
+    size_t prefix_length;
+    int package_only;
+    size_t count;
+    size_t capacity;
+    char **names;
+};
+
+static void match_name(const void *key, void *value, void *data)
+{
+    struct matches *matches = data;
+    const char *name = key;
+
+    if (strncmp(name, matches->prefix, matches->prefix_length)) {
+        return;
+    }
+    /* directly in the package: a `.' after the prefix, and no other */
+    if (matches->package_only &&
+        (name[matches->prefix_length] != '.' ||
+         strchr(name + matches->prefix_length + 1, '.'))) {
+        return;
+    }
+    if (matches->count == matches->capacity) {
+        matches->capacity = matches->capacity ? matches->capacity * 2 : 256;
+        matches->names = realloc(matches->names, sizeof(char *) * matches->capacity);
+        assert(matches->names);
+    }
+    matches->names[matches->count] = strdup(name);
+    assert(matches->names[matches->count]);
+    matches->count++;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static emacs_value query(emacs_env *env, emacs_value prefix, int package_only)
+{
+    char prefix_buffer[MAX_CLASS_NAME_SIZE];
+    ptrdiff_t size = MAX_CLASS_NAME_SIZE;
+    struct matches matches;
+    emacs_value result = Qnil;
+    emacs_value cons_args[2];
+    size_t i;
+
+    prefix_buffer[0] = 0;
+    if (env->is_not_nil(env, prefix)) {
+        if (!type_is(env, prefix, Qstring) ||
+            !env->copy_string_contents(env, prefix, prefix_buffer, &size)) {
+            return NULL;
+        }
+    }
+
+    memset(&matches, 0, sizeof(matches));
+    matches.prefix = prefix_buffer;
+    matches.prefix_length = strlen(prefix_buffer);
+    matches.package_only = package_only;
+    pthread_mutex_lock(&index_lock);
+    if (index_table) {
+        hashtab_foreach(index_table, match_name, &matches);
+    }
+    pthread_mutex_unlock(&index_lock);
+
+    qsort(matches.names, matches.count, sizeof(char *), compare_names);
+    for (i = matches.count; i-- > 0; ) {
+        cons_args[0] = env->intern(env, matches.names[i]);
+        cons_args[1] = result;
+        result = env->funcall(env, Qcons, 2, cons_args);
+        free(matches.names[i]);
+    }
+    free(matches.names);
+    return result;
+}
+
+/*
+ * (gg-loaded-classes &optional PREFIX)
+ *
+ * Return the names of the loaded classes (starting with the string
+ * PREFIX) as a sorted list of symbols.
+ */
+emacs_value
+Fgg_loaded_classes (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    ASSERT_JVM_RUNNING(env);
+    return query(env, nargs > 0 ? args[0] : Qnil, 0);
+}
+
+/*
+ * (gg-package-classes PACKAGE)
+ *
+ * Return the names of the loaded classes in the package named by the
+ * string PACKAGE (not in its subpackages).
+ */
+emacs_value
+Fgg_package_classes (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    ASSERT_JVM_RUNNING(env);
+    return query(env, args[0], 1);
+}
+
+/*
+ * (gg--class-index-supertypes CLASS-NAME-SYMBOL)
+ *
+ * Return (SUPERCLASS . INTERFACES) of an indexed class or nil if it's
+ * not loaded.
+ */
+emacs_value
+Fgg_class_index_supertypes (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    char name[MAX_CLASS_NAME_SIZE];
+    ptrdiff_t size = MAX_CLASS_NAME_SIZE;
+    struct indexed_class *entry;
+    emacs_value *supertypes;
+    emacs_value result = Qnil;
+    emacs_value name_string;
+    int count = 0;
+    int i;
+
+    ASSERT_JVM_RUNNING(env);
+
+    if (!type_is(env, args[0], Qsymbol)) {
+        return NULL;
+    }
+    name_string = env->funcall(env, Qsymbol_name, 1, args);
+    if (!env->copy_string_contents(env, name_string, name, &size)) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&index_lock);
+    entry = index_table ? hashtab_get(index_table, name) : NULL;
+    if (entry) {
+        supertypes = malloc(sizeof(emacs_value) * (entry->interface_count + 1));
+        assert(supertypes);
+        for (i = 0; i < entry->interface_count; ++i) {
+            supertypes[count++] = env->intern(env, entry->interfaces[i]);
+        }
+        result = env->funcall(env, Qlist, count, supertypes);
+        supertypes[0] = entry->superclass ? env->intern(env, entry->superclass) : Qnil;
+        supertypes[1] = result;
+        result = env->funcall(env, Qcons, 2, supertypes);
+        free(supertypes);
+    }
+    pthread_mutex_unlock(&index_lock);
+    return result;
+}
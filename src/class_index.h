@@ -0,0 +1,48 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Index of loaded classes kept up to date by JVMTI events (c.f. `gg-loaded-classes')
+ */
+
+#include <emacs-module.h>
+
+#include <jni.h>
+
+emacs_value Fgg_loaded_classes (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_package_classes (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_class_index_supertypes (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+
+/*
+ * Enable the events and index the classes loaded so far. Called on
+ * the thread creating the VM, after JVMTI is set up.
+ *
+ * @return 0 for OK or JNI_ERR if the events couldn't be enabled
+ */
+int class_index_init(JNIEnv *jni);
+
+/*
+ * Disable the events and empty the index (before the VM is destroyed)
+ */
+void class_index_stop();
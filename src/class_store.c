@@ -0,0 +1,928 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <emacs-module.h>
+#include <jvmti.h>
+#include <jni.h>
+
+#include "class_cache.h"
+#include "class_store.h"
+#include "ctrl.h"
+#include "el_util.h"
+#include "hashtab.h"
+#include "jar_index.h"
+#include "sig.h"
+
+/*
+ * The store file is mapped on first use and looks like this (integers
+ * are u32 in native byte order):
+ *
+ *   header:  "GGCS", version, byte order mark, segment count
+ *   segment: str key, records length, records
+ *   record:  record length, str binary name, modifiers, str superclass
+ *            ("" for none), interface count, str interface...,
+ *            method count, (str name, modifiers, str descriptor)...,
+ *            field count, (str name, str descriptor)...
+ *   str:     length, bytes, NUL
+ *
+ * A segment has the classes of one origin: the JDK, keyed by
+ * "jdk\nJAVA_HOME\nVM_VERSION", or a jar, keyed by
+ * "jar\nPATH\nMTIME\nSIZE". Segments whose key doesn't match the
+ * running JDK or the jar on disk aren't used and are dropped when the
+ * store is saved. Classes from elsewhere (directories, generated
+ * classes) aren't stored.
+ */
+#define STORE_MAGIC "GGCS"
+#define STORE_VERSION 1
+#define STORE_BYTE_ORDER 0x01020304
+#define HEADER_SIZE 16
+
+#define MAX_KEY_SIZE (PATH_MAX + 64)
+
+struct buffer {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+};
+
+struct record {
+    int pending;            /* in `pending' rather than the mapped file */
+    size_t offset;          /* of the record length, from the start of the records */
+};
+
+struct segment {
+    char *key;
+    char *jar;              /* NULL for the JDK */
+    int current;            /* the key matches the JDK or jar */
+    const unsigned char *records;   /* in the mapped file */
+    size_t records_length;
+    struct buffer pending;  /* records added in this session */
+    struct hashtab *by_name;        /* binary name -> struct record * */
+};
+
+static char *store_path;
+static int loaded;
+static int dirty;
+static unsigned char *mapping;
+static size_t mapping_size;
+static struct segment *segments;
+static int segment_count;
+
+/* c.f. `gg--class-store-stats' */
+static long hits;
+static long added;
+
+/* descriptor -> struct sig * of stored methods, kept until the VM is
+ * stopped as cached class_infos point to them */
+static struct hashtab *sigs;
+
+static char *jdk;
+static jobject platform_loader;
+static int platform_loader_resolved;
+
+struct reader {
+    const unsigned char *p;
+    const unsigned char *end;
+    int ok;
+};
+
+static uint32_t read_u32(struct reader *r)
+{
+    uint32_t value;
+
+    if (!r->ok || r->end - r->p < 4) {
+        r->ok = 0;
+        return 0;
+    }
+    memcpy(&value, r->p, 4);
+    r->p += 4;
+    return value;
+}
+
+/*
+ * Return the NUL-terminated string at the reader's position (in place)
+ */
+static const char *read_str(struct reader *r)
+{
+    uint32_t length = read_u32(r);
+    const char *str;
+
+    if (!r->ok || (size_t) (r->end - r->p) <= length || r->p[length]) {
+        r->ok = 0;
+        return "";
+    }
+    str = (const char *) r->p;
+    r->p += length + 1;
+    return str;
+}
+
+static void put(struct buffer *b, const void *data, size_t n)
+{
+    if (b->size + n > b->capacity) {
+        b->capacity = b->capacity ? b->capacity * 2 : 4096;
+        while (b->size + n > b->capacity) {
+            b->capacity *= 2;
+        }
+        b->data = realloc(b->data, b->capacity);
+        assert(b->data);
+    }
+    memcpy(b->data + b->size, data, n);
+    b->size += n;
+}
+
+static void put_u32(struct buffer *b, uint32_t value)
+{
+    put(b, &value, 4);
+}
+
+static void put_str(struct buffer *b, const char *str)
+{
+    size_t length = str ? strlen(str) : 0;
+
+    put_u32(b, length);
+    put(b, str ? str : "", length + 1);
+}
+
+static int write_all(int fd, const void *data, size_t n)
+{
+    const char *p = data;
+    ssize_t written;
+
+    while (n > 0) {
+        written = write(fd, p, n);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += written;
+        n -= written;
+    }
+    return 0;
+}
+
+static char *internal_to_binary(const char *internal_name)
+{
+    char *binary = strdup(internal_name);
+    char *c;
+
+    assert(binary);
+    for (c = binary; *c; ++c) {
+        if (*c == '/') {
+            *c = '.';
+        }
+    }
+    return binary;
+}
+
+/*
+ * The key of the running JDK's segment or NULL if it can't be told
+ */
+static const char *jdk_key()
+{
+    char *home = NULL, *version = NULL;
+    size_t size;
+
+    if (!jdk && g_jvmti &&
+        (*g_jvmti)->GetSystemProperty(g_jvmti, "java.home", &home) == JVMTI_ERROR_NONE &&
+        (*g_jvmti)->GetSystemProperty(g_jvmti, "java.vm.version", &version) == JVMTI_ERROR_NONE) {
+        size = strlen(home) + strlen(version) + 6;
+        jdk = malloc(size);
+        assert(jdk);
+        snprintf(jdk, size, "jdk\n%s\n%s", home, version);
+    }
+    if (home) {
+        (*g_jvmti)->Deallocate(g_jvmti, (void *) home);
+    }
+    if (version) {
+        (*g_jvmti)->Deallocate(g_jvmti, (void *) version);
+    }
+    return jdk;
+}
+
+/*
+ * Write the key of a jar's segment to `key' (MAX_KEY_SIZE)
+ *
+ * @return 0 for OK or -1 if the jar can't be stat()'d
+ */
+static int jar_key(const char *path, char *key)
+{
+    struct stat st;
+
+    if (stat(path, &st)) {
+        return -1;
+    }
+    snprintf(key, MAX_KEY_SIZE, "jar\n%s\n%lld\n%lld", path,
+             (long long) st.st_mtime, (long long) st.st_size);
+    return 0;
+}
+
+static int key_is_current(const char *key)
+{
+    char current[MAX_KEY_SIZE];
+    const char *end;
+    char *path;
+    int ok;
+
+    if (!strncmp(key, "jdk\n", 4)) {
+        return jdk_key() && !strcmp(key, jdk_key());
+    }
+    if (strncmp(key, "jar\n", 4) || !(end = strchr(key + 4, '\n'))) {
+        return 0;
+    }
+    path = strndup(key + 4, end - key - 4);
+    assert(path);
+    ok = !jar_key(path, current) && !strcmp(key, current);
+    free(path);
+    return ok;
+}
+
+static int find_segment(const char *key)
+{
+    int i;
+
+    for (i = 0; i < segment_count; ++i) {
+        if (!strcmp(segments[i].key, key)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int add_segment(const char *key, int current)
+{
+    struct segment *segment;
+    const char *end;
+
+    segments = realloc(segments, sizeof(struct segment) * (segment_count + 1));
+    assert(segments);
+    segment = &segments[segment_count];
+    memset(segment, 0, sizeof(struct segment));
+    segment->key = strdup(key);
+    assert(segment->key);
+    if (!strncmp(key, "jar\n", 4) && (end = strchr(key + 4, '\n'))) {
+        segment->jar = strndup(key + 4, end - key - 4);
+        assert(segment->jar);
+    }
+    segment->current = current;
+    segment->by_name = hashtab_new(HASHTAB_STRING_KEYS);
+    return segment_count++;
+}
+
+/*
+ * Index the records of a current segment by name
+ */
+static int index_records(struct segment *segment)
+{
+    struct reader r = { segment->records, segment->records + segment->records_length, 1 };
+    struct reader record;
+    struct record *entry;
+    const unsigned char *start;
+    uint32_t length;
+    const char *name;
+
+    while (r.ok && r.p < r.end) {
+        start = r.p;
+        length = read_u32(&r);
+        if (!r.ok || length < 4 || (size_t) (r.end - start) < length) {
+            return 0;
+        }
+        record.p = r.p;
+        record.end = start + length;
+        record.ok = 1;
+        name = read_str(&record);
+        if (!record.ok) {
+            return 0;
+        }
+        entry = malloc(sizeof(struct record));
+        assert(entry);
+        entry->pending = 0;
+        entry->offset = start - segment->records;
+        free(hashtab_remove(segment->by_name, name));
+        hashtab_put(segment->by_name, name, entry);
+        r.p = start + length;
+    }
+    return r.ok;
+}
+
+static void load_file()
+{
+    struct stat st;
+    struct reader r;
+    struct segment *segment;
+    const char *key;
+    uint32_t count, length, i;
+    int fd, index;
+
+    if (loaded || !store_path) {
+        return;
+    }
+    loaded = 1;
+
+    fd = open(store_path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) || st.st_size < HEADER_SIZE) {
+        close(fd);
+        return;
+    }
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = NULL;
+        return;
+    }
+    mapping_size = st.st_size;
+
+    r.p = mapping;
+    r.end = mapping + mapping_size;
+    r.ok = 1;
+    if (memcmp(r.p, STORE_MAGIC, 4)) {
+        return;
+    }
+    r.p += 4;
+    if (read_u32(&r) != STORE_VERSION || read_u32(&r) != STORE_BYTE_ORDER) {
+        return;
+    }
+    count = read_u32(&r);
+    for (i = 0; i < count && r.ok; ++i) {
+        key = read_str(&r);
+        length = read_u32(&r);
+        if (!r.ok || (size_t) (r.end - r.p) < length || find_segment(key) >= 0) {
+            return;
+        }
+        index = add_segment(key, key_is_current(key));
+        segment = &segments[index];
+        segment->records = r.p;
+        segment->records_length = length;
+        if (segment->current && !index_records(segment)) {
+            /* corrupt, forget what was indexed */
+            hashtab_clear(segment->by_name, free);
+            segment->current = 0;
+        }
+        r.p += length;
+    }
+}
+
+static void free_segments()
+{
+    int i;
+
+    for (i = 0; i < segment_count; ++i) {
+        hashtab_free(segments[i].by_name, free);
+        free(segments[i].pending.data);
+        free(segments[i].key);
+        free(segments[i].jar);
+    }
+    free(segments);
+    segments = NULL;
+    segment_count = 0;
+    if (mapping) {
+        munmap(mapping, mapping_size);
+        mapping = NULL;
+    }
+    loaded = 0;
+    dirty = 0;
+}
+
+static const unsigned char *record_data(struct segment *segment, struct record *record)
+{
+    return (record->pending ? segment->pending.data : segment->records) + record->offset;
+}
+
+static const struct sig *stored_sig(const char *descriptor)
+{
+    struct sig *sig;
+
+    if (!sigs) {
+        sigs = hashtab_new(HASHTAB_STRING_KEYS);
+    }
+    sig = hashtab_get(sigs, descriptor);
+    if (!sig) {
+        sig = sig_parse(descriptor);
+        if (sig) {
+            hashtab_put(sigs, descriptor, sig);
+        }
+    }
+    return sig;
+}
+
+static void free_info(struct class_info *info)
+{
+    int i;
+
+    for (i = 0; i < info->interface_count; ++i) {
+        free(info->interfaces[i]);
+    }
+    for (i = 0; i < info->method_count; ++i) {
+        free(info->methods[i].name);
+    }
+    for (i = 0; i < info->field_count; ++i) {
+        free(info->fields[i].name);
+        free(info->fields[i].sig);
+    }
+    free(info->interfaces);
+    free(info->methods);
+    free(info->fields);
+    free(info->superclass);
+    free(info->name);
+    free(info);
+}
+
+/*
+ * Build a class_info from a stored record, NULL if it's malformed
+ */
+static struct class_info *decode(const char *internal_name, const unsigned char *data)
+{
+    struct reader r = { data, data + 4, 1 };
+    struct class_info *info;
+    const char *str;
+    const char *p;
+    uint32_t count, i;
+
+    r.end = data + read_u32(&r);
+    read_str(&r);
+
+    info = calloc(1, sizeof(struct class_info));
+    assert(info);
+    info->name = strdup(internal_name);
+    assert(info->name);
+    info->modifiers = read_u32(&r);
+    str = read_str(&r);
+    if (*str) {
+        info->superclass = strdup(str);
+        assert(info->superclass);
+    }
+
+    count = read_u32(&r);
+    if (!r.ok || count > (size_t) (r.end - r.p)) {
+        goto malformed;
+    }
+    info->interfaces = calloc(count ? count : 1, sizeof(char *));
+    assert(info->interfaces);
+    for (i = 0; i < count && r.ok; ++i) {
+        info->interfaces[info->interface_count] = strdup(read_str(&r));
+        assert(info->interfaces[info->interface_count]);
+        info->interface_count++;
+    }
+
+    count = read_u32(&r);
+    if (!r.ok || count > (size_t) (r.end - r.p)) {
+        goto malformed;
+    }
+    info->methods = calloc(count ? count : 1, sizeof(struct method_info));
+    assert(info->methods);
+    for (i = 0; i < count && r.ok; ++i) {
+        struct method_info *method = &info->methods[info->method_count];
+        method->name = strdup(read_str(&r));
+        assert(method->name);
+        info->method_count++;
+        method->modifiers = read_u32(&r);
+        method->sig = stored_sig(read_str(&r));
+        if (!method->sig) {
+            goto malformed;
+        }
+    }
+
+    count = read_u32(&r);
+    if (!r.ok || count > (size_t) (r.end - r.p)) {
+        goto malformed;
+    }
+    info->fields = calloc(count ? count : 1, sizeof(struct field_info));
+    assert(info->fields);
+    for (i = 0; i < count && r.ok; ++i) {
+        struct field_info *field = &info->fields[info->field_count];
+        field->name = strdup(read_str(&r));
+        field->sig = strdup(read_str(&r));
+        assert(field->name && field->sig);
+        info->field_count++;
+        p = field->sig;
+        if (!sig_parse_type(field->sig, &p, &field->type)) {
+            goto malformed;
+        }
+    }
+
+    if (r.ok) {
+        return info;
+    }
+malformed:
+    free_info(info);
+    return NULL;
+}
+
+static struct record *lookup(const char *key, const char *binary_name, struct segment **segment)
+{
+    int index = key ? find_segment(key) : -1;
+
+    if (index < 0 || !segments[index].current) {
+        return NULL;
+    }
+    *segment = &segments[index];
+    return hashtab_get(segments[index].by_name, binary_name);
+}
+
+struct class_info *class_store_get(const char *internal_name)
+{
+    char key[MAX_KEY_SIZE];
+    struct segment *segment = NULL;
+    struct record *record;
+    struct class_info *info;
+    const char *jar;
+    char *binary_name;
+
+    if (!store_path) {
+        return NULL;
+    }
+    load_file();
+
+    binary_name = internal_to_binary(internal_name);
+    /* the JDK's classes come first, as with class loading */
+    record = lookup(jdk_key(), binary_name, &segment);
+    if (!record && (jar = jar_index_jar(binary_name)) && !jar_key(jar, key)) {
+        record = lookup(key, binary_name, &segment);
+    }
+    free(binary_name);
+    if (!record) {
+        return NULL;
+    }
+    info = decode(internal_name, record_data(segment, record));
+    if (info) {
+        hits++;
+    }
+    return info;
+}
+
+static jobject get_platform_loader()
+{
+    jclass class;
+    jmethodID method;
+
+    if (!platform_loader_resolved) {
+        platform_loader_resolved = 1;
+        class = (*g_jni)->FindClass(g_jni, "java/lang/ClassLoader");
+        method = class ? (*g_jni)->GetStaticMethodID(g_jni, class, "getPlatformClassLoader",
+                                                     "()Ljava/lang/ClassLoader;") : NULL;
+        if (method) {
+            platform_loader = (*g_jni)->CallStaticObjectMethod(g_jni, class, method);
+        }
+        /* no platform loader before Java 9 */
+        (*g_jni)->ExceptionClear(g_jni);
+        if (platform_loader) {
+            jobject local = platform_loader;
+            platform_loader = (*g_jni)->NewGlobalRef(g_jni, local);
+            (*g_jni)->DeleteLocalRef(g_jni, local);
+        }
+        if (class) {
+            (*g_jni)->DeleteLocalRef(g_jni, class);
+        }
+    }
+    return platform_loader;
+}
+
+/*
+ * Write the key of the segment a class belongs to
+ *
+ * @return 0 for OK or -1 if the class isn't stored
+ */
+static int origin_key(jclass class, const char *binary_name, char *key)
+{
+    jobject loader;
+    int jdk_class;
+    const char *jar;
+
+    if ((*g_jvmti)->GetClassLoader(g_jvmti, class, &loader) != JVMTI_ERROR_NONE) {
+        return -1;
+    }
+    jdk_class = !loader || (get_platform_loader() && (*g_jni)->IsSameObject(g_jni, loader, platform_loader));
+    if (loader) {
+        (*g_jni)->DeleteLocalRef(g_jni, loader);
+    }
+    if (jdk_class) {
+        if (!jdk_key()) {
+            return -1;
+        }
+        snprintf(key, MAX_KEY_SIZE, "%s", jdk_key());
+        return 0;
+    }
+    jar = jar_index_jar(binary_name);
+    return jar ? jar_key(jar, key) : -1;
+}
+
+void class_store_add(struct class_info *info)
+{
+    char key[MAX_KEY_SIZE];
+    struct segment *segment;
+    struct record *record;
+    struct buffer *b;
+    char *binary_name;
+    uint32_t length;
+    int index;
+    int i;
+
+    if (!store_path || !info->class) {
+        return;
+    }
+    load_file();
+
+    binary_name = internal_to_binary(info->name);
+    if (origin_key(info->class, binary_name, key)) {
+        free(binary_name);
+        return;
+    }
+    index = find_segment(key);
+    if (index < 0) {
+        index = add_segment(key, 1);
+    }
+    segment = &segments[index];
+    record = hashtab_get(segment->by_name, binary_name);
+    if (record && record->pending) {
+        free(binary_name);
+        return;
+    }
+
+    b = &segment->pending;
+    record = malloc(sizeof(struct record));
+    assert(record);
+    record->pending = 1;
+    record->offset = b->size;
+    put_u32(b, 0);
+    put_str(b, binary_name);
+    put_u32(b, info->modifiers);
+    put_str(b, info->superclass);
+    put_u32(b, info->interface_count);
+    for (i = 0; i < info->interface_count; ++i) {
+        put_str(b, info->interfaces[i]);
+    }
+    put_u32(b, info->method_count);
+    for (i = 0; i < info->method_count; ++i) {
+        put_str(b, info->methods[i].name);
+        put_u32(b, info->methods[i].modifiers);
+        put_str(b, info->methods[i].sig->descriptor);
+    }
+    put_u32(b, info->field_count);
+    for (i = 0; i < info->field_count; ++i) {
+        put_str(b, info->fields[i].name);
+        put_str(b, info->fields[i].sig);
+    }
+    length = b->size - record->offset;
+    memcpy(b->data + record->offset, &length, 4);
+
+    /* replaces a (malformed) mapped record */
+    free(hashtab_remove(segment->by_name, binary_name));
+    hashtab_put(segment->by_name, binary_name, record);
+    free(binary_name);
+    added++;
+    dirty = 1;
+}
+
+void class_store_forget(const char *internal_name)
+{
+    char *binary_name;
+    struct record *record;
+    int i;
+
+    if (!store_path) {
+        return;
+    }
+    /* or the mapped record would turn up later */
+    load_file();
+    if (!internal_name) {
+        for (i = 0; i < segment_count; ++i) {
+            hashtab_clear(segments[i].by_name, free);
+            segments[i].pending.size = 0;
+        }
+        dirty |= segment_count > 0;
+        return;
+    }
+    binary_name = internal_to_binary(internal_name);
+    for (i = 0; i < segment_count; ++i) {
+        record = hashtab_remove(segments[i].by_name, binary_name);
+        if (record) {
+            free(record);
+            dirty = 1;
+        }
+    }
+    free(binary_name);
+}
+
+/*
+ * Append the records (mapped or pending) of a segment that are still
+ * in use, i.e. not replaced or forgotten
+ */
+static void collect(struct segment *segment, const unsigned char *records, size_t records_length,
+                    int pending, struct buffer *b)
+{
+    struct reader r = { records, records + records_length, 1 };
+    struct reader name_reader;
+    struct record *record;
+    const unsigned char *start;
+    uint32_t length;
+
+    while (records && r.ok && r.p < r.end) {
+        start = r.p;
+        length = read_u32(&r);
+        if (!r.ok || length < 4 || (size_t) (r.end - start) < length) {
+            break;
+        }
+        name_reader.p = r.p;
+        name_reader.end = start + length;
+        name_reader.ok = 1;
+        record = hashtab_get(segment->by_name, read_str(&name_reader));
+        if (name_reader.ok && record && record->pending == pending &&
+            record->offset == (size_t) (start - records)) {
+            put(b, start, length);
+        }
+        r.p = start + length;
+    }
+}
+
+static void collect_records(struct segment *segment, struct buffer *b)
+{
+    collect(segment, segment->records, segment->records_length, 0, b);
+    collect(segment, segment->pending.data, segment->pending.size, 1, b);
+}
+
+int class_store_save()
+{
+    struct buffer b = { NULL, 0, 0 };
+    char *tmp_path;
+    size_t size;
+    uint32_t count = 0;
+    size_t count_offset;
+    size_t length_offset;
+    uint32_t length;
+    int fd, i, ret = 1;
+
+    if (!store_path || !dirty) {
+        return 0;
+    }
+
+    put(&b, STORE_MAGIC, 4);
+    put_u32(&b, STORE_VERSION);
+    put_u32(&b, STORE_BYTE_ORDER);
+    count_offset = b.size;
+    put_u32(&b, 0);
+    for (i = 0; i < segment_count; ++i) {
+        if (!segments[i].current || hashtab_count(segments[i].by_name) == 0) {
+            continue;
+        }
+        put_str(&b, segments[i].key);
+        length_offset = b.size;
+        put_u32(&b, 0);
+        collect_records(&segments[i], &b);
+        length = b.size - length_offset - 4;
+        memcpy(b.data + length_offset, &length, 4);
+        count++;
+    }
+    memcpy(b.data + count_offset, &count, 4);
+
+    /* write a new file and rename it over the old one (which stays mapped) */
+    size = strlen(store_path) + 5;
+    tmp_path = malloc(size);
+    assert(tmp_path);
+    snprintf(tmp_path, size, "%s.tmp", store_path);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write_all(fd, b.data, b.size) || close(fd) || rename(tmp_path, store_path)) {
+        if (fd >= 0) {
+            unlink(tmp_path);
+        }
+        ret = -1;
+    } else {
+        dirty = 0;
+    }
+    free(tmp_path);
+    free(b.data);
+    return ret;
+}
+
+void class_store_stop()
+{
+    if (class_store_save() < 0) {
+        fprintf(stderr, "Failed to write the class metadata cache %s: %s\n", store_path, strerror(errno));
+    }
+    free_segments();
+    free(store_path);
+    store_path = NULL;
+    if (sigs) {
+        hashtab_free(sigs, free);
+        sigs = NULL;
+    }
+    if (platform_loader && g_jni) {
+        (*g_jni)->DeleteGlobalRef(g_jni, platform_loader);
+    }
+    platform_loader = NULL;
+    platform_loader_resolved = 0;
+    free(jdk);
+    jdk = NULL;
+}
+
+/*
+ * (gg--class-store-open FILE)
+ *
+ * Use FILE (nil for none) for class metadata from now on, saving the
+ * current one first. FILE is read when first needed.
+ */
+emacs_value
+Fgg_class_store_open (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    char path[PATH_MAX];
+    ptrdiff_t size = PATH_MAX;
+
+    if (env->is_not_nil(env, args[0]) &&
+        (!type_is(env, args[0], Qstring) ||
+         !env->copy_string_contents(env, args[0], path, &size))) {
+        return NULL;
+    }
+    class_store_save();
+    free_segments();
+    free(store_path);
+    store_path = NULL;
+    if (env->is_not_nil(env, args[0])) {
+        store_path = strdup(path);
+        assert(store_path);
+    }
+    return Qnil;
+}
+
+/*
+ * (gg--class-store-save)
+ *
+ * Write the classes added since the store was read. Return t if the
+ * file was written.
+ */
+emacs_value
+Fgg_class_store_save (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    char err_msg[PATH_MAX + 100];
+    int ret = class_store_save();
+
+    if (ret < 0) {
+        snprintf(err_msg, sizeof(err_msg), "Can't write %s: %s", store_path, strerror(errno));
+        env->non_local_exit_signal(env, Qerror, env->make_string(env, err_msg, strlen(err_msg)));
+        return NULL;
+    }
+    return ret ? Qt : Qnil;
+}
+
+/*
+ * (gg--class-store-stats)
+ *
+ * Return (:classes N :hits N :added N): the number of classes in
+ * current segments, the class structs answered from the store and
+ * the classes added to it.
+ */
+emacs_value
+Fgg_class_store_stats (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    long classes = 0;
+    int i;
+
+    /* the JDK's segment can only be checked with the VM running */
+    if (g_jni) {
+        load_file();
+    }
+    for (i = 0; i < segment_count; ++i) {
+        if (segments[i].current) {
+            classes += hashtab_count(segments[i].by_name);
+        }
+    }
+    return list(env, 6,
+                QCclasses, env->make_integer(env, classes),
+                QChits, env->make_integer(env, hits),
+                QCadded, env->make_integer(env, added));
+}
@@ -0,0 +1,73 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Class metadata persisted across sessions (c.f. `gg-class-metadata-cache')
+ */
+
+#ifndef GG_CLASS_STORE_H
+#define GG_CLASS_STORE_H
+
+#include <emacs-module.h>
+
+#include "class_cache.h"
+
+emacs_value Fgg_class_store_open (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_class_store_save (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_class_store_stats (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+
+/*
+ * Return the stored metadata of a class (e.g. java/util/ArrayList) as
+ * a new class_info without a class ref or member IDs, or NULL if the
+ * store doesn't have it (or it's from a jar that's changed since).
+ */
+struct class_info *class_store_get(const char *internal_name);
+
+/*
+ * Record a class's metadata extracted from the JVM, if it comes from
+ * the JDK or a jar on the class path
+ */
+void class_store_add(struct class_info *info);
+
+/*
+ * Drop a class (or all classes if NULL) from the store, e.g. when
+ * it's flushed from the class cache after being redefined. The next
+ * lookup goes to the JVM.
+ */
+void class_store_forget(const char *internal_name);
+
+/*
+ * Write the store if classes were added.
+ *
+ * @return 1 if it was written, 0 if there was nothing to write or -1 on failure
+ */
+int class_store_save();
+
+/*
+ * Save and close the store (before the VM is destroyed and after the
+ * class cache is flushed)
+ */
+void class_store_stop();
+
+#endif
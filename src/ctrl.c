@@ -23,12 +23,19 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include <jni.h>
 #include <jvmti.h>
 
+#include "class_index.h"
+#include "ctrl.h"
+#include "events.h"
+
 /*
  * Global pointers to the vm under control (if this pointer is NULL, there is no running vm)
  * and
@@ -46,9 +53,76 @@ jvmtiEnv *g_jvmti;
  * the JMVTI error
  */
 jvmtiError g_jvmtiError;
+/*
+ * whether JVMTI object tagging is available
+ */
+int g_can_tag_objects;
 
 jclass g_java_lang_Class;
 jclass g_java_lang_String;
+jclass g_java_lang_Object;
+jclass g_java_lang_Throwable;
+jclass g_java_lang_Thread;
+jclass g_java_lang_reflect_Executable;
+jclass g_boolean_array_class;
+jclass g_byte_array_class;
+jclass g_char_array_class;
+jclass g_short_array_class;
+jclass g_int_array_class;
+jclass g_long_array_class;
+jclass g_float_array_class;
+jclass g_double_array_class;
+
+jmethodID g_mid_Class_getName;
+jmethodID g_mid_Object_toString;
+jmethodID g_mid_String_init_chars;
+jmethodID g_mid_Throwable_getMessage;
+jmethodID g_mid_Throwable_getStackTrace;
+jmethodID g_mid_Thread_currentThread;
+jmethodID g_mid_Thread_interrupt;
+jmethodID g_mid_Executable_getParameterTypes;
+
+/*
+ * Classes and IDs resolved once at JVM start. Classes are held as
+ * global refs. Add entries here rather than calling FindClass() or
+ * GetMethodID() from entry points.
+ */
+static const struct {
+    jclass *class;
+    const char *name;
+} cached_classes[] = {
+    {&g_java_lang_Class, "java/lang/Class"},
+    {&g_java_lang_String, "java/lang/String"},
+    {&g_java_lang_Object, "java/lang/Object"},
+    {&g_java_lang_Throwable, "java/lang/Throwable"},
+    {&g_java_lang_Thread, "java/lang/Thread"},
+    {&g_java_lang_reflect_Executable, "java/lang/reflect/Executable"},
+    {&g_boolean_array_class, "[Z"},
+    {&g_byte_array_class, "[B"},
+    {&g_char_array_class, "[C"},
+    {&g_short_array_class, "[S"},
+    {&g_int_array_class, "[I"},
+    {&g_long_array_class, "[J"},
+    {&g_float_array_class, "[F"},
+    {&g_double_array_class, "[D"}
+};
+
+static const struct {
+    jmethodID *mid;
+    jclass *class;
+    const char *name;
+    const char *sig;
+    int is_static;
+} cached_methods[] = {
+    {&g_mid_Class_getName, &g_java_lang_Class, "getName", "()Ljava/lang/String;", 0},
+    {&g_mid_Object_toString, &g_java_lang_Object, "toString", "()Ljava/lang/String;", 0},
+    {&g_mid_String_init_chars, &g_java_lang_String, "<init>", "([C)V", 0},
+    {&g_mid_Throwable_getMessage, &g_java_lang_Throwable, "getMessage", "()Ljava/lang/String;", 0},
+    {&g_mid_Throwable_getStackTrace, &g_java_lang_Throwable, "getStackTrace", "()[Ljava/lang/StackTraceElement;", 0},
+    {&g_mid_Thread_currentThread, &g_java_lang_Thread, "currentThread", "()Ljava/lang/Thread;", 1},
+    {&g_mid_Thread_interrupt, &g_java_lang_Thread, "interrupt", "()V", 0},
+    {&g_mid_Executable_getParameterTypes, &g_java_lang_reflect_Executable, "getParameterTypes", "()[Ljava/lang/Class;", 0}
+};
 
 jint JNI_OnLoad(JavaVM *vm, void *reserved)
 {
@@ -65,59 +139,327 @@ int gg_vfprintf(FILE *stream, const char *format, va_list ap)
 }
 
 /*
- * Start the JVM.
+ * Fill the class/ID cache. Classes and IDs are valid on any thread, so
+ * this can be done on the thread creating the VM.
+ *
+ * @return 0 for OK or JNI_ERR if something couldn't be resolved
+ */
+static int cache_ids(JNIEnv *jni)
+{
+    int i;
+    jclass class;
+    jmethodID mid;
+
+    for (i = 0; i < sizeof(cached_classes) / sizeof(cached_classes[0]); ++i) {
+        class = (*jni)->FindClass(jni, cached_classes[i].name);
+        if (!class) {
+            (*jni)->ExceptionDescribe(jni);
+            (*jni)->ExceptionClear(jni);
+            return JNI_ERR;
+        }
+        *cached_classes[i].class = (*jni)->NewGlobalRef(jni, class);
+        (*jni)->DeleteLocalRef(jni, class);
+        assert(*cached_classes[i].class);
+    }
+
+    for (i = 0; i < sizeof(cached_methods) / sizeof(cached_methods[0]); ++i) {
+        if (cached_methods[i].is_static) {
+            mid = (*jni)->GetStaticMethodID(jni, *cached_methods[i].class,
+                                            cached_methods[i].name, cached_methods[i].sig);
+        } else {
+            mid = (*jni)->GetMethodID(jni, *cached_methods[i].class,
+                                      cached_methods[i].name, cached_methods[i].sig);
+        }
+        if (!mid) {
+            (*jni)->ExceptionDescribe(jni);
+            (*jni)->ExceptionClear(jni);
+            return JNI_ERR;
+        }
+        *cached_methods[i].mid = mid;
+    }
+
+    return 0;
+}
+
+/*
+ * Forget the cached classes/IDs. They die with the VM so there is
+ * nothing to delete.
+ */
+static void uncache_ids()
+{
+    int i;
+    for (i = 0; i < sizeof(cached_classes) / sizeof(cached_classes[0]); ++i) {
+        *cached_classes[i].class = NULL;
+    }
+    for (i = 0; i < sizeof(cached_methods) / sizeof(cached_methods[0]); ++i) {
+        *cached_methods[i].mid = NULL;
+    }
+}
+
+/*
+ * Classes loaded ahead of use by `ctrl_start_java_async' so the
+ * first calls from Lisp don't pay for loading them.
+ */
+static const char *warm_up_classes[] = {
+    "java/lang/Integer",
+    "java/lang/Long",
+    "java/lang/Double",
+    "java/lang/Boolean",
+    "java/lang/StackTraceElement",
+    "java/util/ArrayList",
+    "java/util/HashMap",
+    "java/util/Iterator"
+};
+
+static void warm_up(JNIEnv *jni)
+{
+    int i;
+    jclass class;
+    for (i = 0; i < sizeof(warm_up_classes) / sizeof(warm_up_classes[0]); ++i) {
+        class = (*jni)->FindClass(jni, warm_up_classes[i]);
+        if (class) {
+            (*jni)->DeleteLocalRef(jni, class);
+        } else {
+            (*jni)->ExceptionClear(jni);
+        }
+    }
+}
+
+/*
+ * Create the VM on the current thread and set up everything that
+ * isn't specific to the Emacs thread (cached IDs, JVMTI).
  *
  * @return 0 for OK or a <0 JNI error code on failure
  */
-int ctrl_start_java(char **err_msg)
+static int create_vm(char **option_strings, int option_count, JavaVM **vm, JNIEnv **jni)
 {
     jint ret;
     JavaVMInitArgs vm_args;
-    JavaVMOption options[] = {
-        /* {.optionString = "-verbose:class"}, */
-        /* {.optionString = "-verbose:jni"}, */
-        {.optionString = "-Xcheck:jni"}
-    };
-
-    /* options[0].optionString = "-Xcheck:jni"; */
-    /* options[1].optionString = "vfprintf"; */
-    /* options[1].extraInfo = gg_vfprintf; */
+    jvmtiCapabilities capabilities;
+    JavaVMOption *options;
+    int i;
+
+    options = calloc(option_count ? option_count : 1, sizeof(JavaVMOption));
+    assert(options);
+    for (i = 0; i < option_count; ++i) {
+        options[i].optionString = option_strings[i];
+    }
+    /* options[n].optionString = "vfprintf"; */
+    /* options[n].extraInfo = gg_vfprintf; */
     vm_args.version = JNI_VERSION_1_8;
-    vm_args.nOptions = sizeof(options) / sizeof(JavaVMOption);
+    vm_args.nOptions = option_count;
     vm_args.options = options;
     vm_args.ignoreUnrecognized = 0;
 
-    ret = JNI_CreateJavaVM(&g_vm, (void**) &g_jni, &vm_args);
+    ret = JNI_CreateJavaVM(vm, (void**) jni, &vm_args);
+    free(options);
+    if (ret != JNI_OK) {
+        return ret;
+    }
+
+    ret = cache_ids(*jni);
+    if (ret != JNI_OK) {
+        fprintf(stderr, "Failed to resolve core classes/methods");
+        uncache_ids();
+        (**vm)->DestroyJavaVM(*vm);
+        return ret;
+    }
+
+    if (events_init(*jni) != JNI_OK) {
+        fprintf(stderr, "Failed to define gargoyle.Events, events from Java are disabled");
+    }
 
+    ret = (**vm)->GetEnv(*vm, (void**) &g_jvmti, JVMTI_VERSION_1_2);
+    if (ret != JNI_OK) {
+        /* TODO: deliver this to error buffer, c.f. [YT-13] */
+        fprintf(stderr, "Failed to access JMVTI environment. JNI error code=%d", ret);
+        uncache_ids();
+        (**vm)->DestroyJavaVM(*vm);
+        return ret;
+    }
+
+    /* Tags are used to memoize class name symbols
+     * (c.f. `jclass_to_symbol'). This is optional, we fall back
+     * to Class.getName() without it. */
+    memset(&capabilities, 0, sizeof(capabilities));
+    capabilities.can_tag_objects = 1;
+    if ((*g_jvmti)->AddCapabilities(g_jvmti, &capabilities) != JVMTI_ERROR_NONE) {
+        fprintf(stderr, "JVMTI can_tag_objects not available, class name lookups will be slower");
+    } else {
+        g_can_tag_objects = 1;
+    }
+
+    if (class_index_init(*jni) != JNI_OK) {
+        fprintf(stderr, "Failed to enable JVMTI class events, `gg-loaded-classes' will be incomplete");
+    }
+
+    return JNI_OK;
+}
+
+/*
+ * State of the VM, guarded by `status_lock'. An async start goes
+ * STARTING -> STARTED (or FAILED) on the starting thread and STARTED ->
+ * RUNNING when the Emacs thread attaches in `ctrl_finish_start'.
+ */
+static enum ctrl_status status = CTRL_STOPPED;
+static pthread_mutex_t status_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t status_changed = PTHREAD_COND_INITIALIZER;
+static JavaVM *started_vm;
+static int start_error;
+
+struct start_args {
+    char **option_strings;
+    int option_count;
+};
+
+static void *start_thread(void *data)
+{
+    struct start_args *args = data;
+    JavaVM *vm;
+    JNIEnv *jni;
+    int ret;
+    int i;
+
+    ret = create_vm(args->option_strings, args->option_count, &vm, &jni);
     if (ret == JNI_OK) {
-        ret = (*g_jni)->EnsureLocalCapacity(g_jni, 1000);
-       assert((ret == JNI_OK) && "Workaround to have enough stack space until we manage this properly");
+        warm_up(jni);
+        /* the Emacs thread attaches itself, c.f. `ctrl_finish_start' */
+        (*vm)->DetachCurrentThread(vm);
+    }
 
-       g_java_lang_Class = (*g_jni)->FindClass(g_jni, "java/lang/Class");
-       assert(g_java_lang_Class);
-       g_java_lang_String = (*g_jni)->FindClass(g_jni, "java/lang/String");
-       assert(g_java_lang_String);
+    for (i = 0; i < args->option_count; ++i) {
+        free(args->option_strings[i]);
+    }
+    free(args->option_strings);
+    free(args);
 
-       ret = (*g_vm)->GetEnv(g_vm, (void**) &g_jvmti, JVMTI_VERSION_1_2);
-       if (ret != JNI_OK) {
-           /* TODO: deliver this to error buffer, c.f. [YT-13] */
-           fprintf(stderr, "Failed to access JMVTI environment. JNI error code=%d", ret);
-           ret = (*g_vm)->DestroyJavaVM(g_vm);
-           assert(ret == JNI_OK);
-       }
+    pthread_mutex_lock(&status_lock);
+    if (ret == JNI_OK) {
+        started_vm = vm;
+        status = CTRL_STARTED;
+    } else {
+        start_error = ret;
+        status = CTRL_FAILED;
     }
+    pthread_cond_broadcast(&status_changed);
+    pthread_mutex_unlock(&status_lock);
+
+    return NULL;
+}
 
+int ctrl_start_java(char **option_strings, int option_count, char **err_msg)
+{
+    int ret;
+
+    assert(status == CTRL_STOPPED);
+    ret = create_vm(option_strings, option_count, &g_vm, &g_jni);
+    if (ret != JNI_OK) {
+        g_vm = NULL;
+        g_jni = NULL;
+        return ret;
+    }
+    status = CTRL_RUNNING;
     return ret;
 }
 
+int ctrl_start_java_async(char **option_strings, int option_count)
+{
+    pthread_t thread;
+    struct start_args *args;
+    int i;
+
+    assert(status == CTRL_STOPPED);
+
+    /* the thread gets its own copy of the options */
+    args = malloc(sizeof(struct start_args));
+    assert(args);
+    args->option_count = option_count;
+    args->option_strings = calloc(option_count ? option_count : 1, sizeof(char *));
+    assert(args->option_strings);
+    for (i = 0; i < option_count; ++i) {
+        args->option_strings[i] = strdup(option_strings[i]);
+        assert(args->option_strings[i]);
+    }
+
+    status = CTRL_STARTING;
+    if (pthread_create(&thread, NULL, start_thread, args) != 0) {
+        status = CTRL_STOPPED;
+        for (i = 0; i < option_count; ++i) {
+            free(args->option_strings[i]);
+        }
+        free(args->option_strings);
+        free(args);
+        return JNI_ERR;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+enum ctrl_status ctrl_finish_start(int wait_ms, int *error)
+{
+    struct timespec deadline;
+    enum ctrl_status result;
+    jint ret;
+
+    pthread_mutex_lock(&status_lock);
+    if (status == CTRL_STARTING && wait_ms != 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += wait_ms / 1000;
+        deadline.tv_nsec += (wait_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (status == CTRL_STARTING) {
+            if (wait_ms < 0) {
+                pthread_cond_wait(&status_changed, &status_lock);
+            } else if (pthread_cond_timedwait(&status_changed, &status_lock, &deadline) != 0) {
+                break;
+            }
+        }
+    }
+
+    if (status == CTRL_STARTED) {
+        ret = (*started_vm)->AttachCurrentThread(started_vm, (void **) &g_jni, NULL);
+        if (ret == JNI_OK) {
+            g_vm = started_vm;
+            status = CTRL_RUNNING;
+        } else {
+            start_error = ret;
+            status = CTRL_FAILED;
+        }
+    }
+    if (error) {
+        *error = start_error;
+    }
+    result = status;
+    pthread_mutex_unlock(&status_lock);
+
+    return result;
+}
+
+enum ctrl_status ctrl_status()
+{
+    enum ctrl_status result;
+    pthread_mutex_lock(&status_lock);
+    result = status;
+    pthread_mutex_unlock(&status_lock);
+    return result;
+}
+
 int ctrl_stop_java()
 {
     int ret;
     assert(g_vm);
     ret = (*g_vm)->DestroyJavaVM(g_vm);
     assert(ret == JNI_OK);
+    uncache_ids();
+    g_can_tag_objects = 0;
     g_vm = NULL;
     g_jni = NULL;
+    pthread_mutex_lock(&status_lock);
+    status = CTRL_STOPPED;
+    pthread_mutex_unlock(&status_lock);
     return ret;
 }
 
@@ -140,6 +482,26 @@ const char *ctrl_jni_version()
         return "1.6";
     case JNI_VERSION_1_8:
         return "1.8";
+#ifdef JNI_VERSION_9
+    case JNI_VERSION_9:
+        return "9";
+#endif
+#ifdef JNI_VERSION_10
+    case JNI_VERSION_10:
+        return "10";
+#endif
+#ifdef JNI_VERSION_19
+    case JNI_VERSION_19:
+        return "19";
+#endif
+#ifdef JNI_VERSION_20
+    case JNI_VERSION_20:
+        return "20";
+#endif
+#ifdef JNI_VERSION_21
+    case JNI_VERSION_21:
+        return "21";
+#endif
     }
     return "unknown";
 }
@@ -42,15 +42,86 @@ extern jvmtiEnv *g_jvmti;
  * the JVMTI error
  */
 extern jvmtiError g_jvmtiError;
+/*
+ * whether JVMTI object tagging is available (class name symbols are
+ * only cached with it, c.f. `jclass_to_symbol')
+ */
+extern int g_can_tag_objects;
 
 /*
  * Some global stuff for convenience.
  */
 extern jclass g_java_lang_Class;
 extern jclass g_java_lang_String;
+extern jclass g_java_lang_Object;
+extern jclass g_java_lang_Throwable;
+extern jclass g_java_lang_Thread;
+extern jclass g_java_lang_reflect_Executable;
+extern jclass g_boolean_array_class;
+extern jclass g_byte_array_class;
+extern jclass g_char_array_class;
+extern jclass g_short_array_class;
+extern jclass g_int_array_class;
+extern jclass g_long_array_class;
+extern jclass g_float_array_class;
+extern jclass g_double_array_class;
+
+/*
+ * Method IDs resolved once at JVM start (c.f. `cache_ids' in ctrl.c)
+ */
+extern jmethodID g_mid_Class_getName;
+extern jmethodID g_mid_Object_toString;
+extern jmethodID g_mid_String_init_chars;
+extern jmethodID g_mid_Throwable_getMessage;
+extern jmethodID g_mid_Throwable_getStackTrace;
+extern jmethodID g_mid_Thread_currentThread;
+extern jmethodID g_mid_Thread_interrupt;
+extern jmethodID g_mid_Executable_getParameterTypes;
+
+/*
+ * State of the VM (c.f. `ctrl_finish_start')
+ */
+enum ctrl_status {
+    CTRL_STOPPED,
+    CTRL_STARTING,              /* being created by `ctrl_start_java_async' */
+    CTRL_STARTED,               /* created, Emacs thread not attached yet */
+    CTRL_FAILED,
+    CTRL_RUNNING
+};
+
+/*
+ * How long module entry points wait for an async start to finish
+ * before signaling `java-starting'
+ */
+#define CTRL_STARTUP_WAIT_MS 200
+
+/*
+ * Start the JVM with the given options (c.f. `gg-java-start',
+ * e.g. "-Xmx1g", "-Djava.class.path=...", "-Xcheck:jni").
+ *
+ * @return 0 for OK or a <0 JNI error code on failure
+ */
+int ctrl_start_java(char **option_strings, int option_count, char **err_msg);
+
+/*
+ * Start creating the JVM on a new thread, which also resolves the
+ * cached IDs and loads some common classes. The options are copied.
+ *
+ * @return 0 if the thread was started
+ */
+int ctrl_start_java_async(char **option_strings, int option_count);
+
+/*
+ * Called on the Emacs thread: wait up to `wait_ms' (forever if < 0)
+ * for an async start and attach to the VM if it's been created. The
+ * JNI error of a failed start is stored in `error'.
+ *
+ * @return the resulting state
+ */
+enum ctrl_status ctrl_finish_start(int wait_ms, int *error);
 
-int ctrl_start_java(char **err_msg);
+enum ctrl_status ctrl_status();
 
-void ctrl_stop_java();
+int ctrl_stop_java();
 
 const char *ctrl_jni_version();
@@ -31,19 +31,136 @@
 #include <emacs-module.h>
 
 #include <jni.h>
+#include <jvmti.h>
+#include <classfile_constants.h>
 
 #include "class.h"
 #include "ctrl.h"
 #include "el_util.h"
+#include "handle.h"
+#include "strconv.h"
 
-void delete_global_ref_finalizer(void *x)
+/* finalizer needed as userptr finalizer isn't optional in dynamic modules */
+void noop_finalizer(void *x)
 {
-    (*g_jni)->DeleteGlobalRef(g_jni, (jobject) x);
 }
 
-/* finalizer needed as userptr finalizer isn't optional in dynamic modules */
-void noop_finalizer(void *x)
+emacs_value Qnil, Qt;
+emacs_value Qlist, Qcons, Qvector, Qvconcat, Qgethash, Qsymbol_name;
+emacs_value Qerror, Qwrong_type_argument, Qjava_exception, Qjava_starting;
+emacs_value Qquit, Qjava_timeout;
+emacs_value Qstarting, Qfailed, Qrunning, Qstopped;
+emacs_value Qsymbol, Qstring, Quser_ptr, Qhash_table, Qinteger, Qfloat;
+emacs_value Qapply, Qwrong_number_of_arguments, Qargs_out_of_range;
+emacs_value Qmake_vector, Qencode_coding_string, Qlatin_1;
+emacs_value Qz, Qb, Qc, Qs, Qi, Qj, Qf, Qd, Ql;
+emacs_value Qgg_prim, Qgg_array;
+emacs_value QCname, QCtype, QCreturns, QCaccepts, QCmodifiers, QCsignature;
+emacs_value QCsuperclass, QCinterfaces, QCmethods, QCfields;
+emacs_value QCclasses, QChits, QCadded;
+
+static emacs_value Qpublic, Qprivate, Qprotected, Qstatic, Qfinal, Qsynchronized,
+    Qbridge, Qvarargs, Qnative, Qabstract, Qstrictfp, Qsynthetic, Qsuper,
+    Qinterface, Qannotation, Qenum;
+
+/* (gg-prim . X) type symbols, indexed by the descriptor character */
+static emacs_value primitive_types['Z' + 1];
+
+static const struct {
+    emacs_value *sym;
+    const char *name;
+} symbol_table[] = {
+    {&Qnil, "nil"}, {&Qt, "t"},
+    {&Qlist, "list"}, {&Qcons, "cons"}, {&Qvector, "vector"}, {&Qvconcat, "vconcat"},
+    {&Qgethash, "gethash"}, {&Qsymbol_name, "symbol-name"},
+    {&Qerror, "error"}, {&Qwrong_type_argument, "wrong-type-argument"},
+    {&Qjava_exception, "java-exception"}, {&Qjava_starting, "java-starting"},
+    {&Qstarting, "starting"}, {&Qfailed, "failed"}, {&Qrunning, "running"}, {&Qstopped, "stopped"},
+    {&Qquit, "quit"}, {&Qjava_timeout, "java-timeout"},
+    {&Qsymbol, "symbol"}, {&Qstring, "string"}, {&Quser_ptr, "user-ptr"},
+    {&Qhash_table, "hash-table"}, {&Qinteger, "integer"}, {&Qfloat, "float"},
+    {&Qapply, "apply"}, {&Qwrong_number_of_arguments, "wrong-number-of-arguments"},
+    {&Qargs_out_of_range, "args-out-of-range"}, {&Qmake_vector, "make-vector"},
+    {&Qencode_coding_string, "encode-coding-string"}, {&Qlatin_1, "latin-1"},
+    {&Qz, "z"}, {&Qb, "b"}, {&Qc, "c"}, {&Qs, "s"}, {&Qi, "i"}, {&Qj, "j"},
+    {&Qf, "f"}, {&Qd, "d"}, {&Ql, "l"},
+    {&Qgg_prim, "gg-prim"}, {&Qgg_array, "gg-array"},
+    {&QCname, ":name"}, {&QCtype, ":type"}, {&QCreturns, ":returns"},
+    {&QCaccepts, ":accepts"}, {&QCmodifiers, ":modifiers"}, {&QCsignature, ":signature"},
+    {&QCsuperclass, ":superclass"}, {&QCinterfaces, ":interfaces"},
+    {&QCmethods, ":methods"}, {&QCfields, ":fields"},
+    {&QCclasses, ":classes"}, {&QChits, ":hits"}, {&QCadded, ":added"},
+    {&Qpublic, "public"}, {&Qprivate, "private"}, {&Qprotected, "protected"},
+    {&Qstatic, "static"}, {&Qfinal, "final"}, {&Qsynchronized, "synchronized"},
+    {&Qbridge, "bridge"}, {&Qvarargs, "varargs"}, {&Qnative, "native"},
+    {&Qabstract, "abstract"}, {&Qstrictfp, "strictfp"}, {&Qsynthetic, "synthetic"},
+    {&Qsuper, "super"}, {&Qinterface, "interface"}, {&Qannotation, "annotation"},
+    {&Qenum, "enum"}
+};
+
+/*
+ * Access flags here: https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.6
+ * Some flags share a bit so methods and classes need separate tables.
+ */
+static const struct {
+    jint flag;
+    emacs_value *sym;
+} method_modifiers[] = {
+    {JVM_ACC_PUBLIC, &Qpublic}, {JVM_ACC_PRIVATE, &Qprivate}, {JVM_ACC_PROTECTED, &Qprotected},
+    {JVM_ACC_STATIC, &Qstatic}, {JVM_ACC_FINAL, &Qfinal}, {JVM_ACC_SYNCHRONIZED, &Qsynchronized},
+    {JVM_ACC_BRIDGE, &Qbridge}, {JVM_ACC_VARARGS, &Qvarargs}, {JVM_ACC_NATIVE, &Qnative},
+    {JVM_ACC_ABSTRACT, &Qabstract}, {JVM_ACC_STRICT, &Qstrictfp}, {JVM_ACC_SYNTHETIC, &Qsynthetic}
+}, class_modifiers[] = {
+    {JVM_ACC_PUBLIC, &Qpublic}, {JVM_ACC_FINAL, &Qfinal}, {JVM_ACC_SUPER, &Qsuper},
+    {JVM_ACC_INTERFACE, &Qinterface}, {JVM_ACC_ABSTRACT, &Qabstract},
+    {JVM_ACC_SYNTHETIC, &Qsynthetic}, {JVM_ACC_ANNOTATION, &Qannotation}, {JVM_ACC_ENUM, &Qenum}
+};
+
+/*
+ * Intern all symbols used by the module. Called once from
+ * `emacs_module_init'.
+ */
+void init_symbols(emacs_env *env)
+{
+    static const char primitives[] = "ZBCSIJFDV";
+    char name[2] = {0, 0};
+    int i;
+
+    for (i = 0; i < sizeof(symbol_table) / sizeof(symbol_table[0]); ++i) {
+        *symbol_table[i].sym = env->make_global_ref(env, env->intern(env, symbol_table[i].name));
+    }
+    for (i = 0; primitives[i]; ++i) {
+        name[0] = primitives[i];
+        primitive_types[(int) primitives[i]] = env->make_global_ref(env, env->intern(env, name));
+    }
+}
+
+/*
+ * Symbol for a primitive type descriptor character, e.g. 'I' -> I
+ */
+emacs_value primitive_type_symbol(char type)
+{
+    assert(type > 0 && type <= 'Z' && primitive_types[(int) type]);
+    return primitive_types[(int) type];
+}
+
+/*
+ * Create the list of modifier symbols for a method (or class if
+ * `for_class')
+ */
+emacs_value modifiers_to_list(emacs_env *env, jint modifiers, int for_class)
 {
+    emacs_value modifiers_array[12];
+    int modifiers_count = 0;
+    int i, n = for_class ? sizeof(class_modifiers) / sizeof(class_modifiers[0])
+        : sizeof(method_modifiers) / sizeof(method_modifiers[0]);
+
+    for (i = 0; i < n; ++i) {
+        if (modifiers & (for_class ? class_modifiers[i].flag : method_modifiers[i].flag)) {
+            modifiers_array[modifiers_count++] = *(for_class ? class_modifiers[i].sym : method_modifiers[i].sym);
+        }
+    }
+    return env->funcall(env, Qlist, modifiers_count, modifiers_array);
 }
 
 /* create a list */
@@ -52,42 +169,40 @@ emacs_value list(emacs_env *env, int n, ...)
     va_list ap;
     emacs_value list;
     int i;
-    emacs_value *args;
+    emacs_value args[n];
 
     va_start(ap, n);
 
-    args = malloc(n * sizeof(emacs_value));
-    assert(args);
-
     for (i = 0; i < n; ++i) {
         args[i] = va_arg(ap, emacs_value);
     }
 
     va_end(ap);
 
-    list = env->funcall(env, env->intern(env, "list"), n, args);
+    list = env->funcall(env, Qlist, n, args);
 
     assert(list);
 
-    free(args);
-
     return list;
 }
 
 /*
  * Check whether the `type-of' an emacs_value matches the given type.
  *
- * e.g. type_is(env, some_string, "string") => 1
+ * e.g. type_is(env, some_string, Qstring) => 1
  *
  * TODO: rename this (and other functions that push non-local exits to `assert_type', etc
  */
-int type_is(emacs_env *env, emacs_value v, const char *type_name)
+int type_is(emacs_env *env, emacs_value v, emacs_value type)
 {
     static char errmsg[50];
+    static char type_name[32];
+    ptrdiff_t size = sizeof(type_name);
     emacs_value t = env->type_of(env, v);
-    if (!env->eq(env, t, env->intern(env, type_name))) {
+    if (!env->eq(env, t, type)) {
+        symbol_to_string(env, type, type_name, &size);
         sprintf(errmsg, "Expected %s:", type_name);
-        env->non_local_exit_signal(env, env->intern(env, "wrong-type-argument"),
+        env->non_local_exit_signal(env, Qwrong_type_argument,
                                    list(env, 3, env->make_string(env, errmsg, strlen(errmsg)), t, v));
         return 0;
     } else {
@@ -96,46 +211,25 @@ int type_is(emacs_env *env, emacs_value v, const char *type_name)
 }
 
 /*
- * Wrap a jobject pointer to a Lisp "Java object".
+ * Wrap a jobject pointer to a Lisp "Java object" (a handle,
+ * c.f. handle.c). The class is optional, if given its name symbol is
+ * cached in the handle right away.
  */
 emacs_value new_java_object(emacs_env *env, jobject o, jclass class)
 {
-    emacs_value args[2];
-    emacs_value wrapped;
-    jstring class_name;
+    emacs_value class_sym = NULL;
 
-    if (class == NULL) {
-        class = (*g_jni)->GetObjectClass(g_jni, o);
-        if (handle_exception(env)) { return NULL; }
-        assert(class);
-        class_name = get_class_name(env, class);
-        (*g_jni)->DeleteLocalRef(g_jni, class);
-    } else {
-        class_name = get_class_name(env, class);
+    if (class && g_can_tag_objects) {
+        class_sym = jclass_to_symbol(env, class);
+        if (!class_sym) {
+            return NULL;
+        }
     }
 
     o = (*g_jni)->NewGlobalRef(g_jni, o);
     assert(o);
 
-    args[0] = env->make_user_ptr(env, delete_global_ref_finalizer, o);
-    args[1] = jstring_to_symbol(env, class_name);
-
-    (*g_jni)->DeleteLocalRef(g_jni, class_name);
-
-    wrapped = env->funcall(env, env->intern(env, "gg--new-object"), 2, args);
-    if (env->non_local_exit_check(env) != emacs_funcall_exit_return) {
-        return NULL;
-    }
-    assert(wrapped);
-
-    /*
-     * TODO  TODO  TODO  TODO  TODO  TODO  TODO 
-     * Map the methods available on this object (and static methods if
-     * it's a class) into the Lisp environment
-     * [YT-28]
-     */
-
-    return wrapped;
+    return handle_new(env, o, class_sym);
 }
 
 /*
@@ -145,34 +239,86 @@ emacs_value new_java_object(emacs_env *env, jobject o, jclass class)
 int jvm_running(emacs_env *env)
 {
     static const char *err_msg = "Gargoyle JVM not running";
+    static const char *starting_msg = "Gargoyle JVM is starting";
     emacs_value wrapped_err_msg;
     if (g_jni) {
         return 1;
     }
+    if (ctrl_status() == CTRL_STARTING || ctrl_status() == CTRL_STARTED) {
+        env->non_local_exit_signal(env, Qjava_starting,
+                                   env->make_string(env, starting_msg, strlen(starting_msg)));
+        return 0;
+    }
     wrapped_err_msg = env->make_string(env, err_msg, strlen(err_msg));
     assert(wrapped_err_msg);
-    env->non_local_exit_signal(env, env->intern(env, "error"), wrapped_err_msg);
+    env->non_local_exit_signal(env, Qerror, wrapped_err_msg);
     return 0;
 }
 
+/*
+ * Print Java exceptions to stderr when they're converted
+ * (c.f. `gg-java-print-exceptions')
+ */
+int g_print_exceptions;
+
+/*
+ * The `java-exception' error data for a throwable: (CLASS-SYMBOL
+ * MESSAGE THROWABLE). The stack trace is left in the throwable until
+ * asked for (c.f. `gg-java-exception-stack-trace').
+ */
+emacs_value exception_data(emacs_env *env, jthrowable exception)
+{
+    jclass class;
+    jstring message;
+    emacs_value class_sym;
+    emacs_value message_str = Qnil;
+    emacs_value wrapped;
+
+    class = (*g_jni)->GetObjectClass(g_jni, exception);
+    class_sym = jclass_to_symbol(env, class);
+
+    message = (*g_jni)->CallObjectMethod(g_jni, exception, g_mid_Throwable_getMessage);
+    if ((*g_jni)->ExceptionCheck(g_jni)) {
+        /* getMessage() is overridable and may throw itself */
+        (*g_jni)->ExceptionClear(g_jni);
+    } else if (message) {
+        message_str = jstring_to_lisp(env, message);
+        (*g_jni)->DeleteLocalRef(g_jni, message);
+    }
+
+    wrapped = new_java_object(env, exception, class);
+    (*g_jni)->DeleteLocalRef(g_jni, class);
+
+    /* the Java exception takes precedence over conversion failures */
+    env->non_local_exit_clear(env);
+    return list(env, 3, class_sym ? class_sym : Qnil,
+                message_str ? message_str : Qnil,
+                wrapped ? wrapped : Qnil);
+}
+
 /*
  * Check for JNI exceptions. If one exists, it will be "thrown" into
- * the Emacs environment as a `java-exception' error.
+ * the Emacs environment as a `java-exception' error
+ * (c.f. `exception_data').
  */
 int handle_exception(emacs_env *env)
 {
     jthrowable exception;
+    emacs_value data;
+
     exception = (*g_jni)->ExceptionOccurred(g_jni);
-    if (exception) {
-        if /* should I print exceptions? */ (1) {
-            (*g_jni)->ExceptionDescribe(g_jni);
-        }
-        (*g_jni)->ExceptionClear(g_jni);
-        env->non_local_exit_signal(env, env->intern(env, "java-exception"),
-                                   new_java_object(env, exception, NULL));
-        return 1;
+    if (!exception) {
+        return 0;
     }
-    return 0;
+    if (g_print_exceptions) {
+        (*g_jni)->ExceptionDescribe(g_jni);
+    }
+    (*g_jni)->ExceptionClear(g_jni);
+
+    data = exception_data(env, exception);
+    (*g_jni)->DeleteLocalRef(g_jni, exception);
+    env->non_local_exit_signal(env, Qjava_exception, data);
+    return 1;
 }
 
 /*
@@ -185,13 +331,22 @@ int check_jvmti_error(emacs_env *env)
       (*g_jvmti)->GetErrorName(g_jvmti, g_jvmtiError, &errmsg);
       /* we never Deallocate() the errmsg returned from JVMTI */
 
-      env->non_local_exit_signal(env, env->intern(env, "error"),
+      env->non_local_exit_signal(env, Qerror,
                                  env->make_string(env, errmsg, strlen(errmsg)));
       return 1;
   }
   return 0;
 }
 
+/*
+ * Class name symbols, indexed by (JVMTI tag - 1) of the class
+ * object. The symbols are held as global refs. Once a class has been
+ * seen, getting its symbol needs no call into Java.
+ */
+static emacs_value *class_symbols;
+static jlong class_symbol_count;
+static jlong class_symbol_capacity;
+
 /*
  * Get the class name as a symbol
  */
@@ -199,12 +354,49 @@ emacs_value jclass_to_symbol (emacs_env *env, jclass class)
 {
     jstring class_name;
     emacs_value class_sym;
+    jlong tag;
+    jvmtiError err;
+
+    err = (*g_jvmti)->GetTag(g_jvmti, class, &tag);
+    if (err == JVMTI_ERROR_NONE && tag > 0 && tag <= class_symbol_count) {
+        return class_symbols[tag - 1];
+    }
+
     class_name = get_class_name(env, class);
+    if (!class_name) {
+        return NULL;
+    }
     class_sym = jstring_to_symbol(env, class_name);
     (*g_jni)->DeleteLocalRef(g_jni, class_name);
+    if (!class_sym || err != JVMTI_ERROR_NONE) {
+        /* no tagging capability, don't cache */
+        return class_sym;
+    }
+
+    if (class_symbol_count == class_symbol_capacity) {
+        class_symbol_capacity = class_symbol_capacity ? class_symbol_capacity * 2 : 256;
+        class_symbols = realloc(class_symbols, sizeof(emacs_value) * class_symbol_capacity);
+        assert(class_symbols);
+    }
+    class_sym = env->make_global_ref(env, class_sym);
+    class_symbols[class_symbol_count++] = class_sym;
+    (*g_jvmti)->SetTag(g_jvmti, class, class_symbol_count);
+
     return class_sym;
 }
 
+/*
+ * Forget all cached class symbols (the tags die with the JVM)
+ */
+void clear_class_symbols (emacs_env *env)
+{
+    jlong i;
+    for (i = 0; i < class_symbol_count; ++i) {
+        env->free_global_ref(env, class_symbols[i]);
+    }
+    class_symbol_count = 0;
+}
+
 /*
  * Wrap a Java string in an Emacs symbol.
  */
@@ -232,10 +424,8 @@ bool symbol_to_string (emacs_env *env, emacs_value symbol, char *string, ptrdiff
     emacs_value lisp_string;
     int ok;
     args[0] = symbol;
-    if (!type_is(env, symbol, "symbol")) {
-        assert(!"Value is not a symbol");
-    }
-    lisp_string = env->funcall(env, env->intern(env, "symbol-name"), 1, args);
+    assert(env->eq(env, env->type_of(env, symbol), Qsymbol) && "Value is not a symbol");
+    lisp_string = env->funcall(env, Qsymbol_name, 1, args);
     assert(lisp_string);
     ok = env->copy_string_contents(env, lisp_string, string, size);
     assert(ok);
@@ -247,16 +437,9 @@ bool symbol_to_string (emacs_env *env, emacs_value symbol, char *string, ptrdiff
  */
 jstring get_class_name (emacs_env *env, jclass class)
 {
-    jmethodID mid_getName;
     jstring name;
 
-    mid_getName = (*g_jni)->GetMethodID(g_jni, g_java_lang_Class, "getName", "()Ljava/lang/String;");
-    handle_exception(env);
-    assert(mid_getName);
-    if (handle_exception(env)) { assert(0);return NULL; }
-    assert(mid_getName);
-
-    name = (*g_jni)->CallObjectMethod(g_jni, class, mid_getName);
+    name = (*g_jni)->CallObjectMethod(g_jni, class, g_mid_Class_getName);
     if (handle_exception(env)) { return NULL; }
     assert(name);
 
@@ -28,16 +28,45 @@
 
 #include <emacs-module.h>
 
+#include <jni.h>
+
 #define ASSERT_JVM_RUNNING(E) if (!jvm_running(E)) { return NULL; }
 
+/*
+ * Symbols interned once at module init and held as global refs
+ * (c.f. `init_symbols')
+ */
+extern emacs_value Qnil, Qt;
+extern emacs_value Qlist, Qcons, Qvector, Qvconcat, Qgethash, Qsymbol_name;
+extern emacs_value Qerror, Qwrong_type_argument, Qjava_exception, Qjava_starting;
+extern emacs_value Qquit, Qjava_timeout;
+extern emacs_value Qstarting, Qfailed, Qrunning, Qstopped;
+extern emacs_value Qsymbol, Qstring, Quser_ptr, Qhash_table, Qinteger, Qfloat;
+extern emacs_value Qapply, Qwrong_number_of_arguments, Qargs_out_of_range;
+extern emacs_value Qmake_vector, Qencode_coding_string, Qlatin_1;
+extern emacs_value Qz, Qb, Qc, Qs, Qi, Qj, Qf, Qd, Ql;
+extern emacs_value Qgg_prim, Qgg_array;
+extern emacs_value QCname, QCtype, QCreturns, QCaccepts, QCmodifiers, QCsignature;
+extern emacs_value QCsuperclass, QCinterfaces, QCmethods, QCfields;
+extern emacs_value QCclasses, QChits, QCadded;
+
+/* c.f. `handle_exception' */
+extern int g_print_exceptions;
+
+void init_symbols(emacs_env *env);
+emacs_value primitive_type_symbol(char type);
+emacs_value modifiers_to_list(emacs_env *env, jint modifiers, int for_class);
+
 void noop_finalizer(void *x);
 emacs_value list(emacs_env *env, int n, ...);
-int type_is(emacs_env *env, emacs_value v, const char *type_name);
+int type_is(emacs_env *env, emacs_value v, emacs_value type);
 emacs_value new_java_object(emacs_env *env, jobject o, jclass class);
 int jvm_running(emacs_env *env);
 int handle_exception(emacs_env *env);
+emacs_value exception_data(emacs_env *env, jthrowable exception);
 emacs_value jstring_to_symbol (emacs_env *env, jstring string);
 bool symbol_to_string (emacs_env *env, emacs_value symbol, char *string, ptrdiff_t *size);
 int check_jvmti_error(emacs_env *env);
 emacs_value jclass_to_symbol (emacs_env *env, jclass class);
+void clear_class_symbols (emacs_env *env);
 jstring get_class_name (emacs_env *env, jclass class);
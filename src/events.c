@@ -0,0 +1,290 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <emacs-module.h>
+#include <jni.h>
+
+#include "ctrl.h"
+#include "el_util.h"
+#include "events.h"
+#include "handle.h"
+#include "notify.h"
+#include "strconv.h"
+
+/*
+ * gargoyle.Events, defined in the bootstrap loader so any class can
+ * see it. It's the class file of:
+ *
+ *   package gargoyle;
+ *   public final class Events {
+ *       public static native boolean post(String type, Object data);
+ *   }
+ */
+static const unsigned char events_class_file[] = {
+    0xca, 0xfe, 0xba, 0xbe,     /* magic */
+    0x00, 0x00, 0x00, 0x34,     /* version 52.0 (Java 8) */
+    0x00, 0x07,                 /* constant pool count */
+    /* #1 Class #2 */
+    0x07, 0x00, 0x02,
+    /* #2 Utf8 */
+    0x01, 0x00, 0x0f,
+    'g', 'a', 'r', 'g', 'o', 'y', 'l', 'e', '/', 'E', 'v', 'e', 'n', 't', 's',
+    /* #3 Class #4 */
+    0x07, 0x00, 0x04,
+    /* #4 Utf8 */
+    0x01, 0x00, 0x10,
+    'j', 'a', 'v', 'a', '/', 'l', 'a', 'n', 'g', '/', 'O', 'b', 'j', 'e', 'c', 't',
+    /* #5 Utf8 */
+    0x01, 0x00, 0x04,
+    'p', 'o', 's', 't',
+    /* #6 Utf8 */
+    0x01, 0x00, 0x27,
+    '(', 'L', 'j', 'a', 'v', 'a', '/', 'l', 'a', 'n', 'g', '/', 'S', 't', 'r', 'i', 'n', 'g', ';',
+    'L', 'j', 'a', 'v', 'a', '/', 'l', 'a', 'n', 'g', '/', 'O', 'b', 'j', 'e', 'c', 't', ';',
+    ')', 'Z',
+    0x00, 0x31,                 /* ACC_PUBLIC | ACC_FINAL | ACC_SUPER */
+    0x00, 0x01,                 /* this class */
+    0x00, 0x03,                 /* super class */
+    0x00, 0x00,                 /* interfaces */
+    0x00, 0x00,                 /* fields */
+    0x00, 0x01,                 /* methods */
+    0x01, 0x09,                 /* ACC_PUBLIC | ACC_STATIC | ACC_NATIVE */
+    0x00, 0x05, 0x00, 0x06,     /* name, descriptor */
+    0x00, 0x00,                 /* attributes */
+    0x00, 0x00                  /* attributes */
+};
+
+struct event {
+    jstring type;               /* global ref */
+    jobject data;               /* global ref, may be NULL */
+};
+
+/*
+ * Ring buffer of posted events. Posting never blocks on Emacs: when
+ * the ring is full the event is dropped and post() returns false.
+ */
+static struct event *ring;
+static size_t ring_capacity;
+static size_t ring_head;        /* next to deliver */
+static size_t ring_count;
+static size_t dropped;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the size of the ring at the next start, c.f. `gg--set-event-capacity' */
+static size_t event_capacity = 8192;
+
+static jboolean JNICALL post(JNIEnv *jni, jclass class, jstring type, jobject data)
+{
+    struct event event;
+    int full;
+
+    if (!type) {
+        return JNI_FALSE;
+    }
+    event.type = (*jni)->NewGlobalRef(jni, type);
+    event.data = data ? (*jni)->NewGlobalRef(jni, data) : NULL;
+
+    pthread_mutex_lock(&ring_lock);
+    full = !ring || ring_count == ring_capacity;
+    if (full) {
+        dropped++;
+    } else {
+        ring[(ring_head + ring_count) % ring_capacity] = event;
+        ring_count++;
+    }
+    pthread_mutex_unlock(&ring_lock);
+
+    if (full) {
+        (*jni)->DeleteGlobalRef(jni, event.type);
+        if (event.data) {
+            (*jni)->DeleteGlobalRef(jni, event.data);
+        }
+        return JNI_FALSE;
+    }
+    notify_post();
+    return JNI_TRUE;
+}
+
+int events_init(JNIEnv *jni)
+{
+    JNINativeMethod methods[] = {
+        {"post", "(Ljava/lang/String;Ljava/lang/Object;)Z", (void *) post}
+    };
+    jclass class;
+
+    class = (*jni)->DefineClass(jni, "gargoyle/Events", NULL,
+                                (const jbyte *) events_class_file, sizeof(events_class_file));
+    if (!class) {
+        (*jni)->ExceptionDescribe(jni);
+        (*jni)->ExceptionClear(jni);
+        return JNI_ERR;
+    }
+    if ((*jni)->RegisterNatives(jni, class, methods, 1) != JNI_OK) {
+        (*jni)->ExceptionClear(jni);
+        (*jni)->DeleteLocalRef(jni, class);
+        return JNI_ERR;
+    }
+    (*jni)->DeleteLocalRef(jni, class);
+
+    pthread_mutex_lock(&ring_lock);
+    ring_capacity = event_capacity;
+    ring = calloc(ring_capacity, sizeof(struct event));
+    assert(ring);
+    ring_head = ring_count = dropped = 0;
+    pthread_mutex_unlock(&ring_lock);
+    return JNI_OK;
+}
+
+void events_stop()
+{
+    size_t i;
+    struct event *event;
+
+    pthread_mutex_lock(&ring_lock);
+    for (i = 0; i < ring_count; ++i) {
+        event = &ring[(ring_head + i) % ring_capacity];
+        (*g_jni)->DeleteGlobalRef(g_jni, event->type);
+        if (event->data) {
+            (*g_jni)->DeleteGlobalRef(g_jni, event->data);
+        }
+    }
+    free(ring);
+    ring = NULL;
+    ring_head = ring_count = 0;
+    pthread_mutex_unlock(&ring_lock);
+}
+
+/* Strings are delivered as Lisp strings, everything else as objects */
+static emacs_value event_data(emacs_env *env, jobject data)
+{
+    emacs_value value;
+    if (!data) {
+        return Qnil;
+    }
+    if ((*g_jni)->IsInstanceOf(g_jni, data, g_java_lang_String)) {
+        value = jstring_to_lisp(env, data);
+        (*g_jni)->DeleteGlobalRef(g_jni, data);
+        return value;
+    }
+    /* the handle takes over the global ref */
+    return handle_new(env, data, NULL);
+}
+
+/*
+ * (gg--drain-events-raw &optional MAX)
+ *
+ * Return (at most MAX) posted events as a list of (TYPE . DATA), in
+ * posting order. TYPE is a symbol.
+ */
+emacs_value
+Fgg_drain_events_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    struct event *events;
+    size_t count, remaining, i;
+    emacs_value result = Qnil;
+    emacs_value cons_args[2];
+
+    ASSERT_JVM_RUNNING(env);
+
+    count = SIZE_MAX;
+    if (nargs > 0 && env->is_not_nil(env, args[0])) {
+        count = env->extract_integer(env, args[0]);
+        if (env->non_local_exit_check(env) != emacs_funcall_exit_return) {
+            return NULL;
+        }
+    }
+
+    /* copy them out so posting isn't held up by the conversions */
+    notify_ack();
+    pthread_mutex_lock(&ring_lock);
+    if (count > ring_count) {
+        count = ring_count;
+    }
+    events = malloc(sizeof(struct event) * (count ? count : 1));
+    assert(events);
+    for (i = 0; i < count; ++i) {
+        events[i] = ring[(ring_head + i) % ring_capacity];
+    }
+    ring_head = (ring_head + count) % ring_capacity;
+    ring_count -= count;
+    remaining = ring_count;
+    pthread_mutex_unlock(&ring_lock);
+
+    /* more left, come back for them */
+    if (remaining) {
+        notify_post();
+    }
+
+    for (i = count; i-- > 0; ) {
+        cons_args[0] = jstring_to_symbol(env, events[i].type);
+        (*g_jni)->DeleteGlobalRef(g_jni, events[i].type);
+        cons_args[1] = event_data(env, events[i].data);
+        cons_args[0] = env->funcall(env, Qcons, 2, cons_args);
+        cons_args[1] = result;
+        result = env->funcall(env, Qcons, 2, cons_args);
+    }
+    free(events);
+    return result;
+}
+
+/*
+ * (gg-events-dropped)
+ *
+ * Return the number of events dropped because the buffer was full.
+ */
+emacs_value
+Fgg_events_dropped (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    size_t count;
+    pthread_mutex_lock(&ring_lock);
+    count = dropped;
+    pthread_mutex_unlock(&ring_lock);
+    return env->make_integer(env, count);
+}
+
+/*
+ * (gg--set-event-capacity COUNT)
+ *
+ * Takes effect the next time the JVM is started.
+ */
+emacs_value
+Fgg_set_event_capacity (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    intmax_t count = env->extract_integer(env, args[0]);
+    if (env->non_local_exit_check(env) != emacs_funcall_exit_return) {
+        return NULL;
+    }
+    if (count < 1) {
+        env->non_local_exit_signal(env, Qargs_out_of_range, list(env, 1, args[0]));
+        return NULL;
+    }
+    event_capacity = count;
+    return args[0];
+}
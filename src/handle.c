@@ -0,0 +1,343 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emacs-module.h>
+
+#include <jni.h>
+
+#include "ctrl.h"
+#include "el_util.h"
+#include "handle.h"
+
+/*
+ * Slots are allocated in slabs that never move, so growing the table
+ * is just adding a slab. Free slots are chained through `next_free'.
+ */
+#define SLAB_BITS 10
+#define SLAB_SIZE (1 << SLAB_BITS)
+
+struct handle_slot {
+    jobject ref;                /* global ref, NULL if the slot is free */
+    emacs_value class_symbol;   /* cached, NULL if not known yet */
+    uint32_t generation;        /* bumped each time the slot is freed */
+    uint32_t next_free;         /* index + 1 of the next free slot, 0 for none */
+    uint32_t next_release;      /* index + 1 of the next slot on a release list */
+};
+
+static struct handle_slot **slabs;
+static uint32_t slab_count;
+static uint32_t slot_count;     /* slots handed out at least once */
+static uint32_t free_head;      /* index + 1 of the first free slot, 0 for none */
+static size_t live_count;
+
+/*
+ * Release queue. Finalizers run during Emacs GC, where a JNI
+ * transition per dead handle would add up. They only push the slot on
+ * `release_head' (lock-free, so it's also safe from other threads)
+ * and the global refs are deleted in batches by
+ * `handle_drain_releases' at the next module entry or idle timer.
+ * The drain moves the queue to the `release_backlog' (only touched by
+ * the draining thread) to work through it in batches.
+ */
+static uint32_t release_head;   /* index + 1, 0 for none */
+static uint32_t release_backlog;
+static size_t pending_count;
+size_t g_release_batch_size = 1024;
+
+/*
+ * The user-ptr doesn't point anywhere: it packs the slot index (low
+ * 32 bits) with the generation (high 32 bits) so a handle to a slot
+ * which has been freed and reused is detected.
+ */
+#define PACK(INDEX, GENERATION) ((void *) (((uintptr_t) (GENERATION) << 32) | (INDEX)))
+#define INDEX(PACKED) ((uint32_t) ((uintptr_t) (PACKED) & 0xFFFFFFFF))
+#define GENERATION(PACKED) ((uint32_t) ((uintptr_t) (PACKED) >> 32))
+
+static struct handle_slot *slot_at(uint32_t index)
+{
+    return &slabs[index >> SLAB_BITS][index & (SLAB_SIZE - 1)];
+}
+
+/*
+ * Find the slot for a packed handle, NULL if it's stale
+ */
+static struct handle_slot *lookup(void *packed)
+{
+    struct handle_slot *slot;
+    if (INDEX(packed) >= slot_count) {
+        return NULL;
+    }
+    slot = slot_at(INDEX(packed));
+    if (!slot->ref || slot->generation != GENERATION(packed)) {
+        return NULL;
+    }
+    return slot;
+}
+
+static void free_slot(uint32_t index)
+{
+    struct handle_slot *slot = slot_at(index);
+    slot->ref = NULL;
+    slot->class_symbol = NULL;
+    /* generation 0 is never used, c.f. `handle_new' */
+    if (++slot->generation == 0) {
+        slot->generation = 1;
+    }
+    slot->next_free = free_head;
+    free_head = index + 1;
+    --live_count;
+}
+
+static void handle_finalizer(void *packed)
+{
+    struct handle_slot *slot = lookup(packed);
+    uint32_t head;
+
+    /* stale if the VM was stopped */
+    if (!slot) {
+        return;
+    }
+    head = __atomic_load_n(&release_head, __ATOMIC_RELAXED);
+    do {
+        slot->next_release = head;
+    } while (!__atomic_compare_exchange_n(&release_head, &head, INDEX(packed) + 1, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&pending_count, 1, __ATOMIC_RELAXED);
+}
+
+size_t handle_drain_releases(size_t max)
+{
+    size_t released = 0;
+    uint32_t index;
+
+    if (!release_backlog) {
+        release_backlog = __atomic_exchange_n(&release_head, 0, __ATOMIC_ACQUIRE);
+    }
+    while (release_backlog && released < max) {
+        index = release_backlog - 1;
+        release_backlog = slot_at(index)->next_release;
+        (*g_jni)->DeleteGlobalRef(g_jni, slot_at(index)->ref);
+        free_slot(index);
+        ++released;
+        if (!release_backlog) {
+            release_backlog = __atomic_exchange_n(&release_head, 0, __ATOMIC_ACQUIRE);
+        }
+    }
+    __atomic_sub_fetch(&pending_count, released, __ATOMIC_RELAXED);
+    return released;
+}
+
+size_t handle_pending_releases()
+{
+    return __atomic_load_n(&pending_count, __ATOMIC_RELAXED);
+}
+
+emacs_value handle_new(emacs_env *env, jobject global_ref, emacs_value class_symbol)
+{
+    uint32_t index;
+    struct handle_slot *slot;
+
+    assert(sizeof(uintptr_t) >= 8 && "Handles are packed in 64 bit pointers");
+
+    if (free_head) {
+        index = free_head - 1;
+        slot = slot_at(index);
+        free_head = slot->next_free;
+    } else {
+        if (slot_count == slab_count * SLAB_SIZE) {
+            slabs = realloc(slabs, sizeof(struct handle_slot *) * (slab_count + 1));
+            assert(slabs);
+            slabs[slab_count] = calloc(SLAB_SIZE, sizeof(struct handle_slot));
+            assert(slabs[slab_count]);
+            ++slab_count;
+        }
+        index = slot_count++;
+        slot = slot_at(index);
+        slot->generation = 1;
+    }
+
+    slot->ref = global_ref;
+    slot->class_symbol = class_symbol;
+    slot->next_free = 0;
+    ++live_count;
+
+    return env->make_user_ptr(env, handle_finalizer, PACK(index, slot->generation));
+}
+
+/*
+ * Slot of a handle or NULL with a pending signal
+ */
+static struct handle_slot *get_slot(emacs_env *env, emacs_value value)
+{
+    static const char *type_errmsg = "Expected Java object:";
+    static const char *stale_errmsg = "Stale Java object (the JVM was stopped)";
+    struct handle_slot *slot;
+
+    if (!type_is(env, value, Quser_ptr)) {
+        return NULL;
+    }
+    if (env->get_user_finalizer(env, value) != handle_finalizer) {
+        env->non_local_exit_signal(env, Qwrong_type_argument,
+                                   list(env, 2, env->make_string(env, type_errmsg, strlen(type_errmsg)), value));
+        return NULL;
+    }
+    slot = lookup(env->get_user_ptr(env, value));
+    if (!slot) {
+        env->non_local_exit_signal(env, Qerror,
+                                   list(env, 2, env->make_string(env, stale_errmsg, strlen(stale_errmsg)), value));
+        return NULL;
+    }
+    return slot;
+}
+
+jobject handle_get(emacs_env *env, emacs_value value)
+{
+    struct handle_slot *slot = get_slot(env, value);
+    return slot ? slot->ref : NULL;
+}
+
+emacs_value handle_class_symbol(emacs_env *env, emacs_value value)
+{
+    struct handle_slot *slot = get_slot(env, value);
+    jclass class;
+    emacs_value class_symbol;
+
+    if (!slot) {
+        return NULL;
+    }
+    if (slot->class_symbol) {
+        return slot->class_symbol;
+    }
+
+    class = (*g_jni)->GetObjectClass(g_jni, slot->ref);
+    class_symbol = jclass_to_symbol(env, class);
+    (*g_jni)->DeleteLocalRef(g_jni, class);
+    /* only symbols from the tag cache are global refs */
+    if (class_symbol && g_can_tag_objects) {
+        slot->class_symbol = class_symbol;
+    }
+    return class_symbol;
+}
+
+int handle_p(emacs_env *env, emacs_value value)
+{
+    return env->eq(env, env->type_of(env, value), Quser_ptr) &&
+        env->get_user_finalizer(env, value) == handle_finalizer &&
+        lookup(env->get_user_ptr(env, value));
+}
+
+void handle_release_all()
+{
+    uint32_t i;
+    /* queued refs die with the VM too */
+    release_head = 0;
+    release_backlog = 0;
+    pending_count = 0;
+    for (i = 0; i < slot_count; ++i) {
+        if (slot_at(i)->ref) {
+            free_slot(i);
+        }
+    }
+    assert(live_count == 0);
+}
+
+/*
+ * (gg-objectp OBJECT)
+ */
+emacs_value
+Fgg_objectp (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    return handle_p(env, args[0]) ? Qt : Qnil;
+}
+
+/*
+ * (gg--object-class OBJECT)
+ *
+ * Return the class name symbol of a Java object.
+ */
+emacs_value
+Fgg_object_class (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    return handle_class_symbol(env, args[0]);
+}
+
+/*
+ * (gg--drain-releases &optional MAX)
+ *
+ * Release the global refs of (at most MAX) collected handles. Returns
+ * the number released.
+ */
+emacs_value
+Fgg_drain_releases (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    size_t max = SIZE_MAX;
+    if (nargs > 0 && env->is_not_nil(env, args[0])) {
+        max = env->extract_integer(env, args[0]);
+    }
+    if (!g_jni) {
+        return env->make_integer(env, 0);
+    }
+    return env->make_integer(env, handle_drain_releases(max));
+}
+
+/*
+ * (gg--pending-releases)
+ */
+emacs_value
+Fgg_pending_releases (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    return env->make_integer(env, handle_pending_releases());
+}
+
+/*
+ * (gg--set-release-batch-size SIZE)
+ */
+emacs_value
+Fgg_set_release_batch_size (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    intmax_t size = env->extract_integer(env, args[0]);
+    if (env->non_local_exit_check(env) != emacs_funcall_exit_return) {
+        return NULL;
+    }
+    if (size < 1) {
+        env->non_local_exit_signal(env, Qargs_out_of_range, list(env, 1, args[0]));
+        return NULL;
+    }
+    g_release_batch_size = size;
+    return args[0];
+}
+
+/*
+ * (gg--handle-count)
+ */
+emacs_value
+Fgg_handle_count (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    return env->make_integer(env, live_count);
+}
@@ -0,0 +1,86 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Handle table for Java objects referenced from Lisp (c.f. "Lisp
+ * Representation of Java Objects" in internals.org)
+ */
+
+#include <emacs-module.h>
+
+#include <jni.h>
+
+emacs_value Fgg_objectp (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_object_class (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_drain_releases (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_pending_releases (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_set_release_batch_size (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_handle_count (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+
+/*
+ * Wrap a global ref (owned by the table from here on) in a new
+ * handle. `class_symbol' is cached in the slot if non-NULL, it must
+ * then be a global ref that outlives the handle.
+ */
+emacs_value handle_new(emacs_env *env, jobject global_ref, emacs_value class_symbol);
+
+/*
+ * Return the object referenced by a handle. Returns NULL with a
+ * pending signal if the value isn't a live handle.
+ */
+jobject handle_get(emacs_env *env, emacs_value value);
+
+/*
+ * Return the class name symbol of a handle's object (NULL with a
+ * pending signal on failure)
+ */
+emacs_value handle_class_symbol(emacs_env *env, emacs_value value);
+
+/*
+ * Is the value a live handle?
+ */
+int handle_p(emacs_env *env, emacs_value value);
+
+/*
+ * Number of handles drained per module entry
+ * (c.f. `gg-release-batch-size')
+ */
+extern size_t g_release_batch_size;
+
+/*
+ * Delete the global refs of up to `max' handles collected by Emacs
+ * GC. Needs a JNI env. Returns the number released.
+ */
+size_t handle_drain_releases(size_t max);
+
+/*
+ * Number of collected handles whose global refs are still held
+ */
+size_t handle_pending_releases();
+
+/*
+ * Invalidate all handles (when the VM is stopped). Their global refs
+ * die with the VM, existing Lisp values become stale.
+ */
+void handle_release_all();
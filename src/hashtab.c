@@ -0,0 +1,223 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashtab.h"
+
+#define INITIAL_BUCKETS 64
+
+struct hashtab_entry {
+    const void *key;
+    void *value;
+    size_t hash;
+    struct hashtab_entry *next;
+};
+
+struct hashtab {
+    enum hashtab_key_type key_type;
+    struct hashtab_entry **buckets;
+    size_t bucket_count; /* always a power of two */
+    size_t count;
+};
+
+static size_t hash_key(struct hashtab *table, const void *key)
+{
+    size_t h;
+    const unsigned char *s;
+    if (table->key_type == HASHTAB_STRING_KEYS) {
+        /* FNV-1a */
+        h = (size_t) 14695981039346656037ULL;
+        for (s = key; *s; ++s) {
+            h ^= *s;
+            h *= (size_t) 1099511628211ULL;
+        }
+    } else {
+        h = (size_t) (uintptr_t) key;
+        h ^= h >> 33;
+        h *= (size_t) 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+    }
+    return h;
+}
+
+static int keys_equal(struct hashtab *table, const void *a, const void *b)
+{
+    if (table->key_type == HASHTAB_STRING_KEYS) {
+        return strcmp(a, b) == 0;
+    }
+    return a == b;
+}
+
+struct hashtab *hashtab_new(enum hashtab_key_type key_type)
+{
+    struct hashtab *table = malloc(sizeof(struct hashtab));
+    assert(table);
+    table->key_type = key_type;
+    table->bucket_count = INITIAL_BUCKETS;
+    table->buckets = calloc(table->bucket_count, sizeof(struct hashtab_entry *));
+    assert(table->buckets);
+    table->count = 0;
+    return table;
+}
+
+static void grow(struct hashtab *table)
+{
+    size_t i, new_count = table->bucket_count * 2;
+    struct hashtab_entry **new_buckets;
+    struct hashtab_entry *e, *next;
+
+    new_buckets = calloc(new_count, sizeof(struct hashtab_entry *));
+    assert(new_buckets);
+    for (i = 0; i < table->bucket_count; ++i) {
+        for (e = table->buckets[i]; e; e = next) {
+            next = e->next;
+            e->next = new_buckets[e->hash & (new_count - 1)];
+            new_buckets[e->hash & (new_count - 1)] = e;
+        }
+    }
+    free(table->buckets);
+    table->buckets = new_buckets;
+    table->bucket_count = new_count;
+}
+
+static struct hashtab_entry **find(struct hashtab *table, const void *key, size_t hash)
+{
+    struct hashtab_entry **e = &table->buckets[hash & (table->bucket_count - 1)];
+    for (; *e; e = &(*e)->next) {
+        if ((*e)->hash == hash && keys_equal(table, (*e)->key, key)) {
+            break;
+        }
+    }
+    return e;
+}
+
+void *hashtab_get(struct hashtab *table, const void *key)
+{
+    struct hashtab_entry *e = *find(table, key, hash_key(table, key));
+    return e ? e->value : NULL;
+}
+
+/*
+ * Insert or replace. The previous value (if any) is NOT freed.
+ */
+void hashtab_put(struct hashtab *table, const void *key, void *value)
+{
+    size_t hash = hash_key(table, key);
+    struct hashtab_entry **slot = find(table, key, hash);
+    struct hashtab_entry *e;
+
+    if (*slot) {
+        (*slot)->value = value;
+        return;
+    }
+
+    e = malloc(sizeof(struct hashtab_entry));
+    assert(e);
+    e->key = table->key_type == HASHTAB_STRING_KEYS ? strdup(key) : key;
+    assert(e->key);
+    e->value = value;
+    e->hash = hash;
+    e->next = NULL;
+    *slot = e;
+
+    if (++table->count > table->bucket_count - table->bucket_count / 4) {
+        grow(table);
+    }
+}
+
+/*
+ * Remove the entry for `key' and return its value (or NULL if absent)
+ */
+void *hashtab_remove(struct hashtab *table, const void *key)
+{
+    struct hashtab_entry **slot = find(table, key, hash_key(table, key));
+    struct hashtab_entry *e = *slot;
+    void *value;
+
+    if (!e) {
+        return NULL;
+    }
+    *slot = e->next;
+    value = e->value;
+    if (table->key_type == HASHTAB_STRING_KEYS) {
+        free((void *) e->key);
+    }
+    free(e);
+    table->count--;
+    return value;
+}
+
+void hashtab_clear(struct hashtab *table, void (*free_value)(void *value))
+{
+    size_t i;
+    struct hashtab_entry *e, *next;
+
+    for (i = 0; i < table->bucket_count; ++i) {
+        for (e = table->buckets[i]; e; e = next) {
+            next = e->next;
+            if (free_value) {
+                free_value(e->value);
+            }
+            if (table->key_type == HASHTAB_STRING_KEYS) {
+                free((void *) e->key);
+            }
+            free(e);
+        }
+        table->buckets[i] = NULL;
+    }
+    table->count = 0;
+}
+
+void hashtab_free(struct hashtab *table, void (*free_value)(void *value))
+{
+    hashtab_clear(table, free_value);
+    free(table->buckets);
+    free(table);
+}
+
+size_t hashtab_count(struct hashtab *table)
+{
+    return table->count;
+}
+
+/*
+ * Call `fn' for every entry. `fn' must not modify the table.
+ */
+void hashtab_foreach(struct hashtab *table,
+                     void (*fn)(const void *key, void *value, void *data),
+                     void *data)
+{
+    size_t i;
+    struct hashtab_entry *e;
+
+    for (i = 0; i < table->bucket_count; ++i) {
+        for (e = table->buckets[i]; e; e = e->next) {
+            fn(e->key, e->value, data);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Minimal chained hash table used by the various native caches.
+ *
+ * Keys are either NUL-terminated strings (copied into the table) or
+ * opaque pointers (compared by identity, e.g. jmethodID).
+ */
+
+#include <stddef.h>
+
+enum hashtab_key_type {
+    HASHTAB_STRING_KEYS,
+    HASHTAB_POINTER_KEYS
+};
+
+struct hashtab;
+
+struct hashtab *hashtab_new(enum hashtab_key_type key_type);
+void hashtab_free(struct hashtab *table, void (*free_value)(void *value));
+void *hashtab_get(struct hashtab *table, const void *key);
+void hashtab_put(struct hashtab *table, const void *key, void *value);
+void *hashtab_remove(struct hashtab *table, const void *key);
+void hashtab_clear(struct hashtab *table, void (*free_value)(void *value));
+size_t hashtab_count(struct hashtab *table);
+void hashtab_foreach(struct hashtab *table,
+                     void (*fn)(const void *key, void *value, void *data),
+                     void *data);
@@ -0,0 +1,261 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <emacs-module.h>
+#include <jni.h>
+
+#include "ctrl.h"
+#include "el_util.h"
+#include "interrupt.h"
+#include "pool.h"
+
+/*
+ * How often the Emacs thread checks for quit while waiting
+ */
+#define POLL_MS 10
+
+/*
+ * A thread making calls for the Emacs thread. When a call is given up
+ * on, its helper is abandoned: it's interrupted, finishes the call on
+ * its own and exits. The next call starts a new helper.
+ */
+struct helper {
+    pthread_t thread;
+    jobject java_thread;        /* global ref */
+    struct job *job;            /* set by Emacs, taken by the helper */
+    int done;
+    int abandoned;
+    int stop;
+};
+
+/* the helper for the next call, NULL if there is none */
+static struct helper *helper;
+static pthread_mutex_t helper_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t helper_cond = PTHREAD_COND_INITIALIZER;
+
+static void *helper_main(void *data)
+{
+    struct helper *h = data;
+    struct job *job = NULL;
+    JNIEnv *jni;
+    jobject thread;
+    int abandoned;
+
+    if ((*g_vm)->AttachCurrentThreadAsDaemon(g_vm, (void **) &jni, NULL) != JNI_OK) {
+        pthread_mutex_lock(&helper_lock);
+        h->stop = 1;
+        pthread_cond_broadcast(&helper_cond);
+        pthread_mutex_unlock(&helper_lock);
+        return NULL;
+    }
+    thread = (*jni)->CallStaticObjectMethod(jni, g_java_lang_Thread, g_mid_Thread_currentThread);
+
+    pthread_mutex_lock(&helper_lock);
+    h->java_thread = (*jni)->NewGlobalRef(jni, thread);
+    (*jni)->DeleteLocalRef(jni, thread);
+    pthread_cond_broadcast(&helper_cond);
+    for (;;) {
+        while (!h->job && !h->stop) {
+            pthread_cond_wait(&helper_cond, &helper_lock);
+        }
+        if (h->stop) {
+            break;
+        }
+        job = h->job;
+        h->job = NULL;
+        pthread_mutex_unlock(&helper_lock);
+
+        job_run(jni, job);
+
+        pthread_mutex_lock(&helper_lock);
+        h->done = 1;
+        pthread_cond_broadcast(&helper_cond);
+        if (h->abandoned) {
+            break;
+        }
+    }
+    abandoned = h->abandoned;
+    pthread_mutex_unlock(&helper_lock);
+
+    /* nobody is waiting for us any more */
+    if (abandoned) {
+        job_free(jni, job);
+        (*jni)->DeleteGlobalRef(jni, h->java_thread);
+        free(h);
+    }
+    (*g_vm)->DetachCurrentThread(g_vm);
+    return NULL;
+}
+
+/*
+ * Start a helper and wait for it to attach. Called with `helper_lock'
+ * held.
+ */
+static struct helper *start_helper()
+{
+    struct helper *h = calloc(1, sizeof(struct helper));
+    assert(h);
+    if (pthread_create(&h->thread, NULL, helper_main, h) != 0) {
+        free(h);
+        return NULL;
+    }
+    while (!h->java_thread && !h->stop) {
+        pthread_cond_wait(&helper_cond, &helper_lock);
+    }
+    if (!h->java_thread) {
+        pthread_join(h->thread, NULL);
+        free(h);
+        return NULL;
+    }
+    return h;
+}
+
+void interrupt_stop()
+{
+    struct helper *h;
+
+    pthread_mutex_lock(&helper_lock);
+    h = helper;
+    helper = NULL;
+    if (h) {
+        h->stop = 1;
+        pthread_cond_broadcast(&helper_cond);
+    }
+    pthread_mutex_unlock(&helper_lock);
+    if (h) {
+        pthread_join(h->thread, NULL);
+        (*g_jni)->DeleteGlobalRef(g_jni, h->java_thread);
+        free(h);
+    }
+}
+
+static void add_ms(struct timespec *t, long ms)
+{
+    t->tv_sec += ms / 1000;
+    t->tv_nsec += (ms % 1000) * 1000000;
+    if (t->tv_nsec >= 1000000000) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000;
+    }
+}
+
+static int before(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/*
+ * (gg--call-method-interruptible-raw TARGET METHOD-ID ARGS &optional NONVIRTUAL TIMEOUT)
+ *
+ * Like `gg--call-method-raw', but the call is made on a helper thread
+ * while Emacs waits. If Emacs is quit (C-g) or TIMEOUT seconds pass,
+ * the Java thread is interrupted and `quit' or `java-timeout' is
+ * signaled.
+ */
+emacs_value
+Fgg_call_method_interruptible_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    struct job *job;
+    struct helper *h;
+    struct timespec deadline, wake;
+    int has_deadline = 0;
+    emacs_value reason = NULL;
+    emacs_value result;
+    double timeout;
+
+    ASSERT_JVM_RUNNING(env);
+
+    if (nargs > 4 && env->is_not_nil(env, args[4])) {
+        timeout = env->eq(env, env->type_of(env, args[4]), Qinteger) ?
+            env->extract_integer(env, args[4]) : env->extract_float(env, args[4]);
+        if (env->non_local_exit_check(env) != emacs_funcall_exit_return) {
+            return NULL;
+        }
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        add_ms(&deadline, (long) (timeout * 1000));
+        has_deadline = 1;
+    }
+
+    job = job_new(env, nargs > 4 ? 4 : nargs, args);
+    if (!job) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&helper_lock);
+    if (!helper) {
+        helper = start_helper();
+    }
+    h = helper;
+    if (!h) {
+        pthread_mutex_unlock(&helper_lock);
+        job_free(g_jni, job);
+        env->non_local_exit_signal(env, Qerror,
+                                   list(env, 1, env->make_string(env, "Can't start the call thread", 27)));
+        return NULL;
+    }
+    h->job = job;
+    h->done = 0;
+    pthread_cond_broadcast(&helper_cond);
+
+    while (!h->done) {
+        clock_gettime(CLOCK_REALTIME, &wake);
+        if (has_deadline && !before(&wake, &deadline)) {
+            reason = Qjava_timeout;
+            break;
+        }
+        /* `should_quit' is new in Emacs 26 */
+        if (env->size >= sizeof(struct emacs_env_26) && env->should_quit(env)) {
+            reason = Qquit;
+            break;
+        }
+        add_ms(&wake, POLL_MS);
+        if (has_deadline && before(&deadline, &wake)) {
+            wake = deadline;
+        }
+        pthread_cond_timedwait(&helper_cond, &helper_lock, &wake);
+    }
+
+    if (!h->done) {
+        /* the helper can't exit before we let go of the lock */
+        (*g_jni)->CallVoidMethod(g_jni, h->java_thread, g_mid_Thread_interrupt);
+        (*g_jni)->ExceptionClear(g_jni);
+        h->abandoned = 1;
+        pthread_detach(h->thread);
+        helper = NULL;
+        pthread_mutex_unlock(&helper_lock);
+        env->non_local_exit_signal(env, reason,
+                                   reason == Qjava_timeout ? list(env, 1, args[4]) : Qnil);
+        return NULL;
+    }
+    pthread_mutex_unlock(&helper_lock);
+
+    result = job_result(env, job);
+    job_free(g_jni, job);
+    return result;
+}
@@ -0,0 +1,461 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <emacs-module.h>
+
+#include "el_util.h"
+#include "jar_index.h"
+
+#define MAX_QUERY_SIZE 1024
+
+/*
+ * Class names are binary names (java.util.Map$Entry) stored
+ * NUL-terminated in one pool. `names' holds their offsets and the jar
+ * they're from (an index into `jars'), sorted by name (and without
+ * duplicates, the first jar added wins) when `sorted' is set.
+ */
+struct name {
+    uint32_t offset;
+    uint32_t jar;
+};
+
+static char *pool;
+static size_t pool_size;
+static size_t pool_capacity;
+static char **jars;
+static size_t jar_count;
+static struct name *names;
+static size_t name_count;
+static size_t name_capacity;
+static int sorted = 1;
+
+#define NAME(i) (pool + names[i].offset)
+
+/* zip record signatures and sizes */
+#define EOCD_SIGNATURE 0x06054b50
+#define EOCD_SIZE 22
+#define ZIP64_LOCATOR_SIGNATURE 0x07064b50
+#define ZIP64_LOCATOR_SIZE 20
+#define ZIP64_EOCD_SIGNATURE 0x06064b50
+#define ZIP64_EOCD_SIZE 56
+#define CENTRAL_SIGNATURE 0x02014b50
+#define CENTRAL_SIZE 46
+
+static uint16_t u16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t u32(const unsigned char *p)
+{
+    return (uint32_t) u16(p) | ((uint32_t) u16(p + 2) << 16);
+}
+
+static uint64_t u64(const unsigned char *p)
+{
+    return (uint64_t) u32(p) | ((uint64_t) u32(p + 4) << 32);
+}
+
+static void add_name(const char *entry, size_t length)
+{
+    size_t i;
+
+    if (pool_size + length + 1 > pool_capacity) {
+        pool_capacity = pool_capacity ? pool_capacity * 2 : 1 << 16;
+        while (pool_size + length + 1 > pool_capacity) {
+            pool_capacity *= 2;
+        }
+        pool = realloc(pool, pool_capacity);
+        assert(pool);
+    }
+    if (name_count == name_capacity) {
+        name_capacity = name_capacity ? name_capacity * 2 : 4096;
+        names = realloc(names, sizeof(struct name) * name_capacity);
+        assert(names);
+    }
+    names[name_count].offset = pool_size;
+    names[name_count++].jar = jar_count - 1;
+    for (i = 0; i < length; ++i) {
+        pool[pool_size++] = entry[i] == '/' ? '.' : entry[i];
+    }
+    pool[pool_size++] = 0;
+    sorted = 0;
+}
+
+/*
+ * Add a central directory entry if it's a class. Entries of
+ * multi-release jars (META-INF/versions/N/...) are added under the
+ * class name, module-info and package-info are skipped.
+ *
+ * @return 1 if a class was added
+ */
+static int add_entry(const char *entry, size_t length)
+{
+    static const char versions[] = "META-INF/versions/";
+    const char *simple_name;
+    size_t prefix = sizeof(versions) - 1;
+    size_t i;
+
+    if (length < 7 || memcmp(entry + length - 6, ".class", 6)) {
+        return 0;
+    }
+    length -= 6;
+    if (length > prefix && !memcmp(entry, versions, prefix)) {
+        for (i = prefix; i < length && entry[i] != '/'; ++i);
+        if (i == length) {
+            return 0;
+        }
+        entry += i + 1;
+        length -= i + 1;
+    }
+    simple_name = entry;
+    for (i = 0; i < length; ++i) {
+        if (entry[i] == '/') {
+            simple_name = entry + i + 1;
+        }
+    }
+    if (!strncmp(simple_name, "module-info", 11) || !strncmp(simple_name, "package-info", 12) ||
+        simple_name == entry + length) {
+        return 0;
+    }
+    add_name(entry, length);
+    return 1;
+}
+
+/*
+ * Find the central directory of the zip file mapped at `zip'. Data
+ * prepended to the zip (e.g. a launcher script) shifts the offsets
+ * recorded in it, this is corrected for.
+ *
+ * @return 0 for OK or -1 if it's not a zip file
+ */
+static int find_central_directory(const unsigned char *zip, size_t size,
+                                  uint64_t *offset, uint64_t *length, uint64_t *count)
+{
+    const unsigned char *eocd = NULL;
+    const unsigned char *record;
+    size_t min, pos;
+    uint64_t eocd_pos;
+
+    if (size < EOCD_SIZE) {
+        return -1;
+    }
+    /* the EOCD is followed by a comment of up to 64k */
+    min = size > EOCD_SIZE + 0xffff ? size - EOCD_SIZE - 0xffff : 0;
+    for (pos = size - EOCD_SIZE + 1; pos-- > min; ) {
+        if (u32(zip + pos) == EOCD_SIGNATURE) {
+            eocd = zip + pos;
+            break;
+        }
+    }
+    if (!eocd) {
+        return -1;
+    }
+    eocd_pos = eocd - zip;
+    *count = u16(eocd + 10);
+    *length = u32(eocd + 12);
+    *offset = u32(eocd + 16);
+
+    if ((*count == 0xffff || *length == 0xffffffff || *offset == 0xffffffff) &&
+        eocd_pos >= ZIP64_LOCATOR_SIZE &&
+        u32(eocd - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR_SIGNATURE) {
+        eocd_pos = u64(eocd - ZIP64_LOCATOR_SIZE + 8);
+        if (size < ZIP64_EOCD_SIZE || eocd_pos > size - ZIP64_EOCD_SIZE) {
+            return -1;
+        }
+        record = zip + eocd_pos;
+        if (u32(record) != ZIP64_EOCD_SIGNATURE) {
+            return -1;
+        }
+        *count = u64(record + 32);
+        *length = u64(record + 40);
+        *offset = u64(record + 48);
+    }
+
+    if (*length > eocd_pos) {
+        return -1;
+    }
+    /* the directory ends where the EOCD (or ZIP64 EOCD) starts. The
+     * recorded offset is off for jars with data prepended and can't be
+     * trusted to stay in the file, so it's always derived. */
+    *offset = eocd_pos - *length;
+    return 0;
+}
+
+long jar_index_add(const char *path)
+{
+    struct stat st;
+    const unsigned char *zip;
+    const unsigned char *entry;
+    const unsigned char *end;
+    uint64_t offset, length, count, i;
+    size_t entry_size;
+    long classes = 0;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        errno = errno ? errno : EINVAL;
+        return -1;
+    }
+    zip = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (zip == MAP_FAILED) {
+        return -1;
+    }
+
+    if (find_central_directory(zip, st.st_size, &offset, &length, &count)) {
+        munmap((void *) zip, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+    jars = realloc(jars, sizeof(char *) * (jar_count + 1));
+    assert(jars);
+    jars[jar_count] = strdup(path);
+    assert(jars[jar_count]);
+    jar_count++;
+
+    entry = zip + offset;
+    end = entry + length;
+    for (i = 0; i < count && entry + CENTRAL_SIZE <= end; ++i) {
+        if (u32(entry) != CENTRAL_SIGNATURE) {
+            break;
+        }
+        entry_size = CENTRAL_SIZE + u16(entry + 28) + u16(entry + 30) + u16(entry + 32);
+        if (entry + entry_size > end) {
+            break;
+        }
+        classes += add_entry((const char *) entry + CENTRAL_SIZE, u16(entry + 28));
+        entry += entry_size;
+    }
+    munmap((void *) zip, st.st_size);
+    return classes;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    const struct name *x = a;
+    const struct name *y = b;
+    int diff = strcmp(pool + x->offset, pool + y->offset);
+
+    if (diff) {
+        return diff;
+    }
+    return x->jar < y->jar ? -1 : x->jar > y->jar;
+}
+
+/*
+ * Sort and drop duplicates (the same class in several jars) before
+ * the first query after adding jars
+ */
+static void ensure_sorted()
+{
+    size_t i, j;
+
+    if (sorted) {
+        return;
+    }
+    qsort(names, name_count, sizeof(struct name), compare_names);
+    for (i = j = 0; i < name_count; ++i) {
+        if (j == 0 || strcmp(NAME(i), NAME(j - 1))) {
+            names[j++] = names[i];
+        }
+    }
+    name_count = j;
+    sorted = 1;
+}
+
+/*
+ * Index of the first name not less than `key'
+ */
+static size_t lower_bound(const char *key)
+{
+    size_t low = 0, high = name_count, mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (strcmp(NAME(mid), key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static int contains(const char *class_name)
+{
+    size_t i = lower_bound(class_name);
+    return i < name_count && !strcmp(NAME(i), class_name);
+}
+
+const char *jar_index_jar(const char *binary_name)
+{
+    size_t i;
+
+    if (!name_count) {
+        return NULL;
+    }
+    ensure_sorted();
+    i = lower_bound(binary_name);
+    if (i < name_count && !strcmp(NAME(i), binary_name)) {
+        return jars[names[i].jar];
+    }
+    return NULL;
+}
+
+int jar_index_resolve(char *class_name)
+{
+    char *dot;
+    size_t length;
+    char *candidate;
+    int found = 0;
+
+    if (!name_count) {
+        return 0;
+    }
+    ensure_sorted();
+
+    length = strlen(class_name);
+    candidate = strdup(class_name);
+    assert(candidate);
+    /* com.x.Y.Z, com.x.Y$Z, com.x$Y$Z, ... */
+    while (!(found = contains(candidate))) {
+        for (dot = candidate + length; dot > candidate && *dot != '.'; --dot);
+        if (dot == candidate) {
+            break;
+        }
+        *dot = '$';
+        length = dot - candidate;
+    }
+    if (found) {
+        strcpy(class_name, candidate);
+    }
+    free(candidate);
+    return found;
+}
+
+/*
+ * (gg--jar-index-add PATH)
+ *
+ * Add the classes of the jar file PATH to the index, returning their
+ * number.
+ */
+emacs_value
+Fgg_jar_index_add (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    char path[PATH_MAX];
+    char err_msg[PATH_MAX + 100];
+    ptrdiff_t size = PATH_MAX;
+    long classes;
+
+    if (!type_is(env, args[0], Qstring) ||
+        !env->copy_string_contents(env, args[0], path, &size)) {
+        return NULL;
+    }
+    errno = 0;
+    classes = jar_index_add(path);
+    if (classes < 0) {
+        snprintf(err_msg, sizeof(err_msg), "Can't index jar %s: %s", path, strerror(errno));
+        env->non_local_exit_signal(env, Qerror, env->make_string(env, err_msg, strlen(err_msg)));
+        return NULL;
+    }
+    return env->make_integer(env, classes);
+}
+
+/*
+ * (gg--jar-index-clear)
+ */
+emacs_value
+Fgg_jar_index_clear (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    size_t i;
+
+    for (i = 0; i < jar_count; ++i) {
+        free(jars[i]);
+    }
+    free(jars);
+    jars = NULL;
+    jar_count = 0;
+    free(pool);
+    free(names);
+    pool = NULL;
+    names = NULL;
+    pool_size = pool_capacity = 0;
+    name_count = name_capacity = 0;
+    sorted = 1;
+    return Qnil;
+}
+
+/*
+ * (gg--jar-index-query &optional PREFIX)
+ *
+ * Return the indexed class names starting with the string PREFIX as a
+ * sorted list of symbols.
+ */
+emacs_value
+Fgg_jar_index_query (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    char prefix[MAX_QUERY_SIZE];
+    ptrdiff_t size = MAX_QUERY_SIZE;
+    size_t prefix_length;
+    size_t first, i;
+    emacs_value result = Qnil;
+    emacs_value cons_args[2];
+
+    prefix[0] = 0;
+    if (nargs > 0 && env->is_not_nil(env, args[0])) {
+        if (!type_is(env, args[0], Qstring) ||
+            !env->copy_string_contents(env, args[0], prefix, &size)) {
+            return NULL;
+        }
+    }
+    ensure_sorted();
+
+    prefix_length = strlen(prefix);
+    first = lower_bound(prefix);
+    for (i = first; i < name_count && !strncmp(NAME(i), prefix, prefix_length); ++i);
+    while (i-- > first) {
+        cons_args[0] = env->intern(env, NAME(i));
+        cons_args[1] = result;
+        result = env->funcall(env, Qcons, 2, cons_args);
+    }
+    return result;
+}
@@ -0,0 +1,57 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Index of the class names in jar files, read from the zip central
+ * directory without loading anything (c.f. `gg-classpath-classes')
+ */
+
+#include <emacs-module.h>
+
+emacs_value Fgg_jar_index_add (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_jar_index_clear (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_jar_index_query (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+
+/*
+ * Add the classes of a jar to the index.
+ *
+ * @return the number of class entries or -1 (with errno set) if the
+ * file isn't a readable zip file
+ */
+long jar_index_add(const char *path);
+
+/*
+ * Resolve (in-place) a class name given with `.' before nested
+ * classes (com.x.Y.Z) to the binary name (com.x.Y$Z) if the index has
+ * it. The name keeps its length.
+ *
+ * @return 1 if the class was found
+ */
+int jar_index_resolve(char *class_name);
+
+/*
+ * The path of the (first added) jar that has the class with the
+ * given binary name or NULL if no jar has it
+ */
+const char *jar_index_jar(const char *binary_name);
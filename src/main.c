@@ -29,9 +29,22 @@
 
 #include <emacs-module.h>
 
+#include "array.h"
+#include "call.h"
 #include "class.h"
+#include "class_cache.h"
+#include "class_index.h"
+#include "class_store.h"
 #include "ctrl.h"
 #include "el_util.h"
+#include "events.h"
+#include "handle.h"
+#include "interrupt.h"
+#include "jar_index.h"
+#include "notify.h"
+#include "pool.h"
+#include "sig.h"
+#include "strconv.h"
 
 /* Emacs won't load the plugin without this: (error "Module /home/jbalint/sw/emacs-gargoyle/gargoyle.so is not GPL compatible") */
 int plugin_is_GPL_compatible;
@@ -68,41 +81,191 @@ int plugin_is_GPL_compatible;
  */
 int vm_started;
 
-static emacs_value
-Fgg_java_start (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+/*
+ * Copy a list of option strings. Returns 0 with a pending signal on
+ * failure, c.f. `free_options'.
+ */
+static int get_options(emacs_env *env, emacs_value list, char ***option_strings, ptrdiff_t *option_count)
+{
+    emacs_value options;
+    emacs_value option;
+    ptrdiff_t size;
+    ptrdiff_t i;
+
+    *option_strings = NULL;
+    *option_count = 0;
+    if (!env->is_not_nil(env, list)) {
+        return 1;
+    }
+
+    options = env->funcall(env, Qvconcat, 1, &list);
+    if (env->non_local_exit_check(env) != emacs_funcall_exit_return) {
+        return 0;
+    }
+    *option_count = env->vec_size(env, options);
+    *option_strings = calloc(*option_count, sizeof(char *));
+    assert(*option_strings);
+    for (i = 0; i < *option_count; ++i) {
+        option = env->vec_get(env, options, i);
+        size = 0;
+        if (!type_is(env, option, Qstring) ||
+            !env->copy_string_contents(env, option, NULL, &size)) {
+            return 0;
+        }
+        (*option_strings)[i] = malloc(size);
+        assert((*option_strings)[i]);
+        env->copy_string_contents(env, option, (*option_strings)[i], &size);
+    }
+    return 1;
+}
+
+static void free_options(char **option_strings, ptrdiff_t option_count)
+{
+    ptrdiff_t i;
+    for (i = 0; i < option_count; ++i) {
+        free(option_strings[i]);
+    }
+    free(option_strings);
+}
+
+/*
+ * Signal an error if the JVM can't be started now
+ */
+static int check_can_start(emacs_env *env)
 {
-    int ret;
     static char errmsg[50];
     if (g_vm) {
         sprintf(errmsg, "JVM already running");
-        env->non_local_exit_signal(env, env->intern(env, "error"),
-                                   env->make_string(env, errmsg, strlen(errmsg)));
+    } else if (ctrl_status() == CTRL_STARTING || ctrl_status() == CTRL_STARTED) {
+        sprintf(errmsg, "JVM is starting");
     } else if (vm_started) {
         sprintf(errmsg, "JVM may not be restarted");
-        env->non_local_exit_signal(env, env->intern(env, "error"),
-                                   env->make_string(env, errmsg, strlen(errmsg)));
+    } else {
+        return 1;
     }
-    ret = ctrl_start_java(NULL);
+    env->non_local_exit_signal(env, Qerror,
+                               env->make_string(env, errmsg, strlen(errmsg)));
+    return 0;
+}
+
+static void signal_start_failed(emacs_env *env, int ret)
+{
+    static char errmsg[50];
+    sprintf(errmsg, "JVM creation failed (%d)", ret);
+    env->non_local_exit_signal(env, Qerror,
+                               env->make_string(env, errmsg, strlen(errmsg)));
+}
+
+static emacs_value
+Fgg_java_start_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    int ret;
+    char **option_strings;
+    ptrdiff_t option_count;
+
+    if (!check_can_start(env)) {
+        return NULL;
+    }
+    if (!get_options(env, nargs > 0 ? args[0] : Qnil, &option_strings, &option_count)) {
+        free_options(option_strings, option_count);
+        return NULL;
+    }
+
+    ret = ctrl_start_java(option_strings, option_count, NULL);
+    free_options(option_strings, option_count);
     if (ret) {
-        sprintf(errmsg, "JVM created failed (%d)", ret);
-        env->non_local_exit_signal(env, env->intern(env, "error"),
-                                   env->make_string(env, errmsg, strlen(errmsg)));
+        signal_start_failed(env, ret);
+        return NULL;
     }
     vm_started = 1;
-    return env->intern (env, "t");
+    return Qt;
+}
+
+static emacs_value
+Fgg_java_start_async_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    int ret;
+    char **option_strings;
+    ptrdiff_t option_count;
+
+    if (!check_can_start(env)) {
+        return NULL;
+    }
+    if (!get_options(env, nargs > 0 ? args[0] : Qnil, &option_strings, &option_count)) {
+        free_options(option_strings, option_count);
+        return NULL;
+    }
+
+    ret = ctrl_start_java_async(option_strings, option_count);
+    free_options(option_strings, option_count);
+    if (ret) {
+        signal_start_failed(env, ret);
+        return NULL;
+    }
+    vm_started = 1;
+    return Qt;
+}
+
+/*
+ * Attach to a VM started by `gg--java-start-async-raw' if it's ready
+ */
+static emacs_value
+Fgg_java_finish_start (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    int error;
+    switch (ctrl_finish_start(0, &error)) {
+    case CTRL_RUNNING:
+        return Qt;
+    case CTRL_FAILED:
+        signal_start_failed(env, error);
+        return NULL;
+    default:
+        /* still starting or never started */
+        return jvm_running(env) ? Qt : NULL;
+    }
+}
+
+static emacs_value
+Fgg_java_status (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    switch (ctrl_status()) {
+    case CTRL_STARTING:
+    case CTRL_STARTED:
+        return Qstarting;
+    case CTRL_FAILED:
+        return Qfailed;
+    case CTRL_RUNNING:
+        return Qrunning;
+    default:
+        return Qstopped;
+    }
 }
 
 static emacs_value
 Fgg_java_stop (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
 {
+    /* an async start has to finish before the VM can be destroyed */
+    if (!g_vm && ctrl_finish_start(-1, NULL) != CTRL_RUNNING) {
+        return Qnil;
+    }
+    pool_stop();
+    interrupt_stop();
+    events_stop();
+    class_index_stop();
+    class_cache_flush_all();
+    class_store_stop();
+    call_info_flush_all();
+    sig_flush_all();
+    handle_release_all();
+    clear_class_symbols(env);
     ctrl_stop_java();
-    return env->intern (env, "t");
+    return Qt;
 }
 
 static emacs_value
 Fgg_java_running (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
 {
-    return env->intern (env, g_vm ? "t" : "nil");
+    return g_vm ? Qt : Qnil;
 }
 
 static emacs_value
@@ -110,13 +273,13 @@ Fgg_jni_version (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data
 {
     const char *version;
     if (!g_vm) {
-        return env->intern (env, "nil");
+        return Qnil;
     }
     version = ctrl_jni_version();
     if (version) {
         return env->make_string (env, version, strlen(version));
     } else {
-        return env->intern (env, "nil");
+        return Qnil;
     }
 }
 
@@ -142,6 +305,57 @@ bind_function (emacs_env *env, const char *name, emacs_value Sfun)
     env->funcall (env, Qfset, 2, args);
 }
 
+/*
+ * Entry points that use JNI run inside their own local reference
+ * frame. The Emacs thread never returns to Java, so without this any
+ * local ref not explicitly deleted would live for the rest of the
+ * session.
+ */
+struct jni_function {
+    emacs_value (*function)(emacs_env *, ptrdiff_t, emacs_value[], void *);
+    /* local refs the function may hold at once (a hint to the VM) */
+    jint frame_capacity;
+};
+
+static emacs_value
+local_frame_trampoline (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    struct jni_function *f = data;
+    emacs_value result;
+
+    /* finish an async start, waiting a little if it's still going */
+    if (!g_jni && ctrl_status() != CTRL_STOPPED) {
+        ctrl_finish_start(CTRL_STARTUP_WAIT_MS, NULL);
+    }
+    /* no VM, the function will signal (c.f. `ASSERT_JVM_RUNNING') */
+    if (!g_jni) {
+        return f->function(env, nargs, args, NULL);
+    }
+    /* release refs of handles collected since the last call */
+    handle_drain_releases(g_release_batch_size);
+    if ((*g_jni)->PushLocalFrame(g_jni, f->frame_capacity) < 0) {
+        handle_exception(env);
+        return NULL;
+    }
+    result = f->function(env, nargs, args, NULL);
+    (*g_jni)->PopLocalFrame(g_jni, NULL);
+    return result;
+}
+
+/* Like `make_function' but run FUNCTION in a local frame of the given capacity */
+static emacs_value
+make_jni_function (emacs_env *env, ptrdiff_t min_arity, ptrdiff_t max_arity,
+                   emacs_value (*function)(emacs_env *, ptrdiff_t, emacs_value[], void *),
+                   const char *documentation, jint frame_capacity)
+{
+    /* lives as long as the function object, i.e. forever */
+    struct jni_function *f = malloc(sizeof(struct jni_function));
+    assert(f);
+    f->function = function;
+    f->frame_capacity = frame_capacity;
+    return env->make_function(env, min_arity, max_arity, local_frame_trampoline, documentation, f);
+}
+
 /*****************************/
 /* Stuff to be moved out of here once organization is clearer */
 
@@ -154,13 +368,12 @@ Fgg_new_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
     jmethodID mid;
     jobject obj;
 
-    if (!type_is(env, args[0], "user-ptr")) {
-        return NULL;
-    }
-
     ASSERT_JVM_RUNNING(env);
 
-    class = env->get_user_ptr(env, args[0]);
+    class = handle_get(env, args[0]);
+    if (!class) {
+        return NULL;
+    }
 
     mid = (*g_jni)->GetMethodID(g_jni, class, "<init>", "()V");
     if (handle_exception(env)) { return NULL; }
@@ -175,60 +388,97 @@ static emacs_value
 Fgg_new_string (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
 {
     jstring str;
-    char *raw_str;
-    ptrdiff_t str_size;
+    emacs_value wrapped;
+
+    if (!type_is(env, args[0], Qstring)) {
+        return NULL;
+    }
 
     ASSERT_JVM_RUNNING(env);
 
-    env->copy_string_contents(env, args[0], NULL, &str_size);
-    raw_str = malloc(str_size);
-    assert(raw_str);
-    env->copy_string_contents(env, args[0], raw_str, &str_size);
-    str = (*g_jni)->NewStringUTF(g_jni, raw_str);
-    free(raw_str); /* necessary whether there's an error or not */
-    if (handle_exception(env)) { return NULL; }
-    return new_java_object(env, str, NULL);
+    str = lisp_to_jstring(env, args[0]);
+    if (!str) { return NULL; }
+    wrapped = new_java_object(env, str, NULL);
+    (*g_jni)->DeleteLocalRef(g_jni, str);
+    return wrapped;
 }
 
 static emacs_value
 Fgg_toString_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
 {
-    jclass c;
-    jmethodID mid_toString;
     jstring asString;
     jobject tgt;
     emacs_value e_string;
-    const char *string;
-    jboolean isCopy;
 
-    if (!type_is(env, args[0], "user-ptr")) {
+    ASSERT_JVM_RUNNING(env);
+
+    /* call toString */
+    tgt = handle_get(env, args[0]);
+    if (!tgt) {
         return NULL;
     }
+    asString = (*g_jni)->CallObjectMethod(g_jni, tgt, g_mid_Object_toString);
+    if (handle_exception(env)) { return NULL; }
+    if (!asString) { return Qnil; }
+
+    /* copy the string from Java to Lisp */
+    e_string = jstring_to_lisp(env, asString);
+    (*g_jni)->DeleteLocalRef(g_jni, asString);
+
+    return e_string;
+}
+
+static emacs_value
+Fgg_get_stack_trace_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    static const char *errmsg = "Expected throwable:";
+    jobject throwable;
+    jobjectArray trace;
+    jobject element;
+    jstring string;
+    jsize length, i;
+    emacs_value *strings;
+    emacs_value result = NULL;
 
     ASSERT_JVM_RUNNING(env);
 
-    /* get the method reference */
-    c = (*g_jni)->FindClass(g_jni, "java/lang/Object");
-    if (handle_exception(env)) { return NULL; }
-    assert(c);
-    mid_toString = (*g_jni)->GetMethodID(g_jni, c, "toString", "()Ljava/lang/String;");
-    if (handle_exception(env)) { return NULL; }
-    assert(mid_toString);
+    throwable = handle_get(env, args[0]);
+    if (!throwable) {
+        return NULL;
+    }
+    if (!(*g_jni)->IsInstanceOf(g_jni, throwable, g_java_lang_Throwable)) {
+        env->non_local_exit_signal(env, Qwrong_type_argument,
+                                   list(env, 2, env->make_string(env, errmsg, strlen(errmsg)), args[0]));
+        return NULL;
+    }
 
-    /* call toString */
-    tgt = env->get_user_ptr(env, args[0]);
-    asString = (*g_jni)->CallObjectMethod(g_jni, tgt, mid_toString);
+    trace = (*g_jni)->CallObjectMethod(g_jni, throwable, g_mid_Throwable_getStackTrace);
     if (handle_exception(env)) { return NULL; }
 
-    /* copy the string from Java to Lisp */
-    string = (*g_jni)->GetStringUTFChars(g_jni, asString, &isCopy);
-    if (handle_exception(env)) { return NULL; }
-    assert(string);
-    e_string = env->make_string(env, string, strlen(string));
-    assert(e_string);
-    (*g_jni)->ReleaseStringUTFChars(g_jni, asString, string);
+    length = (*g_jni)->GetArrayLength(g_jni, trace);
+    strings = malloc(sizeof(emacs_value) * (length ? length : 1));
+    assert(strings);
+    for (i = 0; i < length; ++i) {
+        element = (*g_jni)->GetObjectArrayElement(g_jni, trace, i);
+        string = (*g_jni)->CallObjectMethod(g_jni, element, g_mid_Object_toString);
+        (*g_jni)->DeleteLocalRef(g_jni, element);
+        if (handle_exception(env)) { goto done; }
+        strings[i] = jstring_to_lisp(env, string);
+        (*g_jni)->DeleteLocalRef(g_jni, string);
+        if (!strings[i]) { goto done; }
+    }
+    result = env->funcall(env, Qlist, length, strings);
 
-    return e_string;
+done:
+    free(strings);
+    return result;
+}
+
+static emacs_value
+Fgg_set_print_exceptions (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    g_print_exceptions = env->is_not_nil(env, args[0]);
+    return args[0];
 }
 
 /*****************************/
@@ -239,20 +489,78 @@ emacs_module_init(struct emacs_runtime *ert)
 {
     emacs_env *env = ert->get_environment(ert);
 
-    bind_function(env, "gg-java-start", env->make_function(env, 0, 0, Fgg_java_start, "Start the JVM", NULL));
+    init_symbols(env);
+
+    bind_function(env, "gg--java-start-raw", env->make_function(env, 0, 1, Fgg_java_start_raw, "Start the JVM with the given list of options", NULL));
+    bind_function(env, "gg--java-start-async-raw", env->make_function(env, 0, 1, Fgg_java_start_async_raw, "Start creating the JVM with the given list of options on a background thread", NULL));
+    bind_function(env, "gg--java-finish-start", env->make_function(env, 0, 0, Fgg_java_finish_start, "Attach to the JVM once an async start is done", NULL));
+    bind_function(env, "gg-java-status", env->make_function(env, 0, 0, Fgg_java_status, "Return the JVM state: stopped, starting, running or failed", NULL));
     bind_function(env, "gg-java-stop", env->make_function(env, 0, 0, Fgg_java_stop, "Stop the JVM", NULL));
     bind_function(env, "gg-java-running", env->make_function(env, 0, 0, Fgg_java_running, "Is the JVM running?", NULL));
     bind_function(env, "gg-jni-version", env->make_function(env, 0, 0, Fgg_jni_version, "JNI version", NULL));
 
-    bind_function(env, "gg--toString-raw", env->make_function(env, 1, 1, Fgg_toString_raw, "Return a string representation of the raw/userptr object", NULL));
-    bind_function(env, "gg--new-raw", env->make_function(env, 1, 1, Fgg_new_raw, "Create a new instance of the given class", NULL));
-    bind_function(env, "gg-new-string", env->make_function(env, 1, 1, Fgg_new_string, "Create a new java.lang.String from the Lisp string", NULL));
+    bind_function(env, "gg--toString-raw", make_jni_function(env, 1, 1, Fgg_toString_raw, "Return a string representation of the raw/userptr object", 16));
+    bind_function(env, "gg--new-raw", make_jni_function(env, 1, 1, Fgg_new_raw, "Create a new instance of the given class", 16));
+    bind_function(env, "gg--get-stack-trace-raw", make_jni_function(env, 1, 1, Fgg_get_stack_trace_raw, "Return the stack trace of a throwable as a list of strings", 16));
+    bind_function(env, "gg--set-print-exceptions", env->make_function(env, 1, 1, Fgg_set_print_exceptions, "Enable/disable printing Java exceptions to stderr", NULL));
+    bind_function(env, "gg-new-string", make_jni_function(env, 1, 1, Fgg_new_string, "Create a new java.lang.String from the Lisp string", 16));
+
+    /* from handle.c */
+    bind_function(env, "gg-objectp", env->make_function(env, 1, 1, Fgg_objectp, "Return t if the value is a Java object", NULL));
+    bind_function(env, "gg--object-class", make_jni_function(env, 1, 1, Fgg_object_class, "Return the class name symbol of a Java object", 16));
+    bind_function(env, "gg--drain-releases", env->make_function(env, 0, 1, Fgg_drain_releases, "Release the global refs of (at most MAX) collected Java objects", NULL));
+    bind_function(env, "gg--pending-releases", env->make_function(env, 0, 0, Fgg_pending_releases, "Return the number of collected Java objects not yet released", NULL));
+    bind_function(env, "gg--set-release-batch-size", env->make_function(env, 1, 1, Fgg_set_release_batch_size, "Set the number of collected Java objects released per module call", NULL));
+    bind_function(env, "gg--handle-count", env->make_function(env, 0, 0, Fgg_handle_count, "Return the number of Java objects referenced from Lisp", NULL));
+
+    /* from array.c */
+    bind_function(env, "gg--array-to-vector-raw", make_jni_function(env, 1, 3, Fgg_array_to_vector_raw, "Copy (a range of) a raw primitive array to a vector", 16));
+    bind_function(env, "gg--vector-to-array-raw", make_jni_function(env, 2, 4, Fgg_vector_to_array_raw, "Create a primitive array of the given type from (a range of) a vector", 16));
+    bind_function(env, "gg--byte-array-to-string-raw", make_jni_function(env, 1, 3, Fgg_byte_array_to_string_raw, "Copy (a range of) a raw byte array to a unibyte string", 16));
+    bind_function(env, "gg--string-to-byte-array-raw", make_jni_function(env, 1, 1, Fgg_string_to_byte_array_raw, "Create a byte array from a string", 16));
+
+    /* from call.c */
+    bind_function(env, "gg--get-method-id-raw", make_jni_function(env, 3, 4, Fgg_get_method_id_raw, "Return the ID of the method with the given name and signature on the raw class", 16));
+    bind_function(env, "gg--call-method-raw", make_jni_function(env, 3, 4, Fgg_call_method_raw, "Call a method given the raw target, method ID and list of typed arguments", 16));
+
+    /* from interrupt.c */
+    bind_function(env, "gg--call-method-interruptible-raw", make_jni_function(env, 3, 5, Fgg_call_method_interruptible_raw, "Like `gg--call-method-raw' but interrupt the call on quit or after TIMEOUT seconds", 16));
+
+    /* from pool.c */
+    bind_function(env, "gg--call-method-async-raw", make_jni_function(env, 3, 4, Fgg_call_method_async_raw, "Like `gg--call-method-raw' but call on a worker thread, returning the call ID", 16));
+    bind_function(env, "gg--collect-completed-raw", make_jni_function(env, 0, 0, Fgg_collect_completed_raw, "Return the completed async calls as a list of (ID t VALUE) or (ID nil ERROR)", 16));
+    bind_function(env, "gg--set-worker-threads", env->make_function(env, 1, 1, Fgg_set_worker_threads, "Set the number of worker threads for async calls", NULL));
+
+    /* from events.c */
+    bind_function(env, "gg--drain-events-raw", make_jni_function(env, 0, 1, Fgg_drain_events_raw, "Return (at most MAX) events posted from Java as a list of (TYPE . DATA)", 16));
+    bind_function(env, "gg-events-dropped", env->make_function(env, 0, 0, Fgg_events_dropped, "Return the number of events from Java dropped because the buffer was full", NULL));
+    bind_function(env, "gg--set-event-capacity", env->make_function(env, 1, 1, Fgg_set_event_capacity, "Set the number of undelivered events from Java that are buffered", NULL));
+
+    /* from class_index.c */
+    bind_function(env, "gg-loaded-classes", env->make_function(env, 0, 1, Fgg_loaded_classes, "Return the names of the loaded classes (starting with PREFIX) as a sorted list of symbols", NULL));
+    bind_function(env, "gg-package-classes", env->make_function(env, 1, 1, Fgg_package_classes, "Return the names of the loaded classes in the package PACKAGE as a sorted list of symbols", NULL));
+    bind_function(env, "gg--class-index-supertypes", env->make_function(env, 1, 1, Fgg_class_index_supertypes, "Return (SUPERCLASS . INTERFACES) of a loaded class name symbol or nil", NULL));
+
+    /* from class_store.c */
+    bind_function(env, "gg--class-store-open", env->make_function(env, 1, 1, Fgg_class_store_open, "Use FILE (or nil for none) as the class metadata cache", NULL));
+    bind_function(env, "gg--class-store-save", env->make_function(env, 0, 0, Fgg_class_store_save, "Write the class metadata cache if classes were added to it", NULL));
+    bind_function(env, "gg--class-store-stats", env->make_function(env, 0, 0, Fgg_class_store_stats, "Return a plist describing the class metadata cache", NULL));
+
+    /* from jar_index.c */
+    bind_function(env, "gg--jar-index-add", env->make_function(env, 1, 1, Fgg_jar_index_add, "Add the classes in the jar file PATH to the class path index", NULL));
+    bind_function(env, "gg--jar-index-clear", env->make_function(env, 0, 0, Fgg_jar_index_clear, "Empty the class path index", NULL));
+    bind_function(env, "gg--jar-index-query", env->make_function(env, 0, 1, Fgg_jar_index_query, "Return the indexed class names starting with PREFIX as a sorted list of symbols", NULL));
+
+    /* from notify.c */
+    bind_function(env, "gg--notify-open", env->make_function(env, 1, 1, Fgg_notify_open, "Use the pipe process for wake-ups from other threads (nil if unsupported)", NULL));
 
     /* from class.c */
-    bind_function(env, "gg--get-superclass-raw", env->make_function(env, 1, 1, Fgg_get_superclass_raw, "Return a Java class's superclass (nil for java.lang.Object)", NULL));
-    bind_function(env, "gg-find-class", env->make_function(env, 1, 1, Fgg_find_class, "Find/load a Java class", NULL));
-    bind_function(env, "gg--get-class-name-raw", env->make_function(env, 1, 1, Fgg_get_class_name_raw, "Return a Java class's name symbol", NULL));
-    bind_function(env, "gg--get-class-struct", env->make_function(env, 1, 1, Fgg_get_class_struct, "Return a Java class' structure", NULL));
+    bind_function(env, "gg--get-superclass-raw", make_jni_function(env, 1, 1, Fgg_get_superclass_raw, "Return a Java class's superclass (nil for java.lang.Object)", 16));
+    bind_function(env, "gg-find-class", make_jni_function(env, 1, 1, Fgg_find_class, "Find/load a Java class", 16));
+    bind_function(env, "gg--get-class-name-raw", make_jni_function(env, 1, 1, Fgg_get_class_name_raw, "Return a Java class's name symbol", 16));
+    bind_function(env, "gg--get-class-struct", make_jni_function(env, 1, 1, Fgg_get_class_struct, "Return a Java class' structure", 32));
+    bind_function(env, "gg--get-class-structs", make_jni_function(env, 1, 2, Fgg_get_class_structs, "Return the structures of the given class(es) and all their supertypes, skipping classes in the optional hash table of loaded classes", 64));
+    bind_function(env, "gg--flush-class-cache", make_jni_function(env, 0, 1, Fgg_flush_class_cache, "Drop a class (or all classes if nil) from the class structure cache", 16));
 
     provide(env, "gargoyle-dm");
 
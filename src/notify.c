@@ -0,0 +1,86 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <emacs-module.h>
+
+#include "el_util.h"
+#include "notify.h"
+
+/*
+ * Write end of the pipe process created in Lisp, -1 if there is none
+ * (before Emacs 28 there's no `open_channel' and Lisp polls instead).
+ */
+static int notify_fd = -1;
+
+/* set while a byte is in the pipe */
+static int notify_pending;
+
+/*
+ * (gg--notify-open PIPE-PROCESS)
+ *
+ * Use PIPE-PROCESS for notifications. Returns nil if this Emacs can't
+ * give us a channel to it.
+ */
+emacs_value
+Fgg_notify_open (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+#if defined(EMACS_MAJOR_VERSION) && EMACS_MAJOR_VERSION >= 28
+    int fd;
+
+    /* the module may be loaded into an older Emacs */
+    if (env->size < sizeof(struct emacs_env_28)) {
+        return Qnil;
+    }
+    fd = env->open_channel(env, args[0]);
+    if (fd < 0) {
+        return NULL;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (notify_fd >= 0) {
+        close(notify_fd);
+    }
+    notify_fd = fd;
+    __atomic_store_n(&notify_pending, 0, __ATOMIC_RELEASE);
+    return Qt;
+#else
+    return Qnil;
+#endif
+}
+
+void notify_post()
+{
+    if (notify_fd >= 0 && !__atomic_exchange_n(&notify_pending, 1, __ATOMIC_ACQ_REL)) {
+        if (write(notify_fd, "!", 1) < 0) {
+            /* the pipe is full, so Lisp has wake-ups pending anyway */
+        }
+    }
+}
+
+void notify_ack()
+{
+    __atomic_store_n(&notify_pending, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,390 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emacs-module.h>
+#include <jni.h>
+
+#include "call.h"
+#include "ctrl.h"
+#include "el_util.h"
+#include "handle.h"
+#include "notify.h"
+#include "pool.h"
+#include "sig.h"
+
+static pthread_t *workers;
+static int worker_count;
+/* workers attached to the VM, and those not done attaching yet */
+static int live_workers;
+static int starting_workers;
+static int pool_size = 4;
+static int shutting_down;
+static intmax_t next_id = 1;
+
+/* queued jobs and completed jobs, FIFO, guarded by `pool_lock' */
+static struct job *queue_head, *queue_tail;
+static struct job *completed_head, *completed_tail;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_available = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t workers_started = PTHREAD_COND_INITIALIZER;
+
+static void release_job_refs(JNIEnv *jni, struct job *job)
+{
+    int i;
+    if (job->target) {
+        (*jni)->DeleteGlobalRef(jni, job->target);
+        job->target = NULL;
+    }
+    for (i = 0; i < job->info->sig->arg_count; ++i) {
+        if (job->info->sig->args[i].kind == 'L' && job->args[i].l) {
+            (*jni)->DeleteGlobalRef(jni, job->args[i].l);
+            job->args[i].l = NULL;
+        }
+    }
+}
+
+void job_free(JNIEnv *jni, struct job *job)
+{
+    release_job_refs(jni, job);
+    if (job->info->sig->returns.kind == 'L' && job->result.l) {
+        (*jni)->DeleteGlobalRef(jni, job->result.l);
+    }
+    if (job->exception) {
+        (*jni)->DeleteGlobalRef(jni, job->exception);
+    }
+    free(job->args);
+    free(job);
+}
+
+void job_run(JNIEnv *jni, struct job *job)
+{
+    jthrowable exception;
+    jobject local;
+
+    call_invoke(jni, job->info, job->method,
+                job->target ? job->target : job->info->declaring_class,
+                job->nonvirtual, job->args, &job->result);
+    exception = (*jni)->ExceptionOccurred(jni);
+    if (exception) {
+        (*jni)->ExceptionClear(jni);
+        job->exception = (*jni)->NewGlobalRef(jni, exception);
+        (*jni)->DeleteLocalRef(jni, exception);
+        job->result.l = NULL;
+    } else if (job->info->sig->returns.kind == 'L' && job->result.l) {
+        local = job->result.l;
+        job->result.l = (*jni)->NewGlobalRef(jni, local);
+        (*jni)->DeleteLocalRef(jni, local);
+    }
+    release_job_refs(jni, job);
+}
+
+struct job *job_new(emacs_env *env, ptrdiff_t nargs, emacs_value args[])
+{
+    struct call call;
+    struct job *job;
+    int i;
+
+    if (!call_prepare(env, nargs, args, &call)) {
+        call_release(&call);
+        return NULL;
+    }
+
+    /* the job holds its own refs, the handles may be collected meanwhile */
+    job = calloc(1, sizeof(struct job));
+    assert(job);
+    job->method = call.method;
+    job->info = call.info;
+    job->nonvirtual = call.nonvirtual;
+    if (!call.info->is_static) {
+        job->target = (*g_jni)->NewGlobalRef(g_jni, call.target);
+    }
+    job->args = malloc(sizeof(jvalue) * (call.info->sig->arg_count ? call.info->sig->arg_count : 1));
+    assert(job->args);
+    memcpy(job->args, call.args, sizeof(jvalue) * call.info->sig->arg_count);
+    for (i = 0; i < call.info->sig->arg_count; ++i) {
+        if (call.info->sig->args[i].kind == 'L' && job->args[i].l) {
+            job->args[i].l = (*g_jni)->NewGlobalRef(g_jni, job->args[i].l);
+        }
+    }
+    call_release(&call);
+    return job;
+}
+
+static emacs_value job_value(emacs_env *env, struct job *job)
+{
+    emacs_value value;
+    if (job->info->sig->returns.kind != 'L') {
+        return call_primitive_to_lisp(env, job->info->sig->returns.kind, job->result);
+    } else if (!job->result.l) {
+        return Qnil;
+    }
+    /* the handle takes over the global ref */
+    value = handle_new(env, job->result.l, NULL);
+    job->result.l = NULL;
+    return value;
+}
+
+static emacs_value job_error(emacs_env *env, struct job *job)
+{
+    emacs_value cons_args[2];
+    emacs_value error;
+
+    /* one frame per exception, there may be any number of them */
+    (*g_jni)->PushLocalFrame(g_jni, 16);
+    cons_args[0] = Qjava_exception;
+    cons_args[1] = exception_data(env, job->exception);
+    error = env->funcall(env, Qcons, 2, cons_args);
+    (*g_jni)->PopLocalFrame(g_jni, NULL);
+    return error;
+}
+
+emacs_value job_result(emacs_env *env, struct job *job)
+{
+    if (job->exception) {
+        env->non_local_exit_signal(env, Qjava_exception, exception_data(env, job->exception));
+        return NULL;
+    }
+    return job_value(env, job);
+}
+
+emacs_value job_outcome(emacs_env *env, struct job *job)
+{
+    if (job->exception) {
+        return list(env, 2, Qnil, job_error(env, job));
+    }
+    return list(env, 2, Qt, job_value(env, job));
+}
+
+static void *worker(void *data)
+{
+    JNIEnv *jni;
+    struct job *job;
+    int attached;
+
+    /* daemon, so the workers never hold up DestroyJavaVM */
+    attached = (*g_vm)->AttachCurrentThreadAsDaemon(g_vm, (void **) &jni, NULL) == JNI_OK;
+    pthread_mutex_lock(&pool_lock);
+    --starting_workers;
+    if (attached) {
+        ++live_workers;
+    }
+    pthread_cond_broadcast(&workers_started);
+    pthread_mutex_unlock(&pool_lock);
+    if (!attached) {
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        while (!queue_head && !shutting_down) {
+            pthread_cond_wait(&work_available, &pool_lock);
+        }
+        if (shutting_down) {
+            pthread_mutex_unlock(&pool_lock);
+            break;
+        }
+        job = queue_head;
+        queue_head = job->next;
+        if (!queue_head) {
+            queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&pool_lock);
+
+        job_run(jni, job);
+
+        pthread_mutex_lock(&pool_lock);
+        job->next = NULL;
+        if (completed_tail) {
+            completed_tail->next = job;
+        } else {
+            completed_head = job;
+        }
+        completed_tail = job;
+        pthread_mutex_unlock(&pool_lock);
+        notify_post();
+    }
+
+    (*g_vm)->DetachCurrentThread(g_vm);
+    return NULL;
+}
+
+/*
+ * Called with `pool_lock' held. Returns once every worker has attached
+ * to the VM or failed to.
+ */
+static void start_workers()
+{
+    int i;
+    workers = calloc(pool_size, sizeof(pthread_t));
+    assert(workers);
+    for (i = 0; i < pool_size; ++i) {
+        if (pthread_create(&workers[worker_count], NULL, worker, NULL) == 0) {
+            ++worker_count;
+            ++starting_workers;
+        }
+    }
+    while (starting_workers > 0) {
+        pthread_cond_wait(&workers_started, &pool_lock);
+    }
+}
+
+void pool_stop()
+{
+    struct job *job, *next;
+    int i;
+
+    pthread_mutex_lock(&pool_lock);
+    shutting_down = 1;
+    pthread_cond_broadcast(&work_available);
+    pthread_mutex_unlock(&pool_lock);
+    for (i = 0; i < worker_count; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+    live_workers = 0;
+
+    for (job = queue_head; job; job = next) {
+        next = job->next;
+        job_free(g_jni, job);
+    }
+    for (job = completed_head; job; job = next) {
+        next = job->next;
+        job_free(g_jni, job);
+    }
+    queue_head = queue_tail = completed_head = completed_tail = NULL;
+    shutting_down = 0;
+}
+
+/*
+ * (gg--call-method-async-raw TARGET METHOD-ID ARGS &optional NONVIRTUAL)
+ *
+ * Like `gg--call-method-raw', but the call is made on a worker thread.
+ * Returns the ID of the call, c.f. `gg--collect-completed-raw'.
+ */
+emacs_value
+Fgg_call_method_async_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    struct job *job;
+
+    ASSERT_JVM_RUNNING(env);
+
+    job = job_new(env, nargs, args);
+    if (!job) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    if (!workers) {
+        start_workers();
+    }
+    if (!live_workers) {
+        /* the job would never be run */
+        pthread_mutex_unlock(&pool_lock);
+        job_free(g_jni, job);
+        env->non_local_exit_signal(env, Qerror,
+                                   list(env, 1, env->make_string(env, "Can't start the worker threads", 30)));
+        return NULL;
+    }
+    job->id = next_id++;
+    if (queue_tail) {
+        queue_tail->next = job;
+    } else {
+        queue_head = job;
+    }
+    queue_tail = job;
+    pthread_cond_signal(&work_available);
+    pthread_mutex_unlock(&pool_lock);
+
+    return env->make_integer(env, job->id);
+}
+
+/*
+ * (gg--collect-completed-raw)
+ *
+ * Return the calls completed since the last collection as a list of
+ * (ID t VALUE) or (ID nil ERROR) in completion order.
+ */
+emacs_value
+Fgg_collect_completed_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    struct job *job, *next;
+    emacs_value result = Qnil;
+    emacs_value cons_args[2];
+    emacs_value entry;
+
+    ASSERT_JVM_RUNNING(env);
+
+    notify_ack();
+    pthread_mutex_lock(&pool_lock);
+    job = completed_head;
+    completed_head = completed_tail = NULL;
+    pthread_mutex_unlock(&pool_lock);
+
+    /* the result list is built back to front, so reverse first */
+    for (next = NULL; job; ) {
+        struct job *following = job->next;
+        job->next = next;
+        next = job;
+        job = following;
+    }
+    for (job = next; job; job = next) {
+        next = job->next;
+        cons_args[0] = env->make_integer(env, job->id);
+        cons_args[1] = job_outcome(env, job);
+        entry = env->funcall(env, Qcons, 2, cons_args);
+        job_free(g_jni, job);
+        cons_args[0] = entry;
+        cons_args[1] = result;
+        result = env->funcall(env, Qcons, 2, cons_args);
+    }
+    return result;
+}
+
+/*
+ * (gg--set-worker-threads COUNT)
+ *
+ * Takes effect the next time the pool is started.
+ */
+emacs_value
+Fgg_set_worker_threads (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data)
+{
+    intmax_t count = env->extract_integer(env, args[0]);
+    if (env->non_local_exit_check(env) != emacs_funcall_exit_return) {
+        return NULL;
+    }
+    if (count < 1 || count > 256) {
+        env->non_local_exit_signal(env, Qargs_out_of_range, list(env, 1, args[0]));
+        return NULL;
+    }
+    pool_size = count;
+    return args[0];
+}
@@ -0,0 +1,85 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Worker threads for asynchronous Java calls (c.f. `gg-call-async')
+ */
+
+#include <stdint.h>
+
+#include <emacs-module.h>
+#include <jni.h>
+
+struct call_info;
+
+/*
+ * A call made off the Emacs thread. Everything the calling thread
+ * touches is either immutable (method, call info) or a global ref
+ * owned by the job.
+ */
+struct job {
+    intmax_t id;
+    jmethodID method;
+    struct call_info *info;
+    jobject target;             /* global ref, NULL for static methods */
+    int nonvirtual;
+    jvalue *args;               /* object args are global refs */
+    jvalue result;              /* object result is a global ref */
+    jthrowable exception;       /* global ref */
+    struct job *next;
+};
+
+/*
+ * Build a job from the `gg--call-method-raw' arguments. Returns NULL
+ * with a pending signal on failure.
+ */
+struct job *job_new(emacs_env *env, ptrdiff_t nargs, emacs_value args[]);
+
+/*
+ * Make the call on the given (attached) thread
+ */
+void job_run(JNIEnv *jni, struct job *job);
+
+/*
+ * Return the result of a job run, or signal its exception (returning
+ * NULL). The job may be freed afterwards.
+ */
+emacs_value job_result(emacs_env *env, struct job *job);
+
+/*
+ * Convert the result of a job run to (t VALUE) or (nil ERROR)
+ */
+emacs_value job_outcome(emacs_env *env, struct job *job);
+
+void job_free(JNIEnv *jni, struct job *job);
+
+emacs_value Fgg_call_method_async_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_collect_completed_raw (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+emacs_value Fgg_set_worker_threads (emacs_env *env, ptrdiff_t nargs, emacs_value args[], void *data);
+
+/*
+ * Stop the workers (before the VM is destroyed). Calls in progress
+ * are waited for, queued and uncollected ones are dropped.
+ */
+void pool_stop();
@@ -0,0 +1,170 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emacs-module.h>
+#include <jvmti.h>
+#include <jni.h>
+
+#include "ctrl.h"
+#include "el_util.h"
+#include "hashtab.h"
+#include "sig.h"
+
+/* jmethodID -> struct sig * */
+static struct hashtab *sigs;
+
+int sig_parse_type(const char *descriptor, const char **p, struct sig_type *type)
+{
+    const char *end;
+
+    type->array_depth = 0;
+    type->name_start = type->name_length = 0;
+    while (**p == '[') {
+        type->array_depth++;
+        (*p)++;
+    }
+    type->element = **p;
+    switch (type->element) {
+    case 'Z': case 'B': case 'C': case 'S':
+    case 'I': case 'J': case 'F': case 'D':
+        (*p)++;
+        break;
+    case 'L':
+        end = strchr(*p, ';');
+        if (!end) {
+            return 0;
+        }
+        type->name_start = *p + 1 - descriptor;
+        type->name_length = end - *p - 1;
+        *p = end + 1;
+        break;
+    default:
+        return 0;
+    }
+    type->kind = type->array_depth ? 'L' : type->element;
+    return 1;
+}
+
+struct sig *sig_parse(const char *descriptor)
+{
+    struct sig *sig;
+    struct sig_type type;
+    const char *p;
+    int count = 0;
+    int i;
+
+    /* count the arguments first */
+    if (*descriptor != '(') {
+        return NULL;
+    }
+    for (p = descriptor + 1; *p != ')'; ++count) {
+        if (!sig_parse_type(descriptor, &p, &type)) {
+            return NULL;
+        }
+    }
+
+    sig = malloc(sizeof(struct sig) + sizeof(struct sig_type) * count);
+    assert(sig);
+    sig->descriptor = strdup(descriptor);
+    assert(sig->descriptor);
+    sig->arg_count = count;
+    for (p = descriptor + 1, i = 0; i < count; ++i) {
+        sig_parse_type(descriptor, &p, &sig->args[i]);
+    }
+    p++;
+    if (*p == 'V') {
+        memset(&sig->returns, 0, sizeof(struct sig_type));
+        sig->returns.kind = sig->returns.element = 'V';
+        p++;
+    } else if (!sig_parse_type(descriptor, &p, &sig->returns)) {
+        p = NULL;
+    }
+    if (!p || *p) {
+        free(sig->descriptor);
+        free(sig);
+        return NULL;
+    }
+    return sig;
+}
+
+static void free_sig(void *x)
+{
+    struct sig *sig = x;
+    free(sig->descriptor);
+    free(sig);
+}
+
+void sig_flush_all()
+{
+    if (sigs) {
+        hashtab_clear(sigs, free_sig);
+    }
+}
+
+const struct sig *sig_intern(jmethodID method, const char *descriptor)
+{
+    struct sig *sig;
+
+    if (!sigs) {
+        sigs = hashtab_new(HASHTAB_POINTER_KEYS);
+    }
+    sig = hashtab_get(sigs, method);
+    if (!sig) {
+        sig = sig_parse(descriptor);
+        if (sig) {
+            hashtab_put(sigs, method, sig);
+        }
+    }
+    return sig;
+}
+
+const struct sig *sig_for_method(emacs_env *env, jmethodID method)
+{
+    const struct sig *sig;
+    char *name, *descriptor;
+    static const char *errmsg = "Malformed method descriptor";
+
+    sig = sigs ? hashtab_get(sigs, method) : NULL;
+    if (sig) {
+        return sig;
+    }
+
+    g_jvmtiError = (*g_jvmti)->GetMethodName(g_jvmti, method, &name, &descriptor, NULL);
+    if (check_jvmti_error(env)) {
+        return NULL;
+    }
+    sig = sig_intern(method, descriptor);
+    if (!sig) {
+        env->non_local_exit_signal(env, Qerror,
+                                   list(env, 2, env->make_string(env, errmsg, strlen(errmsg)),
+                                        env->make_string(env, descriptor, strlen(descriptor))));
+    }
+    (*g_jvmti)->Deallocate(g_jvmti, (void *) name);
+    (*g_jvmti)->Deallocate(g_jvmti, (void *) descriptor);
+    return sig;
+}
@@ -0,0 +1,84 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Parsed method descriptors, shared by reflection (class_cache.c) and
+ * invocation (call.c). Each descriptor is parsed once per method.
+ */
+
+#ifndef GG_SIG_H
+#define GG_SIG_H
+
+#include <emacs-module.h>
+
+#include <jni.h>
+
+/*
+ * One type in a descriptor
+ */
+struct sig_type {
+    char kind;          /* jvalue kind: the primitive char, 'L' for objects and arrays, 'V' for void */
+    char element;       /* the primitive char or 'L' of the (array element) type */
+    int array_depth;    /* 0 for non-array types */
+    int name_start;     /* span of an 'L' element's internal class name in the descriptor */
+    int name_length;
+};
+
+struct sig {
+    char *descriptor;
+    int arg_count;
+    struct sig_type returns;
+    struct sig_type args[];
+};
+
+/*
+ * Parse a method descriptor, e.g. "(I[Ljava/lang/String;)V". Returns a
+ * malloc()'d descriptor (free() it) or NULL if it's malformed.
+ */
+struct sig *sig_parse(const char *descriptor);
+
+/*
+ * Parse the field descriptor at `*p', advancing `*p' past it. Spans
+ * are relative to `descriptor'. Returns 0 if it's malformed.
+ */
+int sig_parse_type(const char *descriptor, const char **p, struct sig_type *type);
+
+/*
+ * Return the cached descriptor of a method, parsing the one from
+ * JVMTI on first use. Returns NULL with a pending signal on failure.
+ */
+const struct sig *sig_for_method(emacs_env *env, jmethodID method);
+
+/*
+ * Cache a method's descriptor that's already at hand (from
+ * GetMethodName). Returns NULL if it's malformed.
+ */
+const struct sig *sig_intern(jmethodID method, const char *descriptor);
+
+/*
+ * Drop all cached descriptors (when the JVM is stopped)
+ */
+void sig_flush_all();
+
+#endif
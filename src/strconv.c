@@ -0,0 +1,304 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <emacs-module.h>
+#include <jni.h>
+
+#include "ctrl.h"
+#include "el_util.h"
+#include "strconv.h"
+
+#define REPLACEMENT_CHAR 0xFFFD
+
+/*
+ * Strings up to this many bytes (Emacs side) are converted through a
+ * per-thread scratch buffer without any allocation. Longer strings are
+ * transcoded CHUNK_SIZE UTF-16 units at a time.
+ */
+#define SCRATCH_SIZE 16384
+#define CHUNK_SIZE 8192
+
+static __thread char *scratch_bytes;
+static __thread jchar *scratch_chars;
+
+static void ensure_scratch()
+{
+    if (!scratch_bytes) {
+        scratch_bytes = malloc(SCRATCH_SIZE);
+        scratch_chars = malloc(SCRATCH_SIZE * sizeof(jchar));
+        assert(scratch_bytes && scratch_chars);
+    }
+}
+
+/*
+ * Decode one code point from the UTF-8 at `*in' and advance past
+ * it. Invalid, overlong or surrogate encodings decode as U+FFFD.
+ */
+static uint32_t decode_utf8(const unsigned char **in, const unsigned char *end)
+{
+    const unsigned char *p = *in;
+    uint32_t c = *p++;
+    uint32_t min;
+    int extra;
+
+    if (c < 0x80) {
+        *in = p;
+        return c;
+    } else if ((c & 0xE0) == 0xC0) {
+        extra = 1; c &= 0x1F; min = 0x80;
+    } else if ((c & 0xF0) == 0xE0) {
+        extra = 2; c &= 0x0F; min = 0x800;
+    } else if ((c & 0xF8) == 0xF0) {
+        extra = 3; c &= 0x07; min = 0x10000;
+    } else {
+        *in = p;
+        return REPLACEMENT_CHAR;
+    }
+
+    for (; extra; --extra, ++p) {
+        if (p == end || (*p & 0xC0) != 0x80) {
+            /* resume at the offending byte */
+            *in = p;
+            return REPLACEMENT_CHAR;
+        }
+        c = (c << 6) | (*p & 0x3F);
+    }
+    *in = p;
+    if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+        return REPLACEMENT_CHAR;
+    }
+    return c;
+}
+
+/*
+ * Transcode UTF-8 at `*in' to at most `room' UTF-16 units, advancing
+ * `*in' past what was consumed. A surrogate pair is never split.
+ *
+ * @return the number of units written
+ */
+static jsize utf8_to_utf16(const unsigned char **in, const unsigned char *end,
+                           jchar *out, jsize room)
+{
+    const unsigned char *p;
+    jsize n = 0;
+    uint32_t c;
+
+    while (*in < end) {
+        p = *in;
+        c = decode_utf8(&p, end);
+        if (c >= 0x10000) {
+            if (room - n < 2) { break; }
+            c -= 0x10000;
+            out[n++] = 0xD800 + (c >> 10);
+            out[n++] = 0xDC00 + (c & 0x3FF);
+        } else {
+            if (room - n < 1) { break; }
+            out[n++] = c;
+        }
+        *in = p;
+    }
+    return n;
+}
+
+/*
+ * Number of UTF-16 units needed for the given UTF-8
+ */
+static jsize utf16_length(const unsigned char *in, const unsigned char *end)
+{
+    jsize n = 0;
+    while (in < end) {
+        n += decode_utf8(&in, end) >= 0x10000 ? 2 : 1;
+    }
+    return n;
+}
+
+static char *put_utf8(char *p, uint32_t c)
+{
+    if (c < 0x80) {
+        *p++ = c;
+    } else if (c < 0x800) {
+        *p++ = 0xC0 | (c >> 6);
+        *p++ = 0x80 | (c & 0x3F);
+    } else if (c < 0x10000) {
+        *p++ = 0xE0 | (c >> 12);
+        *p++ = 0x80 | ((c >> 6) & 0x3F);
+        *p++ = 0x80 | (c & 0x3F);
+    } else {
+        *p++ = 0xF0 | (c >> 18);
+        *p++ = 0x80 | ((c >> 12) & 0x3F);
+        *p++ = 0x80 | ((c >> 6) & 0x3F);
+        *p++ = 0x80 | (c & 0x3F);
+    }
+    return p;
+}
+
+/*
+ * Transcode UTF-16 to UTF-8. `*high' carries a high surrogate over
+ * from the previous chunk (0 if none) and is updated for the next
+ * one. The output never exceeds 3 bytes per input unit.
+ *
+ * @return the number of bytes written
+ */
+static ptrdiff_t utf16_to_utf8(const jchar *in, jsize count, char *out, jchar *high)
+{
+    char *p = out;
+    uint32_t c;
+    jsize i;
+
+    for (i = 0; i < count; ++i) {
+        c = in[i];
+        if (*high) {
+            if (c >= 0xDC00 && c <= 0xDFFF) {
+                p = put_utf8(p, 0x10000 + ((*high - 0xD800) << 10) + (c - 0xDC00));
+                *high = 0;
+                continue;
+            }
+            p = put_utf8(p, REPLACEMENT_CHAR);
+            *high = 0;
+        }
+        if (c >= 0xD800 && c <= 0xDBFF) {
+            *high = c;
+        } else if (c >= 0xDC00 && c <= 0xDFFF) {
+            p = put_utf8(p, REPLACEMENT_CHAR);
+        } else {
+            p = put_utf8(p, c);
+        }
+    }
+    return p - out;
+}
+
+/*
+ * Lisp to Java for strings too big for the scratch buffer. The UTF-8
+ * copy is transcoded into a char[] a chunk at a time, so only the UTF-8
+ * is ever held in full on the C side.
+ */
+static jstring lisp_to_jstring_chunked(emacs_env *env, emacs_value string, ptrdiff_t size)
+{
+    jchar chunk[CHUNK_SIZE];
+    unsigned char *bytes;
+    const unsigned char *in, *end;
+    jcharArray chars;
+    jstring result = NULL;
+    jsize length, offset, n;
+
+    bytes = malloc(size);
+    assert(bytes);
+    if (!env->copy_string_contents(env, string, (char *) bytes, &size)) {
+        free(bytes);
+        return NULL;
+    }
+    /* size includes the terminating NUL */
+    end = bytes + size - 1;
+
+    length = utf16_length(bytes, end);
+    chars = (*g_jni)->NewCharArray(g_jni, length);
+    if (chars) {
+        in = bytes;
+        for (offset = 0; offset < length; offset += n) {
+            n = utf8_to_utf16(&in, end, chunk, CHUNK_SIZE);
+            (*g_jni)->SetCharArrayRegion(g_jni, chars, offset, n, chunk);
+        }
+        free(bytes);
+        bytes = NULL;
+        result = (*g_jni)->NewObject(g_jni, g_java_lang_String, g_mid_String_init_chars, chars);
+        (*g_jni)->DeleteLocalRef(g_jni, chars);
+    }
+    free(bytes);
+    if (handle_exception(env)) { return NULL; }
+    return result;
+}
+
+jstring lisp_to_jstring(emacs_env *env, emacs_value string)
+{
+    ptrdiff_t size = SCRATCH_SIZE;
+    const unsigned char *in;
+    jsize n;
+    jstring result;
+
+    ensure_scratch();
+
+    if (!env->copy_string_contents(env, string, scratch_bytes, &size)) {
+        /* Too big for the scratch buffer: `size' now holds the size
+         * required. Anything else is a real error. */
+        if (size <= SCRATCH_SIZE) {
+            return NULL;
+        }
+        env->non_local_exit_clear(env);
+        return lisp_to_jstring_chunked(env, string, size);
+    }
+
+    /* UTF-16 never takes more units than UTF-8 takes bytes */
+    in = (const unsigned char *) scratch_bytes;
+    n = utf8_to_utf16(&in, in + size - 1, scratch_chars, SCRATCH_SIZE);
+    result = (*g_jni)->NewString(g_jni, scratch_chars, n);
+    if (handle_exception(env)) { return NULL; }
+    return result;
+}
+
+emacs_value jstring_to_lisp(emacs_env *env, jstring string)
+{
+    jchar chunk[CHUNK_SIZE];
+    jchar high = 0;
+    jsize length, offset, n;
+    ptrdiff_t size = 0;
+    char *bytes;
+    emacs_value result;
+
+    length = (*g_jni)->GetStringLength(g_jni, string);
+
+    if (length <= SCRATCH_SIZE / 3) {
+        ensure_scratch();
+        (*g_jni)->GetStringRegion(g_jni, string, 0, length, scratch_chars);
+        if (handle_exception(env)) { return NULL; }
+        size = utf16_to_utf8(scratch_chars, length, scratch_bytes, &high);
+        if (high) {
+            size += put_utf8(scratch_bytes + size, REPLACEMENT_CHAR) - (scratch_bytes + size);
+        }
+        return env->make_string(env, scratch_bytes, size);
+    }
+
+    /* Modified UTF-8 is never shorter than what we produce, so its
+     * length bounds the buffer without holding a UTF-16 copy. */
+    bytes = malloc((*g_jni)->GetStringUTFLength(g_jni, string) + 1);
+    assert(bytes);
+    for (offset = 0; offset < length; offset += n) {
+        n = length - offset < CHUNK_SIZE ? length - offset : CHUNK_SIZE;
+        (*g_jni)->GetStringRegion(g_jni, string, offset, n, chunk);
+        if (handle_exception(env)) {
+            free(bytes);
+            return NULL;
+        }
+        size += utf16_to_utf8(chunk, n, bytes + size, &high);
+    }
+    if (high) {
+        size += put_utf8(bytes + size, REPLACEMENT_CHAR) - (bytes + size);
+    }
+    result = env->make_string(env, bytes, size);
+    free(bytes);
+    return result;
+}
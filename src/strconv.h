@@ -0,0 +1,45 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <emacs-module.h>
+#include <jni.h>
+
+/*
+ * Conversion of strings between Emacs (UTF-8) and Java (UTF-16).
+ *
+ * Malformed input (invalid UTF-8 from Emacs or unpaired surrogates
+ * from Java) is replaced by U+FFFD rather than passed through.
+ */
+
+/*
+ * Create a java.lang.String from a Lisp string. Returns a local ref or
+ * NULL with a pending signal.
+ */
+jstring lisp_to_jstring(emacs_env *env, emacs_value string);
+
+/*
+ * Create a Lisp string from a java.lang.String. Returns NULL with a
+ * pending signal on failure.
+ */
+emacs_value jstring_to_lisp(emacs_env *env, jstring string);
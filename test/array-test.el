@@ -0,0 +1,37 @@
+(ert-deftest array-to-vector ()
+  (let* ((v [1 -2 3 2147483647])
+         (a (gg-vector-to-array 'i v)))
+    (should (gg-objectp a))
+    (should (equal v (gg-array-to-vector a)))
+    (should (equal [-2 3] (gg-array-to-vector a 1 3)))
+    (should (equal [] (gg-array-to-vector a 4))))
+  (should (equal [t nil t] (gg-array-to-vector (gg-vector-to-array 'z [t nil 1]))))
+  (should (equal [1.0 2.5] (gg-array-to-vector (gg-vector-to-array 'd [1 2.5]))))
+  (should (equal [1234567890123] (gg-array-to-vector (gg-vector-to-array 'j [1234567890123]))))
+  (should (equal [65 66] (gg-array-to-vector (gg-vector-to-array 'c [0 65 66 0] 1 3)))))
+
+(ert-deftest array-large ()
+  "Arrays larger than one transfer chunk"
+  (let* ((v (make-vector 10000 0)))
+    (dotimes (i (length v))
+      (aset v i (* i 3)))
+    (should (equal v (gg-array-to-vector (gg-vector-to-array 'j v))))))
+
+(ert-deftest array-errors ()
+  (let ((a (gg-vector-to-array 'i [1 2 3])))
+    (should-error (gg-array-to-vector a 2 1) :type 'args-out-of-range)
+    (should-error (gg-array-to-vector a 0 4) :type 'args-out-of-range)
+    (should-error (gg-vector-to-array 'i [1 2] 0 3) :type 'args-out-of-range)
+    (should-error (gg-vector-to-array 'x [1]) :type 'wrong-type-argument)
+    (should-error (gg-vector-to-array 'i [1.5]) :type 'wrong-type-argument)
+    (should-error (gg-array-to-vector (gg-new-string "x")) :type 'wrong-type-argument)
+    (should-error (gg-byte-array-to-string a) :type 'wrong-type-argument)))
+
+(ert-deftest array-byte-string ()
+  (let* ((s (unibyte-string 0 65 127 128 255))
+         (a (gg-string-to-byte-array s)))
+    (should (equal [0 65 127 -128 -1] (gg-array-to-vector a)))
+    (should (equal s (gg-byte-array-to-string a)))
+    (should (equal "A" (gg-byte-array-to-string a 1 2)))
+    (should-not (multibyte-string-p (gg-byte-array-to-string a))))
+  (should (equal [-61 -87] (gg-array-to-vector (gg-string-to-byte-array "é")))))
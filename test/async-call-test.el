@@ -0,0 +1,37 @@
+(ert-deftest call-async-values ()
+  "Futures resolve to the same values as synchronous calls"
+  (let ((max (gg-call-static-async 'java.lang.Math 'max 42 7))
+        (s (gg-call-static-async 'java.lang.String 'valueOf 123))
+        (l (gg-new (gg-find-class "java.util.ArrayList"))))
+    (should (gg-future-p max))
+    (should (eq 42 (gg-future-get max 5)))
+    (should (gg-future-done-p max))
+    (should (string-equal "123" (gg-toString (gg-future-get s 5))))
+    (should (eq t (gg-future-get (gg-call-async l 'add (gg-new-string "x")) 5)))
+    (should (eq 1 (gg-future-get (gg-call-async l 'size) 5)))))
+
+(ert-deftest call-async-exception ()
+  "A failed call signals its Java exception from `gg-future-get'"
+  (let* ((future (gg-call-static-async 'java.lang.Integer 'parseInt "x"))
+         (err (should-error (gg-future-get future 5) :type 'java-exception)))
+    (should (eq 'java.lang.NumberFormatException (gg-java-exception-class err)))))
+
+(ert-deftest call-async-concurrent ()
+  "Long calls run concurrently on the worker threads"
+  (let* ((start (float-time))
+         (futures (cl-loop repeat 4
+                           collect (gg-call-static-async 'java.lang.Thread 'sleep 500))))
+    (dolist (future futures)
+      (should (null (gg-future-get future 10))))
+    (should (< (- (float-time) start) 1.5))))
+
+(ert-deftest call-async-then ()
+  "Callbacks are run on the Emacs thread once the call completes"
+  (let* ((result nil)
+         (future (gg-future-then (gg-call-static-async 'java.lang.Math 'abs -5)
+                                 (lambda (f) (setq result (gg-future-value f))))))
+    (gg-future-get future 5)
+    (should (eq 5 result))
+    ;; already done, called right away
+    (gg-future-then future (lambda (f) (setq result 'again)))
+    (should (eq 'again result))))
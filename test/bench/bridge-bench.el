@@ -0,0 +1,62 @@
+;; End-to-end benchmarks of the bridge entry points
+
+(require 'gg-bench)
+
+;; Must come first, the JVM only starts once per process
+(gg-bench-define jvm-start 1
+  :warmup 0
+  (gg-java-start))
+
+(gg-bench-define find-class 10000
+  (gg-find-class "java.util.ArrayList"))
+
+;; The native class cache is flushed so the class is reflected on every run
+(gg-bench-define class-struct-small 1000
+  (gg--flush-class-cache 'java.lang.Object)
+  (gg--get-class-struct 'java.lang.Object))
+
+(gg-bench-define class-struct-huge 200
+  (gg--flush-class-cache 'java.lang.Character)
+  (gg--get-class-struct 'java.lang.Character))
+
+(gg-bench-define class-struct-cached 1000
+  (gg--get-class-struct 'java.lang.Character))
+
+(defvar gg-bench--long-string nil)
+
+(gg-bench-define new-string-short 10000
+  (gg-new-string "hello, world"))
+
+(gg-bench-define new-string-4mb 20
+  :setup (setq gg-bench--long-string (make-string (* 4 1024 1024) ?x))
+  (gg-new-string gg-bench--long-string))
+
+(gg-bench-define new-string-4mb-multibyte 20
+  :setup (setq gg-bench--long-string (make-string (* 2 1024 1024) ?\u03bb))
+  (gg-new-string gg-bench--long-string))
+
+(defvar gg-bench--object nil)
+(defvar gg-bench--object-class nil)
+
+(gg-bench-define to-string 10000
+  :setup (setq gg-bench--object (gg-new (gg-find-class "java.util.ArrayList")))
+  (gg-toString gg-bench--object))
+
+;; Creating and wrapping a plain object
+(gg-bench-define wrap-object 10000
+  :setup (setq gg-bench--object-class (gg-find-class "java.lang.Object"))
+  (gg--new-raw gg-bench--object-class))
+
+;; Creating, collecting and releasing 10k wrappers, per round
+(defvar gg-bench--wrappers nil)
+
+(gg-bench-define release-10k-wrappers 20
+  :warmup 1
+  :setup (setq gg-bench--object-class (gg-find-class "java.lang.Object"))
+  (setq gg-bench--wrappers (make-vector 10000 nil))
+  (dotimes (i 10000)
+    (aset gg-bench--wrappers i (gg--new-raw gg-bench--object-class)))
+  (setq gg-bench--wrappers nil)
+  (garbage-collect)
+  (while (> (gg--pending-releases) 0)
+    (gg--drain-releases)))
@@ -0,0 +1,126 @@
+;; Benchmark harness for the bridge (c.f. `make bench')
+;;
+;; Each benchmark runs its body a number of times, timing every run,
+;; and reports runs per second and the median and 99th percentile
+;; latency. Results are compared to a baseline file (an alist of
+;; (NAME . OPS-PER-SEC)) and a benchmark fails if it's slower than
+;; the baseline by more than the threshold.
+
+(add-to-list 'load-path (getenv "PWD"))
+(require 'gargoyle)
+(require 'cl-lib)
+
+(cl-defstruct gg-bench
+  name iterations warmup setup function)
+
+(defvar gg-bench--benchmarks nil
+  "Defined benchmarks, in reverse order of definition.")
+
+(defmacro gg-bench-define (name iterations &rest body)
+  "Define the benchmark NAME running BODY ITERATIONS times.
+BODY may start with the keyword arguments :warmup N (untimed runs
+before, default 10% of ITERATIONS) and :setup FORM (evaluated once
+before the runs)."
+  (let (warmup setup)
+    (while (keywordp (car body))
+      (pcase (pop body)
+        (:warmup (setq warmup (pop body)))
+        (:setup (setq setup (pop body)))))
+    `(progn
+       (setq gg-bench--benchmarks
+             (cons (make-gg-bench :name ',name
+                                  :iterations ,iterations
+                                  :warmup ,(or warmup `(/ ,iterations 10))
+                                  :setup (lambda () ,setup)
+                                  :function (lambda () ,@body))
+                   (cl-remove ',name gg-bench--benchmarks :key #'gg-bench-name)))
+       ',name)))
+
+(defun gg-bench--percentile (sorted p)
+  (aref sorted (floor (* p (1- (length sorted))))))
+
+(defun gg-bench-run-one (bench)
+  "Run BENCH, returning (NAME OPS-PER-SEC P50 P99) with latencies in seconds."
+  (let* ((fn (gg-bench-function bench))
+         (n (gg-bench-iterations bench))
+         (samples (make-vector n 0.0))
+         (total 0.0))
+    (funcall (gg-bench-setup bench))
+    (dotimes (_ (gg-bench-warmup bench))
+      (funcall fn))
+    (garbage-collect)
+    (dotimes (i n)
+      (let ((start (float-time)))
+        (funcall fn)
+        (aset samples i (- (float-time) start))))
+    (mapc (lambda (sample) (setq total (+ total sample))) samples)
+    (setq samples (sort samples #'<))
+    (list (gg-bench-name bench)
+          (if (> total 0) (/ n total) 0.0)
+          (gg-bench--percentile samples 0.5)
+          (gg-bench--percentile samples 0.99))))
+
+(defun gg-bench-run (&optional selector)
+  "Run the benchmarks (whose names match the regexp SELECTOR),
+returning a list of `gg-bench-run-one' results."
+  (let (results)
+    (dolist (bench (reverse gg-bench--benchmarks))
+      (when (or (null selector)
+                (string-match-p selector (symbol-name (gg-bench-name bench))))
+        (push (gg-bench-run-one bench) results)))
+    (nreverse results)))
+
+(defun gg-bench--read-baseline (file)
+  (when (and file (file-exists-p file))
+    (with-temp-buffer
+      (insert-file-contents file)
+      (read (current-buffer)))))
+
+(defun gg-bench--write-baseline (file results)
+  (with-temp-file file
+    (insert ";; ops/sec per benchmark, c.f. `make bench-baseline'\n")
+    (pp (mapcar (lambda (result) (cons (nth 0 result) (nth 1 result))) results)
+        (current-buffer))))
+
+(defun gg-bench-report (results baseline threshold)
+  "Print RESULTS compared to BASELINE. Return the names of the
+benchmarks slower than the baseline by more than THRESHOLD (a
+fraction)."
+  (let (regressions)
+    (princ (format "%-28s %12s %12s %12s %12s %8s\n"
+                   "benchmark" "ops/sec" "p50 (us)" "p99 (us)" "baseline" "change"))
+    (dolist (result results)
+      (let* ((name (nth 0 result))
+             (ops (nth 1 result))
+             (base (cdr (assq name baseline)))
+             (change (and base (> base 0) (/ (- ops base) base))))
+        (princ (format "%-28s %12.1f %12.1f %12.1f %12s %8s%s\n"
+                       name ops (* 1e6 (nth 2 result)) (* 1e6 (nth 3 result))
+                       (if base (format "%.1f" base) "-")
+                       (if change (format "%+.1f%%" (* 100 change)) "-")
+                       (if (and change (< change (- threshold)))
+                           (progn (push name regressions) "  REGRESSION")
+                         "")))))
+    (nreverse regressions)))
+
+(defun gg-bench-run-batch ()
+  "Run the benchmarks from the command line, configured by the
+environment: GG_BENCH_SELECT (a regexp of benchmark names),
+GG_BENCH_BASELINE (the baseline file), GG_BENCH_THRESHOLD (the
+allowed slowdown, default 0.25) and GG_BENCH_SAVE (write the results
+to this file as the new baseline). Exit with status 1 on
+regressions."
+  (let* ((selector (getenv "GG_BENCH_SELECT"))
+         (baseline-file (getenv "GG_BENCH_BASELINE"))
+         (threshold (string-to-number (or (getenv "GG_BENCH_THRESHOLD") "0.25")))
+         (save-file (getenv "GG_BENCH_SAVE"))
+         (results (gg-bench-run (and selector (not (string= selector "")) selector)))
+         (regressions (gg-bench-report results
+                                       (gg-bench--read-baseline baseline-file)
+                                       threshold)))
+    (when (and save-file (not (string= save-file "")))
+      (gg-bench--write-baseline save-file results)
+      (princ (format "Baseline written to %s\n" save-file)))
+    (kill-emacs (if regressions 1 0))))
+
+(provide 'gg-bench)
@@ -0,0 +1,73 @@
+(ert-deftest call-method-raw-instance ()
+  "Basic instance method calls with primitive and object args/returns"
+  (let* ((c (gg-find-class "java.util.ArrayList"))
+         (l (gg-new c))
+         (add (gg--get-method-id-raw c "add" "(Ljava/lang/Object;)Z"))
+         (size (gg--get-method-id-raw c "size" "()I"))
+         (get (gg--get-method-id-raw c "get" "(I)Ljava/lang/Object;"))
+         (s (gg-new-string "x")))
+    (should (eq 0 (gg--call-method-raw l size nil)))
+    (should (eq t (gg--call-method-raw l add `((l ,s)))))
+    (should (eq 1 (gg--call-method-raw l size nil)))
+    (should (string-equal "x" (gg-toString (gg--call-method-raw l get '((i 0))))))
+    ;; vector form
+    (should (string-equal "x" (gg-toString (gg--call-method-raw l get [i 0]))))))
+
+(ert-deftest call-method-raw-static ()
+  (let* ((math (gg-find-class "java.lang.Math"))
+         (max-i (gg--get-method-id-raw math "max" "(II)I" t))
+         (max-d (gg--get-method-id-raw math "max" "(DD)D" t)))
+    (should (eq 42 (gg--call-method-raw nil max-i '((i 42) (i 7)))))
+    (should (= 2.5 (gg--call-method-raw math max-d '((d 2.5) (d 1))))))
+  (let* ((long-class (gg-find-class "java.lang.Long"))
+         (parse (gg--get-method-id-raw long-class "parseLong"
+                                       "(Ljava/lang/String;)J" t)))
+    (should (eq 1234567890123 (gg--call-method-raw
+                               nil parse `((l ,(gg-new-string "1234567890123"))))))))
+
+(ert-deftest call-method-raw-errors ()
+  (let* ((math (gg-find-class "java.lang.Math"))
+         (max-i (gg--get-method-id-raw math "max" "(II)I" t))
+         (int-class (gg-find-class "java.lang.Integer"))
+         (parse (gg--get-method-id-raw int-class "parseInt"
+                                       "(Ljava/lang/String;)I" t))
+         (list-class (gg-find-class "java.util.ArrayList"))
+         (size (gg--get-method-id-raw list-class "size" "()I")))
+    (should-error (gg--call-method-raw nil max-i '((i 1))) :type 'wrong-number-of-arguments)
+    (should-error (gg--call-method-raw nil max-i '((i 1) (d 1.0))) :type 'wrong-type-argument)
+    (should-error (gg--call-method-raw nil max-i '((i 1) (i 1.0))) :type 'wrong-type-argument)
+    (should-error (gg--call-method-raw nil math '((i 1) (i 1))) :type 'wrong-type-argument)
+    (should-error (gg--call-method-raw (gg-new-string "x") max-i '((i 1) (i 1)))
+                  :type 'wrong-type-argument)
+    ;; objects of the wrong class
+    (should-error (gg--call-method-raw (gg-new-string "x") size nil) :type 'wrong-type-argument)
+    (should-error (gg--call-method-raw nil parse `((l ,(gg-new list-class))))
+                  :type 'wrong-type-argument)
+    (should-error (gg--call-method-raw nil parse `((l ,(gg-new-string "x"))))
+                  :type 'java-exception)))
+
+(ert-deftest call-method-selection ()
+  "Overloads are selected by argument types"
+  (let ((sb (gg-new "java.lang.StringBuilder")))
+    (gg-call sb 'append 42)
+    (gg-call sb 'append 1.5)
+    (gg-call sb 'append t)
+    (gg-call sb 'append "str")
+    (gg-call sb 'append (gg-new-string "obj"))
+    (should (string-equal "421.5truestrobj" (gg-toString sb)))
+    (should (eq 15 (gg-call sb 'length)))))
+
+(ert-deftest call-method-static ()
+  (should (eq 7 (gg-call-static 'java.lang.Math 'max 3 7)))
+  (should (eq 42 (gg-call-static 'java.lang.Integer 'parseInt "42"))))
+
+(ert-deftest call-method-cache ()
+  (gg-call-cache-clear)
+  (let ((l (gg-new "java.util.ArrayList")))
+    (gg-call l 'add "a")
+    (should (equal 1 (plist-get (gg-call-cache-stats) :misses)))
+    (gg-call l 'add "b")
+    (gg-call l 'add "c")
+    (should (equal 2 (plist-get (gg-call-cache-stats) :hits)))
+    (should (eq 3 (gg-call l 'size)))
+    (should-error (gg-call l 'noSuchMethod))))
@@ -0,0 +1,28 @@
+(ert-deftest class-index-prefix ()
+  "Loaded classes are found by prefix, sorted"
+  (gg-new (gg-find-class "java.util.ArrayList"))
+  (let ((classes (gg-loaded-classes "java.util.Array")))
+    (should (memq 'java.util.ArrayList classes))
+    (should (cl-every (lambda (c) (string-prefix-p "java.util.Array" (symbol-name c)))
+                      classes))
+    (should (equal classes (sort (copy-sequence classes) #'string<)))))
+
+(ert-deftest class-index-package ()
+  "Package queries don't include subpackages"
+  (let ((classes (gg-package-classes "java.util")))
+    (should (memq 'java.util.ArrayList classes))
+    (should-not (memq 'java.util.concurrent.ConcurrentHashMap classes))))
+
+(ert-deftest class-index-new-class ()
+  "Classes loaded after startup are indexed"
+  (should-not (memq 'javax.swing.undo.UndoManager (gg-loaded-classes "javax.swing.undo.")))
+  (gg-find-class "javax.swing.undo.UndoManager")
+  (should (memq 'javax.swing.undo.UndoManager (gg-loaded-classes "javax.swing.undo."))))
+
+(ert-deftest class-index-supertypes ()
+  "Supertypes come from the index"
+  (let ((supertypes (gg--class-index-supertypes 'java.util.ArrayList)))
+    (should (eq 'java.util.AbstractList (car supertypes)))
+    (should (memq 'java.util.List (cdr supertypes))))
+  (should (null (car (gg--class-index-supertypes 'java.lang.Object))))
+  (should (null (gg--class-index-supertypes 'no.such.Class))))
@@ -0,0 +1,59 @@
+(ert-deftest class-store-warm ()
+  "Class structs are read back from the metadata cache"
+  (let ((file (make-temp-file "gg-classes")))
+    (delete-file file)
+    (unwind-protect
+        (progn
+          (gg--class-store-open file)
+          (gg--flush-class-cache 'java.util.ArrayList)
+          (let ((struct (gg--get-class-struct 'java.util.ArrayList))
+                (hits (plist-get (gg--class-store-stats) :hits)))
+            (should (gg--class-store-save))
+            (should (file-exists-p file))
+            (should-not (gg--class-store-save))
+            ;; closed, so the class is only flushed from memory
+            (gg--class-store-open nil)
+            (gg--flush-class-cache 'java.util.ArrayList)
+            (gg--class-store-open file)
+            (should (equal struct (gg--get-class-struct 'java.util.ArrayList)))
+            (should (= (1+ hits) (plist-get (gg--class-store-stats) :hits)))))
+      (gg--class-store-open nil)
+      (when (file-exists-p file)
+        (delete-file file)))))
+
+(ert-deftest class-store-flush ()
+  "Flushing a class drops it from the metadata cache too"
+  (let ((file (make-temp-file "gg-classes")))
+    (delete-file file)
+    (unwind-protect
+        (progn
+          (gg--class-store-open file)
+          (gg--flush-class-cache 'java.util.LinkedList)
+          (gg--get-class-struct 'java.util.LinkedList)
+          (should (gg--class-store-save))
+          (gg--class-store-open file)
+          (let ((hits (plist-get (gg--class-store-stats) :hits))
+                (added (plist-get (gg--class-store-stats) :added)))
+            (gg--flush-class-cache 'java.util.LinkedList)
+            (should (eq 'java.util.LinkedList
+                        (plist-get (gg--get-class-struct 'java.util.LinkedList) :name)))
+            ;; reflected on again rather than read back
+            (should (= hits (plist-get (gg--class-store-stats) :hits)))
+            (should (= (1+ added) (plist-get (gg--class-store-stats) :added)))))
+      (gg--class-store-open nil)
+      (when (file-exists-p file)
+        (delete-file file)))))
+
+(ert-deftest class-store-corrupt ()
+  "A corrupt cache file is ignored"
+  (let ((file (make-temp-file "gg-classes")))
+    (unwind-protect
+        (progn
+          (with-temp-file file
+            (insert "GGCS garbage"))
+          (gg--class-store-open file)
+          (gg--flush-class-cache 'java.util.HashMap)
+          (should (eq 'java.util.HashMap
+                      (plist-get (gg--get-class-struct 'java.util.HashMap) :name))))
+      (gg--class-store-open nil)
+      (delete-file file))))
@@ -17,9 +17,11 @@
 
 (ert-deftest no-class-def ()
   "Does an attempt to load a non-existent class throw a proper exception?"
-  (message "* The following NoClassDefError exception is expected:")
   (condition-case exc (gg-find-class "java.DoesntExist")
-	(java-exception (should (eq 'java-exception (car exc))))))
+	(java-exception
+     (should (eq 'java-exception (car exc)))
+     (should (eq 'java.lang.NoClassDefFoundError (gg-java-exception-class exc)))
+     (should (string-match-p "DoesntExist" (gg-java-exception-message exc))))))
 
 (ert-deftest find-class-on-non-string ()
   "Does an attempt to load a class given a wrong type throw a proper exception?"
@@ -132,6 +134,18 @@
     (should (equal '((gg-array . java.lang.Thread)) (plist-get enumerate-method :accepts)))
     (should (equal '((gg-prim . J) java.util.concurrent.TimeUnit) (plist-get awaitTermination-method :accepts)))))
 
+(ert-deftest class-struct-many-arguments ()
+  "Signatures aren't limited in arity"
+  (let* ((graphics-struct (gg--get-class-struct 'java.awt.Graphics))
+         (draw-image-methods (cl-remove-if-not (lambda (m) (eq 'drawImage (plist-get m :name)))
+                                               (plist-get graphics-struct :methods)))
+         (longest (car (sort (mapcar (lambda (m) (plist-get m :accepts)) draw-image-methods)
+                             (lambda (a b) (> (length a) (length b)))))))
+    (should (equal '(java.awt.Image (gg-prim . I) (gg-prim . I) (gg-prim . I) (gg-prim . I)
+                                    (gg-prim . I) (gg-prim . I) (gg-prim . I) (gg-prim . I)
+                                    java.awt.Color java.awt.image.ImageObserver)
+                   longest))))
+
 (ert-deftest class-struct-basic-access ()
   "Can we load the ArrayList struct?"
   (let* ((arraylist-struct (gg--get-class-struct 'java.util.ArrayList)))
@@ -142,3 +156,39 @@
     ;; basic sanity check. There are 49 methods on ArrayList in JAVA 1.8.0_66-b17
     (should (> (length (plist-get arraylist-struct :methods)) 30))
     (should (> (length (plist-get arraylist-struct :fields)) 4))))
+
+(ert-deftest class-struct-cache ()
+  "Cached and freshly loaded class structs should be identical"
+  (let ((cached (gg--get-class-struct 'java.util.ArrayList)))
+    (should (equal cached (gg--get-class-struct 'java.util.ArrayList)))
+    (should (eq t (gg--flush-class-cache 'java.util.ArrayList)))
+    (should (equal cached (gg--get-class-struct 'java.util.ArrayList)))
+    (should (eq t (gg--flush-class-cache)))
+    (should (equal cached (gg--get-class-struct 'java.util.ArrayList)))))
+
+(ert-deftest class-hierarchy-batch-load ()
+  "Are all supertypes loaded with a class?"
+  (let* ((structs (gg--get-class-structs 'java.util.ArrayList))
+         (names (mapcar (lambda (s) (plist-get s :name)) structs)))
+    (should (eq 'java.util.ArrayList (car names)))
+    (dolist (supertype '(java.util.AbstractList java.util.AbstractCollection java.lang.Object
+                         java.util.List java.util.Collection java.lang.Iterable))
+      (should (memq supertype names)))
+    ;; every class only once
+    (should (equal names (cl-remove-duplicates names)))))
+
+(ert-deftest class-hierarchy-batch-load-skips-loaded ()
+  (let ((loaded (make-hash-table)))
+    (puthash 'java.util.AbstractList t loaded)
+    (let ((names (mapcar (lambda (s) (plist-get s :name))
+                         (gg--get-class-structs '(java.util.ArrayList) loaded))))
+      (should (memq 'java.util.List names))
+      (should (not (memq 'java.util.AbstractList names)))
+      (should (not (memq 'java.util.AbstractCollection names))))))
+
+(ert-deftest class-add-by-name ()
+  (let ((gg--class-hierarchy (make-hash-table)))
+    (gg--class-add-by-name 'java.util.ArrayList)
+    (should (gethash 'java.util.ArrayList gg--class-hierarchy))
+    (should (gethash 'java.util.AbstractList gg--class-hierarchy))
+    (should (gethash 'java.lang.Object gg--class-hierarchy))))
@@ -5,3 +5,27 @@ already running"
   (condition-case err (gg-java-start)
 	(error
 	 (should (string-equal "JVM already running" (cdr err))))))
+
+(ert-deftest java-exception-data ()
+  "Java exceptions carry the class and message, the stack trace is on demand"
+  (let* ((c (gg-find-class "java.lang.Integer"))
+         (parse (gg--get-method-id-raw c "parseInt" "(Ljava/lang/String;)I" t))
+         (err (should-error (gg--call-method-raw nil parse `((l ,(gg-new-string "x")))))))
+    (should (eq 'java-exception (car err)))
+    (should (eq 'java.lang.NumberFormatException (gg-java-exception-class err)))
+    (should (string-equal "For input string: \"x\"" (gg-java-exception-message err)))
+    (should (gg-objectp (gg-java-exception-object err)))
+    (let ((trace (gg-java-exception-stack-trace err)))
+      (should (cl-every #'stringp trace))
+      (should (string-match-p "parseInt" (car trace)))
+      ;; memoized
+      (should (eq trace (gg-java-exception-stack-trace err))))))
+
+(ert-deftest java-exception-null-message ()
+  (let* ((c (gg-find-class "java.util.ArrayList"))
+         (iter (gg--get-method-id-raw c "iterator" "()Ljava/util/Iterator;"))
+         (it (gg--call-method-raw (gg-new c) iter nil))
+         (next (gg--get-method-id-raw (gg-find-class "java.util.Iterator") "next" "()Ljava/lang/Object;"))
+         (err (should-error (gg--call-method-raw it next nil) :type 'java-exception)))
+    (should (eq 'java.util.NoSuchElementException (gg-java-exception-class err)))
+    (should-not (gg-java-exception-message err))))
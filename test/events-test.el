@@ -0,0 +1,33 @@
+(ert-deftest events-dispatch ()
+  "Events posted from Java are delivered in order to their handlers"
+  (let ((received nil)
+        (handler (lambda (data) (push data received))))
+    (gg-add-event-handler 'test-event handler)
+    (unwind-protect
+        (progn
+          (dotimes (i 100)
+            (should (eq t (gg-call-static 'gargoyle.Events 'post "test-event"
+                                          (number-to-string i)))))
+          (gg-call-static 'gargoyle.Events 'post "other-event" "ignored")
+          (gg--dispatch-events)
+          (should (equal (mapcar #'number-to-string (number-sequence 0 99))
+                         (nreverse received))))
+      (gg-remove-event-handler 'test-event handler))))
+
+(ert-deftest events-object-data ()
+  "Non-string data is delivered as Java objects, null as nil"
+  (let ((list (gg-new (gg-find-class "java.util.ArrayList"))))
+    (gg-call-static 'gargoyle.Events 'post "test-event" list)
+    (gg-call-static 'gargoyle.Events 'post "test-event" nil)
+    (let ((events (gg--drain-events-raw)))
+      (should (eq 2 (length events)))
+      (should (eq 'test-event (car (nth 0 events))))
+      (should (eq 'java.util.ArrayList (gg--object-class (cdr (nth 0 events)))))
+      (should (null (cdr (nth 1 events)))))))
+
+(ert-deftest events-batches ()
+  "Draining is limited to the batch size"
+  (dotimes (i 10)
+    (gg-call-static 'gargoyle.Events 'post "test-event" "x"))
+  (should (eq 4 (length (gg--drain-events-raw 4))))
+  (should (eq 6 (length (gg--drain-events-raw)))))
@@ -0,0 +1,25 @@
+(ert-deftest call-timeout ()
+  "A call running past its deadline is interrupted"
+  (let ((start (float-time)))
+    (should-error (gg-with-timeout 0.2
+                    (gg-call-static 'java.lang.Thread 'sleep 10000))
+                  :type 'java-timeout)
+    (should (< (- (float-time) start) 2)))
+  ;; the next call gets a new thread
+  (gg-with-timeout 5
+    (should (eq 42 (gg-call-static 'java.lang.Math 'max 42 7)))))
+
+(ert-deftest call-interruptible ()
+  "Interruptible calls return values and signal exceptions as usual"
+  (let ((gg-java-interruptible-calls t)
+        (l (gg-new (gg-find-class "java.util.ArrayList"))))
+    (should (eq t (gg-call l 'add (gg-new-string "x"))))
+    (should (string-equal "x" (gg-toString (gg-call l 'get 0))))
+    (should (eq 'java.lang.NumberFormatException
+                (gg-java-exception-class
+                 (should-error (gg-call-static 'java.lang.Integer 'parseInt "x")
+                               :type 'java-exception))))))
+
+(ert-deftest future-get-timeout ()
+  (should-error (gg-future-get (gg-call-static-async 'java.lang.Thread 'sleep 1000) 0.05)
+                :type 'java-timeout))
@@ -0,0 +1,44 @@
+(ert-deftest method-functions ()
+  "Methods of classes used from Lisp can be called as /NAME"
+  (let ((gg-define-method-functions t)
+        (l (gg-new (gg-find-class "java.util.ArrayList"))))
+    (gg-define-class-methods 'java.util.ArrayList)
+    (should (fboundp '/add))
+    (should (eq t (/add l (gg-new-string "x"))))
+    (should (eq t (/add l (gg-new-string "y"))))
+    (should (eq 2 (/size l)))
+    ;; inherited from AbstractCollection
+    (should (string-equal "[x, y]" (/toString l)))
+    ;; overloads by arity
+    (/add l 0 (gg-new-string "w"))
+    (should (string-equal "w" (gg-toString (/get l 0))))
+    ;; methods of results are defined too
+    (should (eq t (/hasNext (/iterator l))))))
+
+(ert-deftest method-functions-static ()
+  (gg-define-class-methods 'java.lang.Math)
+  (should (eq 42 (/max 'java.lang.Math 42 7)))
+  (should (= 2.5 (/max 'java.lang.Math 2.5 1.0))))
+
+(ert-deftest method-functions-shared-bindings ()
+  "Classes share the bindings of supertypes for methods they don't declare"
+  (gg-define-class-methods 'java.util.ArrayList)
+  (let ((list-bindings (gg--class-bindings 'java.util.ArrayList))
+        (object-bindings (gg--class-bindings 'java.lang.Object)))
+    (should (eq (gethash 'getClass object-bindings)
+                (gethash 'getClass list-bindings)))
+    (should-not (eq (gethash 'toString object-bindings)
+                    (gethash 'toString list-bindings)))))
+
+(ert-deftest method-functions-errors ()
+  (let ((l (gg-new (gg-find-class "java.util.ArrayList"))))
+    (gg-define-class-methods 'java.util.ArrayList)
+    (should-error (/add l) :type 'error)
+    (should-error (/get l 5) :type 'java-exception)))
+
+(ert-deftest method-functions-off ()
+  "No functions are defined unless asked for"
+  (let ((gg-define-method-functions nil)
+        (bits (gg-new "java.util.BitSet")))
+    (should (eq 0 (gg-call bits 'cardinality)))
+    (should-not (fboundp '/cardinality))))
@@ -0,0 +1,289 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Run the module's entry points in a loop without Emacs, using the
+ * stub env from stub_env.c. This is meant for profiling the module's
+ * own JNI/JVMTI cost with perf, valgrind, etc., e.g.
+ *
+ *   make native-bench
+ *   perf record -g ./test/native/gg-native-bench -n 100000 -w find-class
+ *
+ * Lisp values created during a workload are collected (running
+ * user pointer finalizers) between batches, outside of the timing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <emacs-module.h>
+
+#include "ctrl.h"
+#include "stub_env.h"
+
+extern int emacs_module_init(struct emacs_runtime *ert);
+/* c.f. main.c, normally set by `gg--java-start-raw' */
+extern int vm_started;
+
+/*
+ * Values used by every iteration of a workload (pinned)
+ */
+static emacs_value v_class_name;        /* "java.util.ArrayList" */
+static emacs_value v_class;             /* its class */
+static emacs_value v_list;              /* an instance */
+static emacs_value v_size_mid;          /* ArrayList.size() */
+static emacs_value v_struct_symbol;     /* java.lang.Character */
+static emacs_value v_short_string;
+static emacs_value v_long_string;       /* 1MB */
+static emacs_value v_prefix;            /* "java.util." */
+
+static emacs_value call(emacs_env *env, const char *name, ptrdiff_t nargs, emacs_value args[])
+{
+    emacs_value result = stub_env_call(env, name, nargs, args);
+    if (stub_env_report_exit(env, stderr)) {
+        fprintf(stderr, "error in `%s'\n", name);
+        exit(1);
+    }
+    return result;
+}
+
+static emacs_value pin(emacs_env *env, emacs_value value)
+{
+    return env->make_global_ref(env, value);
+}
+
+static void setup(emacs_env *env)
+{
+    emacs_value args[3];
+    char *long_string;
+
+    v_class_name = pin(env, env->make_string(env, "java.util.ArrayList", 19));
+    v_class = pin(env, call(env, "gg-find-class", 1, &v_class_name));
+    v_list = pin(env, call(env, "gg--new-raw", 1, &v_class));
+    args[0] = v_class;
+    args[1] = env->make_string(env, "size", 4);
+    args[2] = env->make_string(env, "()I", 3);
+    v_size_mid = pin(env, call(env, "gg--get-method-id-raw", 3, args));
+    v_struct_symbol = env->intern(env, "java.lang.Character");
+    v_short_string = pin(env, env->make_string(env, "Hello, world", 12));
+    long_string = malloc(1 << 20);
+    memset(long_string, 'x', 1 << 20);
+    v_long_string = pin(env, env->make_string(env, long_string, 1 << 20));
+    free(long_string);
+    v_prefix = pin(env, env->make_string(env, "java.util.", 10));
+    stub_env_collect(env);
+}
+
+static void w_find_class(emacs_env *env)
+{
+    call(env, "gg-find-class", 1, &v_class_name);
+}
+
+static void w_class_struct(emacs_env *env)
+{
+    call(env, "gg--flush-class-cache", 1, &v_struct_symbol);
+    call(env, "gg--get-class-struct", 1, &v_struct_symbol);
+}
+
+static void w_class_struct_cached(emacs_env *env)
+{
+    call(env, "gg--get-class-struct", 1, &v_struct_symbol);
+}
+
+static void w_new_string(emacs_env *env)
+{
+    call(env, "gg-new-string", 1, &v_short_string);
+}
+
+static void w_new_string_1mb(emacs_env *env)
+{
+    call(env, "gg-new-string", 1, &v_long_string);
+}
+
+static void w_to_string(emacs_env *env)
+{
+    call(env, "gg--toString-raw", 1, &v_list);
+}
+
+static void w_new_object(emacs_env *env)
+{
+    call(env, "gg--new-raw", 1, &v_class);
+}
+
+static void w_call_method(emacs_env *env)
+{
+    emacs_value args[3] = { v_list, v_size_mid, env->intern(env, "nil") };
+    call(env, "gg--call-method-raw", 3, args);
+}
+
+static void w_loaded_classes(emacs_env *env)
+{
+    call(env, "gg-loaded-classes", 1, &v_prefix);
+}
+
+static struct workload {
+    const char *name;
+    void (*run)(emacs_env *env);
+    long default_iterations;
+} workloads[] = {
+    { "find-class", w_find_class, 100000 },
+    { "class-struct", w_class_struct, 1000 },
+    { "class-struct-cached", w_class_struct_cached, 100000 },
+    { "new-string", w_new_string, 100000 },
+    { "new-string-1mb", w_new_string_1mb, 200 },
+    { "to-string", w_to_string, 100000 },
+    { "new-object", w_new_object, 100000 },
+    { "call-method", w_call_method, 100000 },
+    { "loaded-classes", w_loaded_classes, 1000 },
+    { NULL, NULL, 0 }
+};
+
+/*
+ * Values are collected after this many iterations
+ */
+#define BATCH_SIZE 1000
+
+static double elapsed(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void run_workload(emacs_env *env, struct workload *w, long iterations)
+{
+    struct timespec start, end;
+    double total = 0;
+    long done = 0;
+    long i, batch;
+
+    /* warm up (class loading, JIT, caches) */
+    w->run(env);
+    stub_env_collect(env);
+
+    while (done < iterations) {
+        batch = iterations - done < BATCH_SIZE ? iterations - done : BATCH_SIZE;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < batch; ++i) {
+            w->run(env);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        total += elapsed(&start, &end);
+        done += batch;
+        stub_env_collect(env);
+    }
+    printf("%-20s %10ld %10.3fs %12.0f ops/s %10.0f ns/op\n",
+           w->name, iterations, total, iterations / total, total * 1e9 / iterations);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-l] [-n ITERATIONS] [-w WORKLOAD]... [-J JVM-OPTION]... [-c CLASSPATH]\n"
+            "  -l  list the workloads\n"
+            "  -n  iterations of each workload (default depends on the workload)\n"
+            "  -w  run only the given workload(s)\n"
+            "  -J  pass an option to the JVM (e.g. -J-Xcheck:jni)\n"
+            "  -c  class path of the JVM\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct emacs_runtime *runtime;
+    emacs_env *env;
+    struct workload *w;
+    char *options[64];
+    int option_count = 0;
+    const char *selected[64];
+    int selected_count = 0;
+    char *classpath_option;
+    long iterations = 0;
+    int opt, i, ret;
+
+    while ((opt = getopt(argc, argv, "ln:w:J:c:h")) != -1) {
+        switch (opt) {
+        case 'l':
+            for (w = workloads; w->name; ++w) {
+                printf("%-20s %ld\n", w->name, w->default_iterations);
+            }
+            return 0;
+        case 'n':
+            iterations = atol(optarg);
+            break;
+        case 'w':
+            if (selected_count < 64) {
+                selected[selected_count++] = optarg;
+            }
+            break;
+        case 'J':
+            if (option_count < 63) {
+                options[option_count++] = optarg;
+            }
+            break;
+        case 'c':
+            if (option_count < 63) {
+                classpath_option = malloc(strlen(optarg) + 22);
+                sprintf(classpath_option, "-Djava.class.path=%s", optarg);
+                options[option_count++] = classpath_option;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    env = stub_env_new(&runtime);
+    if (emacs_module_init(runtime)) {
+        fprintf(stderr, "module init failed\n");
+        return 1;
+    }
+    if (stub_env_report_exit(env, stderr)) {
+        return 1;
+    }
+
+    ret = ctrl_start_java(options, option_count, NULL);
+    if (ret) {
+        fprintf(stderr, "JVM creation failed (%d)\n", ret);
+        return 1;
+    }
+    vm_started = 1;
+    setup(env);
+
+    for (w = workloads; w->name; ++w) {
+        if (selected_count) {
+            for (i = 0; i < selected_count && strcmp(selected[i], w->name); ++i) {
+            }
+            if (i == selected_count) {
+                continue;
+            }
+        }
+        run_workload(env, w, iterations > 0 ? iterations : w->default_iterations);
+    }
+
+    call(env, "gg-java-stop", 0, NULL);
+    return 0;
+}
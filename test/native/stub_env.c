@@ -0,0 +1,820 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emacs-module.h>
+
+#include "hashtab.h"
+#include "stub_env.h"
+
+enum value_type {
+    T_SYMBOL,
+    T_INTEGER,
+    T_FLOAT,
+    T_STRING,
+    T_CONS,
+    T_VECTOR,
+    T_USER_PTR,
+    T_FUNCTION
+};
+
+typedef emacs_value (*module_function)(emacs_env *, ptrdiff_t, emacs_value[], void *);
+
+struct emacs_value_tag {
+    enum value_type type;
+    int pinned;                     /* global refs */
+    struct emacs_value_tag *next;   /* in the arena (or pinned list) */
+    union {
+        struct {
+            char *name;
+            emacs_value function;
+        } symbol;
+        intmax_t integer;
+        double number;
+        struct {
+            char *bytes;
+            ptrdiff_t length;
+        } string;
+        struct {
+            emacs_value car;
+            emacs_value cdr;
+        } cons;
+        struct {
+            emacs_value *elements;
+            ptrdiff_t size;
+        } vector;
+        struct {
+            void *ptr;
+            void (*finalizer)(void *);
+        } user_ptr;
+        struct {
+            ptrdiff_t min_arity;
+            ptrdiff_t max_arity;
+            module_function function;
+            void *data;
+        } function;
+    } u;
+};
+
+struct emacs_env_private {
+    struct hashtab *obarray;        /* name -> symbol value */
+    emacs_value arena;
+    emacs_value pinned;
+    size_t live;
+    enum emacs_funcall_exit exit;
+    emacs_value exit_symbol;
+    emacs_value exit_data;
+};
+
+#define PRIV(env) ((env)->private_members)
+
+static emacs_env *the_env;
+static struct emacs_runtime the_runtime;
+
+static emacs_value Qnil_, Qt_;
+
+static emacs_value alloc(emacs_env *env, enum value_type type)
+{
+    emacs_value v = calloc(1, sizeof(struct emacs_value_tag));
+    assert(v);
+    v->type = type;
+    v->next = PRIV(env)->arena;
+    PRIV(env)->arena = v;
+    PRIV(env)->live++;
+    return v;
+}
+
+static void free_value(emacs_value v)
+{
+    switch (v->type) {
+    case T_STRING:
+        free(v->u.string.bytes);
+        break;
+    case T_VECTOR:
+        free(v->u.vector.elements);
+        break;
+    case T_USER_PTR:
+        if (v->u.user_ptr.finalizer) {
+            v->u.user_ptr.finalizer(v->u.user_ptr.ptr);
+        }
+        break;
+    default:
+        break;
+    }
+    free(v);
+}
+
+static int pending(emacs_env *env)
+{
+    return PRIV(env)->exit != emacs_funcall_exit_return;
+}
+
+/*
+ * Non-local exits
+ */
+
+static enum emacs_funcall_exit stub_non_local_exit_check(emacs_env *env)
+{
+    return PRIV(env)->exit;
+}
+
+static void stub_non_local_exit_clear(emacs_env *env)
+{
+    PRIV(env)->exit = emacs_funcall_exit_return;
+    PRIV(env)->exit_symbol = NULL;
+    PRIV(env)->exit_data = NULL;
+}
+
+static enum emacs_funcall_exit stub_non_local_exit_get(emacs_env *env, emacs_value *symbol, emacs_value *data)
+{
+    if (pending(env)) {
+        *symbol = PRIV(env)->exit_symbol;
+        *data = PRIV(env)->exit_data;
+    }
+    return PRIV(env)->exit;
+}
+
+static void stub_non_local_exit_signal(emacs_env *env, emacs_value symbol, emacs_value data)
+{
+    /* the first signal wins, as in Emacs */
+    if (!pending(env)) {
+        PRIV(env)->exit = emacs_funcall_exit_signal;
+        PRIV(env)->exit_symbol = symbol;
+        PRIV(env)->exit_data = data;
+    }
+}
+
+static void stub_non_local_exit_throw(emacs_env *env, emacs_value tag, emacs_value value)
+{
+    if (!pending(env)) {
+        PRIV(env)->exit = emacs_funcall_exit_throw;
+        PRIV(env)->exit_symbol = tag;
+        PRIV(env)->exit_data = value;
+    }
+}
+
+static emacs_value stub_intern(emacs_env *env, const char *name);
+static emacs_value stub_make_string(emacs_env *env, const char *contents, ptrdiff_t length);
+
+static void signal_error(emacs_env *env, const char *error, const char *message, emacs_value datum)
+{
+    emacs_value data = Qnil_;
+    emacs_value cell;
+
+    if (datum) {
+        data = alloc(env, T_CONS);
+        data->u.cons.car = datum;
+        data->u.cons.cdr = Qnil_;
+    }
+    cell = alloc(env, T_CONS);
+    cell->u.cons.car = stub_make_string(env, message, strlen(message));
+    cell->u.cons.cdr = data;
+    stub_non_local_exit_signal(env, stub_intern(env, error), cell);
+}
+
+/*
+ * Memory management
+ */
+
+static emacs_value stub_make_global_ref(emacs_env *env, emacs_value value)
+{
+    if (value) {
+        value->pinned++;
+    }
+    return value;
+}
+
+static void stub_free_global_ref(emacs_env *env, emacs_value value)
+{
+    if (value && value->pinned > 0) {
+        value->pinned--;
+    }
+}
+
+static void sweep(emacs_env *env, emacs_value v)
+{
+    emacs_value next;
+
+    for (; v; v = next) {
+        next = v->next;
+        if (v->pinned) {
+            v->next = PRIV(env)->pinned;
+            PRIV(env)->pinned = v;
+        } else {
+            free_value(v);
+        }
+    }
+}
+
+void stub_env_collect(emacs_env *env)
+{
+    emacs_value arena = PRIV(env)->arena;
+    emacs_value pinned = PRIV(env)->pinned;
+
+    PRIV(env)->arena = NULL;
+    PRIV(env)->pinned = NULL;
+    PRIV(env)->live = 0;
+    /* values are freed once their last global ref is */
+    sweep(env, pinned);
+    sweep(env, arena);
+}
+
+size_t stub_env_live_values(emacs_env *env)
+{
+    return PRIV(env)->live;
+}
+
+/*
+ * Values
+ */
+
+static emacs_value stub_intern(emacs_env *env, const char *name)
+{
+    emacs_value symbol = hashtab_get(PRIV(env)->obarray, name);
+
+    if (!symbol) {
+        /* symbols are never collected */
+        symbol = calloc(1, sizeof(struct emacs_value_tag));
+        assert(symbol);
+        symbol->type = T_SYMBOL;
+        symbol->pinned = 1;
+        symbol->u.symbol.name = strdup(name);
+        assert(symbol->u.symbol.name);
+        hashtab_put(PRIV(env)->obarray, name, symbol);
+    }
+    return symbol;
+}
+
+static emacs_value stub_type_of(emacs_env *env, emacs_value value)
+{
+    static const char *names[] = {
+        "symbol", "integer", "float", "string", "cons", "vector", "user-ptr", "module-function"
+    };
+    return stub_intern(env, names[value->type]);
+}
+
+static bool stub_is_not_nil(emacs_env *env, emacs_value value)
+{
+    return value && value != Qnil_;
+}
+
+static bool stub_eq(emacs_env *env, emacs_value a, emacs_value b)
+{
+    /* fixnums are eq by value */
+    return a == b || (a && b && a->type == T_INTEGER && b->type == T_INTEGER &&
+                      a->u.integer == b->u.integer);
+}
+
+static void wrong_type(emacs_env *env, const char *predicate, emacs_value value)
+{
+    emacs_value data = alloc(env, T_CONS);
+
+    data->u.cons.car = stub_intern(env, predicate);
+    data->u.cons.cdr = alloc(env, T_CONS);
+    data->u.cons.cdr->u.cons.car = value;
+    data->u.cons.cdr->u.cons.cdr = Qnil_;
+    stub_non_local_exit_signal(env, stub_intern(env, "wrong-type-argument"), data);
+}
+
+static intmax_t stub_extract_integer(emacs_env *env, emacs_value value)
+{
+    if (value->type != T_INTEGER) {
+        wrong_type(env, "integerp", value);
+        return 0;
+    }
+    return value->u.integer;
+}
+
+static emacs_value stub_make_integer(emacs_env *env, intmax_t n)
+{
+    emacs_value v;
+
+    if (pending(env)) {
+        return NULL;
+    }
+    v = alloc(env, T_INTEGER);
+    v->u.integer = n;
+    return v;
+}
+
+static double stub_extract_float(emacs_env *env, emacs_value value)
+{
+    if (value->type != T_FLOAT) {
+        wrong_type(env, "floatp", value);
+        return 0;
+    }
+    return value->u.number;
+}
+
+static emacs_value stub_make_float(emacs_env *env, double d)
+{
+    emacs_value v;
+
+    if (pending(env)) {
+        return NULL;
+    }
+    v = alloc(env, T_FLOAT);
+    v->u.number = d;
+    return v;
+}
+
+static bool stub_copy_string_contents(emacs_env *env, emacs_value value, char *buffer, ptrdiff_t *size)
+{
+    ptrdiff_t required;
+
+    if (value->type != T_STRING) {
+        wrong_type(env, "stringp", value);
+        return false;
+    }
+    required = value->u.string.length + 1;
+    if (!buffer) {
+        *size = required;
+        return true;
+    }
+    if (*size < required) {
+        *size = required;
+        signal_error(env, "args-out-of-range", "Buffer too small", NULL);
+        return false;
+    }
+    memcpy(buffer, value->u.string.bytes, required);
+    *size = required;
+    return true;
+}
+
+static emacs_value stub_make_string(emacs_env *env, const char *contents, ptrdiff_t length)
+{
+    emacs_value v;
+
+    if (pending(env)) {
+        return NULL;
+    }
+    v = alloc(env, T_STRING);
+    v->u.string.bytes = malloc(length + 1);
+    assert(v->u.string.bytes);
+    memcpy(v->u.string.bytes, contents, length);
+    v->u.string.bytes[length] = 0;
+    v->u.string.length = length;
+    return v;
+}
+
+static emacs_value stub_make_user_ptr(emacs_env *env, void (*finalizer)(void *), void *ptr)
+{
+    emacs_value v;
+
+    if (pending(env)) {
+        return NULL;
+    }
+    v = alloc(env, T_USER_PTR);
+    v->u.user_ptr.ptr = ptr;
+    v->u.user_ptr.finalizer = finalizer;
+    return v;
+}
+
+static void *stub_get_user_ptr(emacs_env *env, emacs_value value)
+{
+    if (value->type != T_USER_PTR) {
+        wrong_type(env, "user-ptrp", value);
+        return NULL;
+    }
+    return value->u.user_ptr.ptr;
+}
+
+static void stub_set_user_ptr(emacs_env *env, emacs_value value, void *ptr)
+{
+    if (value->type != T_USER_PTR) {
+        wrong_type(env, "user-ptrp", value);
+        return;
+    }
+    value->u.user_ptr.ptr = ptr;
+}
+
+static void (*stub_get_user_finalizer(emacs_env *env, emacs_value value))(void *)
+{
+    if (value->type != T_USER_PTR) {
+        wrong_type(env, "user-ptrp", value);
+        return NULL;
+    }
+    return value->u.user_ptr.finalizer;
+}
+
+static void stub_set_user_finalizer(emacs_env *env, emacs_value value, void (*finalizer)(void *))
+{
+    if (value->type != T_USER_PTR) {
+        wrong_type(env, "user-ptrp", value);
+        return;
+    }
+    value->u.user_ptr.finalizer = finalizer;
+}
+
+static emacs_value make_vector(emacs_env *env, ptrdiff_t size, emacs_value init)
+{
+    emacs_value v = alloc(env, T_VECTOR);
+    ptrdiff_t i;
+
+    v->u.vector.elements = malloc(sizeof(emacs_value) * (size ? size : 1));
+    assert(v->u.vector.elements);
+    v->u.vector.size = size;
+    for (i = 0; i < size; ++i) {
+        v->u.vector.elements[i] = init;
+    }
+    return v;
+}
+
+static emacs_value stub_vec_get(emacs_env *env, emacs_value vec, ptrdiff_t i)
+{
+    if (vec->type != T_VECTOR) {
+        wrong_type(env, "vectorp", vec);
+        return NULL;
+    }
+    if (i < 0 || i >= vec->u.vector.size) {
+        signal_error(env, "args-out-of-range", "Vector index", NULL);
+        return NULL;
+    }
+    return vec->u.vector.elements[i];
+}
+
+static void stub_vec_set(emacs_env *env, emacs_value vec, ptrdiff_t i, emacs_value value)
+{
+    if (vec->type != T_VECTOR) {
+        wrong_type(env, "vectorp", vec);
+        return;
+    }
+    if (i < 0 || i >= vec->u.vector.size) {
+        signal_error(env, "args-out-of-range", "Vector index", NULL);
+        return;
+    }
+    vec->u.vector.elements[i] = value;
+}
+
+static ptrdiff_t stub_vec_size(emacs_env *env, emacs_value vec)
+{
+    if (vec->type != T_VECTOR) {
+        wrong_type(env, "vectorp", vec);
+        return 0;
+    }
+    return vec->u.vector.size;
+}
+
+static emacs_value stub_make_function(emacs_env *env, ptrdiff_t min_arity, ptrdiff_t max_arity,
+                                      module_function function, const char *documentation, void *data)
+{
+    emacs_value v;
+
+    if (pending(env)) {
+        return NULL;
+    }
+    v = alloc(env, T_FUNCTION);
+    v->u.function.min_arity = min_arity;
+    v->u.function.max_arity = max_arity;
+    v->u.function.function = function;
+    v->u.function.data = data;
+    return v;
+}
+
+static bool stub_should_quit(emacs_env *env)
+{
+    return false;
+}
+
+#if defined(EMACS_MAJOR_VERSION) && EMACS_MAJOR_VERSION >= 27
+static enum emacs_process_input_result stub_process_input(emacs_env *env)
+{
+    return emacs_process_input_continue;
+}
+#endif
+
+#if defined(EMACS_MAJOR_VERSION) && EMACS_MAJOR_VERSION >= 28
+static int stub_open_channel(emacs_env *env, emacs_value pipe_process)
+{
+    signal_error(env, "error", "No processes without Emacs", NULL);
+    return -1;
+}
+
+static emacs_value stub_make_unibyte_string(emacs_env *env, const char *contents, ptrdiff_t length)
+{
+    return stub_make_string(env, contents, length);
+}
+#endif
+
+/*
+ * The Lisp functions the module calls
+ */
+
+static emacs_value cons(emacs_env *env, emacs_value car, emacs_value cdr)
+{
+    emacs_value v = alloc(env, T_CONS);
+    v->u.cons.car = car;
+    v->u.cons.cdr = cdr;
+    return v;
+}
+
+static emacs_value list_from(emacs_env *env, ptrdiff_t nargs, emacs_value args[])
+{
+    emacs_value result = Qnil_;
+    ptrdiff_t i;
+
+    for (i = nargs; i-- > 0; ) {
+        result = cons(env, args[i], result);
+    }
+    return result;
+}
+
+/*
+ * Elements of a list or vector (malloc()'d, NULL on a signal)
+ */
+static emacs_value *sequence_elements(emacs_env *env, emacs_value seq, ptrdiff_t *count)
+{
+    emacs_value *elements;
+    emacs_value p;
+    ptrdiff_t n = 0;
+
+    if (seq->type == T_VECTOR) {
+        n = seq->u.vector.size;
+        elements = malloc(sizeof(emacs_value) * (n ? n : 1));
+        assert(elements);
+        memcpy(elements, seq->u.vector.elements, sizeof(emacs_value) * n);
+        *count = n;
+        return elements;
+    }
+    for (p = seq; p->type == T_CONS; p = p->u.cons.cdr) {
+        n++;
+    }
+    if (p != Qnil_) {
+        wrong_type(env, "sequencep", seq);
+        return NULL;
+    }
+    elements = malloc(sizeof(emacs_value) * (n ? n : 1));
+    assert(elements);
+    n = 0;
+    for (p = seq; p->type == T_CONS; p = p->u.cons.cdr) {
+        elements[n++] = p->u.cons.car;
+    }
+    *count = n;
+    return elements;
+}
+
+static emacs_value call_function(emacs_env *env, emacs_value function, ptrdiff_t nargs, emacs_value args[]);
+
+static emacs_value builtin(emacs_env *env, const char *name, ptrdiff_t nargs, emacs_value args[])
+{
+    emacs_value *elements;
+    emacs_value *all;
+    emacs_value result;
+    ptrdiff_t count, total, i;
+
+    if (!strcmp(name, "list")) {
+        return list_from(env, nargs, args);
+    } else if (!strcmp(name, "cons") && nargs == 2) {
+        return cons(env, args[0], args[1]);
+    } else if (!strcmp(name, "vector")) {
+        result = make_vector(env, nargs, Qnil_);
+        memcpy(result->u.vector.elements, args, sizeof(emacs_value) * nargs);
+        return result;
+    } else if (!strcmp(name, "make-vector") && nargs == 2) {
+        return make_vector(env, stub_extract_integer(env, args[0]), args[1]);
+    } else if (!strcmp(name, "vconcat")) {
+        result = make_vector(env, 0, Qnil_);
+        for (i = 0; i < nargs; ++i) {
+            elements = sequence_elements(env, args[i], &count);
+            if (!elements) {
+                return NULL;
+            }
+            total = result->u.vector.size + count;
+            result->u.vector.elements = realloc(result->u.vector.elements, sizeof(emacs_value) * (total ? total : 1));
+            assert(result->u.vector.elements);
+            memcpy(result->u.vector.elements + result->u.vector.size, elements, sizeof(emacs_value) * count);
+            result->u.vector.size = total;
+            free(elements);
+        }
+        return result;
+    } else if (!strcmp(name, "symbol-name") && nargs == 1) {
+        if (args[0]->type != T_SYMBOL) {
+            wrong_type(env, "symbolp", args[0]);
+            return NULL;
+        }
+        return stub_make_string(env, args[0]->u.symbol.name, strlen(args[0]->u.symbol.name));
+    } else if (!strcmp(name, "gethash")) {
+        /* there are no hash tables */
+        return nargs > 2 ? args[2] : Qnil_;
+    } else if (!strcmp(name, "encode-coding-string") && nargs >= 1) {
+        /* strings are kept as UTF-8 bytes already */
+        return args[0];
+    } else if (!strcmp(name, "apply") && nargs >= 1) {
+        elements = sequence_elements(env, args[nargs - 1], &count);
+        if (!elements) {
+            return NULL;
+        }
+        total = nargs - 2 + count;
+        all = malloc(sizeof(emacs_value) * (total > 0 ? total : 1));
+        assert(all);
+        memcpy(all, args + 1, sizeof(emacs_value) * (nargs - 2 > 0 ? nargs - 2 : 0));
+        memcpy(all + (nargs - 2 > 0 ? nargs - 2 : 0), elements, sizeof(emacs_value) * count);
+        result = call_function(env, args[0], total, all);
+        free(all);
+        free(elements);
+        return result;
+    } else if (!strcmp(name, "fset") && nargs == 2) {
+        args[0]->u.symbol.function = stub_make_global_ref(env, args[1]);
+        return args[1];
+    } else if (!strcmp(name, "provide")) {
+        return args[0];
+    }
+    signal_error(env, "void-function", name, NULL);
+    return NULL;
+}
+
+static emacs_value call_function(emacs_env *env, emacs_value function, ptrdiff_t nargs, emacs_value args[])
+{
+    emacs_value result;
+
+    if (function->type == T_SYMBOL) {
+        if (function->u.symbol.function) {
+            function = function->u.symbol.function;
+        } else {
+            return builtin(env, function->u.symbol.name, nargs, args);
+        }
+    }
+    if (function->type != T_FUNCTION) {
+        signal_error(env, "invalid-function", "Not a function", function);
+        return NULL;
+    }
+    if (nargs < function->u.function.min_arity ||
+        (function->u.function.max_arity >= 0 && nargs > function->u.function.max_arity)) {
+        signal_error(env, "wrong-number-of-arguments", "Wrong number of arguments", NULL);
+        return NULL;
+    }
+    result = function->u.function.function(env, nargs, args, function->u.function.data);
+    return pending(env) ? NULL : result;
+}
+
+static emacs_value stub_funcall(emacs_env *env, emacs_value function, ptrdiff_t nargs, emacs_value args[])
+{
+    if (pending(env)) {
+        return NULL;
+    }
+    return call_function(env, function, nargs, args);
+}
+
+emacs_value stub_env_call(emacs_env *env, const char *name, ptrdiff_t nargs, emacs_value args[])
+{
+    return stub_funcall(env, stub_intern(env, name), nargs, args);
+}
+
+void stub_env_print(emacs_env *env, emacs_value v, FILE *out)
+{
+    emacs_value p;
+    ptrdiff_t i;
+
+    if (!v) {
+        fprintf(out, "#<null>");
+        return;
+    }
+    switch (v->type) {
+    case T_SYMBOL:
+        fprintf(out, "%s", v->u.symbol.name);
+        break;
+    case T_INTEGER:
+        fprintf(out, "%jd", v->u.integer);
+        break;
+    case T_FLOAT:
+        fprintf(out, "%g", v->u.number);
+        break;
+    case T_STRING:
+        fprintf(out, "\"%.*s\"", (int) v->u.string.length, v->u.string.bytes);
+        break;
+    case T_CONS:
+        fputc('(', out);
+        for (p = v; p->type == T_CONS; p = p->u.cons.cdr) {
+            if (p != v) {
+                fputc(' ', out);
+            }
+            stub_env_print(env, p->u.cons.car, out);
+        }
+        if (p != Qnil_) {
+            fprintf(out, " . ");
+            stub_env_print(env, p, out);
+        }
+        fputc(')', out);
+        break;
+    case T_VECTOR:
+        fputc('[', out);
+        for (i = 0; i < v->u.vector.size; ++i) {
+            if (i) {
+                fputc(' ', out);
+            }
+            stub_env_print(env, v->u.vector.elements[i], out);
+        }
+        fputc(']', out);
+        break;
+    case T_USER_PTR:
+        fprintf(out, "#<user-ptr %p>", v->u.user_ptr.ptr);
+        break;
+    case T_FUNCTION:
+        fprintf(out, "#<module function>");
+        break;
+    }
+}
+
+int stub_env_report_exit(emacs_env *env, FILE *out)
+{
+    if (!pending(env)) {
+        return 0;
+    }
+    fprintf(out, "%s: ", PRIV(env)->exit == emacs_funcall_exit_signal ? "signal" : "throw");
+    stub_env_print(env, PRIV(env)->exit_symbol, out);
+    fputc(' ', out);
+    stub_env_print(env, PRIV(env)->exit_data, out);
+    fputc('\n', out);
+    stub_non_local_exit_clear(env);
+    return 1;
+}
+
+static emacs_env *get_environment(struct emacs_runtime *runtime)
+{
+    return the_env;
+}
+
+emacs_env *stub_env_new(struct emacs_runtime **runtime)
+{
+    emacs_env *env;
+
+    if (the_env) {
+        *runtime = &the_runtime;
+        return the_env;
+    }
+    env = calloc(1, sizeof(emacs_env));
+    assert(env);
+    env->size = sizeof(emacs_env);
+    env->private_members = calloc(1, sizeof(struct emacs_env_private));
+    assert(env->private_members);
+    PRIV(env)->obarray = hashtab_new(HASHTAB_STRING_KEYS);
+
+    env->make_global_ref = stub_make_global_ref;
+    env->free_global_ref = stub_free_global_ref;
+    env->non_local_exit_check = stub_non_local_exit_check;
+    env->non_local_exit_clear = stub_non_local_exit_clear;
+    env->non_local_exit_get = stub_non_local_exit_get;
+    env->non_local_exit_signal = stub_non_local_exit_signal;
+    env->non_local_exit_throw = stub_non_local_exit_throw;
+    env->make_function = stub_make_function;
+    env->funcall = stub_funcall;
+    env->intern = stub_intern;
+    env->type_of = stub_type_of;
+    env->is_not_nil = stub_is_not_nil;
+    env->eq = stub_eq;
+    env->extract_integer = stub_extract_integer;
+    env->make_integer = stub_make_integer;
+    env->extract_float = stub_extract_float;
+    env->make_float = stub_make_float;
+    env->copy_string_contents = stub_copy_string_contents;
+    env->make_string = stub_make_string;
+    env->make_user_ptr = stub_make_user_ptr;
+    env->get_user_ptr = stub_get_user_ptr;
+    env->set_user_ptr = stub_set_user_ptr;
+    env->get_user_finalizer = stub_get_user_finalizer;
+    env->set_user_finalizer = stub_set_user_finalizer;
+    env->vec_get = stub_vec_get;
+    env->vec_set = stub_vec_set;
+    env->vec_size = stub_vec_size;
+    env->should_quit = stub_should_quit;
+#if defined(EMACS_MAJOR_VERSION) && EMACS_MAJOR_VERSION >= 27
+    env->process_input = stub_process_input;
+#endif
+#if defined(EMACS_MAJOR_VERSION) && EMACS_MAJOR_VERSION >= 28
+    env->open_channel = stub_open_channel;
+    env->make_unibyte_string = stub_make_unibyte_string;
+#endif
+
+    the_env = env;
+    Qnil_ = stub_intern(env, "nil");
+    Qt_ = stub_intern(env, "t");
+
+    the_runtime.size = sizeof(struct emacs_runtime);
+    the_runtime.get_environment = get_environment;
+    *runtime = &the_runtime;
+    return env;
+}
@@ -0,0 +1,76 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Jess Balint
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * A minimal in-process emacs_env for running the module without
+ * Emacs (c.f. gg_native_bench.c). It has symbols (with function
+ * cells), integers, floats, strings, conses, vectors, user pointers
+ * and non-local exits, plus the few Lisp functions the module calls.
+ *
+ * Values other than symbols live in an arena that is freed by
+ * `stub_env_collect', which also runs the finalizers of user pointers
+ * as Emacs' GC would. Global refs pin a value (not what it refers to)
+ * so they survive collection.
+ */
+
+#ifndef GG_STUB_ENV_H
+#define GG_STUB_ENV_H
+
+#include <stdio.h>
+
+#include <emacs-module.h>
+
+/*
+ * Create the env and a runtime returning it (for `emacs_module_init')
+ */
+emacs_env *stub_env_new(struct emacs_runtime **runtime);
+
+/*
+ * Call the function bound to the symbol NAME (e.g. by `fset' in
+ * `emacs_module_init'). Returns NULL with a pending non-local exit on
+ * failure.
+ */
+emacs_value stub_env_call(emacs_env *env, const char *name, ptrdiff_t nargs, emacs_value args[]);
+
+/*
+ * Free the unpinned values, running user pointer finalizers
+ */
+void stub_env_collect(emacs_env *env);
+
+/*
+ * Number of unpinned values allocated since the last collection
+ */
+size_t stub_env_live_values(emacs_env *env);
+
+/*
+ * Print a value (roughly as `prin1' would)
+ */
+void stub_env_print(emacs_env *env, emacs_value value, FILE *out);
+
+/*
+ * Print and clear a pending non-local exit. Returns 1 if there was one.
+ */
+int stub_env_report_exit(emacs_env *env, FILE *out);
+
+#endif
@@ -0,0 +1,43 @@
+;; The class path index reads jars without a JVM
+(ert-deftest jar-index-classes ()
+  (skip-unless (executable-find "jar"))
+  (let* ((dir (make-temp-file "gg-jar" t))
+         (jar (expand-file-name "test.jar" dir))
+         (default-directory (file-name-as-directory dir)))
+    (unwind-protect
+        (progn
+          (make-directory "com/x/lower" t)
+          (dolist (file '("com/x/Outer.class" "com/x/Outer$Inner.class"
+                          "com/x/lower/in$Nested.class" "com/x/package-info.class"))
+            (write-region "" nil file))
+          (should (eq 0 (call-process "jar" nil nil nil "cf" jar "com")))
+          (let ((gg-java-classpath (list jar)))
+            (should (equal '(com.x.Outer com.x.Outer$Inner com.x.lower.in$Nested)
+                           (gg-classpath-classes "com.x.")))
+            (should (equal '(com.x.lower.in$Nested) (gg-classpath-classes "com.x.lower")))
+            (should (null (gg-classpath-classes "org.")))))
+      (gg--jar-index-clear)
+      (setq gg--classpath-indexed nil)
+      (delete-directory dir t))))
+
+(ert-deftest jar-index-not-a-jar ()
+  (let ((file (make-temp-file "gg-jar")))
+    (unwind-protect
+        (should-error (gg--jar-index-add file))
+      (delete-file file))))
+
+(ert-deftest jar-index-truncated-zip64 ()
+  "A ZIP64 locator in a file too small for the record it points to"
+  (let ((file (make-temp-file "gg-jar")))
+    (unwind-protect
+        (let ((coding-system-for-write 'binary))
+          (with-temp-file file
+            (set-buffer-multibyte nil)
+            ;; locator pointing past the end, then an EOCD asking for it
+            (insert (unibyte-string #x50 #x4b #x06 #x07 0 0 0 0
+                                    0 0 0 #x10 0 0 0 0 1 0 0 0)
+                    (unibyte-string #x50 #x4b #x05 #x06 0 0 0 0 #xff #xff #xff #xff
+                                    0 0 0 0 0 0 0 0 0 0)))
+          (should (= 42 (file-attribute-size (file-attributes file))))
+          (should-error (gg--jar-index-add file)))
+      (delete-file file))))
@@ -0,0 +1,14 @@
+;; Starting the JVM on a background thread
+(ert-deftest async-start-test ()
+  (should (eq 'stopped (gg-java-status)))
+  (let* ((called nil)
+         (gg-java-started-hook (list (lambda () (setq called 'hook)))))
+    (should (eq t (gg-java-start-async nil (lambda (result) (setq called result)))))
+    (should (memq (gg-java-status) '(starting running)))
+    (should-error (gg-java-start))
+    (should (gg-java-wait-for-start 60))
+    (should (eq t called))
+    (should (eq 'running (gg-java-status)))
+    (should (string-equal "x" (gg-toString (gg-new-string "x"))))
+    (should (eq t (gg-java-stop)))
+    (should (eq 'stopped (gg-java-status)))))
@@ -3,7 +3,8 @@
   (should (eq nil (gg-java-running)))
   (should (eq t (gg-java-start)))
   (should (eq t (gg-java-running)))
-  (should (string-equal "1.8" (gg-jni-version)))
+  ;; JNI 10 is reported by JDK 10 to 18, later JDKs have their own
+  (should (member (gg-jni-version) '("1.8" "9" "10" "19" "20" "21")))
   (should (eq t (gg-java-stop)))
   (should (eq nil (gg-java-running)))
   (condition-case err (gg-java-start)
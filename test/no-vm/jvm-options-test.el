@@ -0,0 +1,36 @@
+;; JVM launch options are assembled from the customization variables
+(ert-deftest jvm-launch-options ()
+  (let ((gg-java-options '("-Xmx64m"))
+        (gg-java-classpath '("/a" "/b.jar"))
+        (gg-java-properties '(("x" . "1")))
+        (gg-java-check-jni nil)
+        (gg-java-cds-archive nil))
+    (should (equal (list (concat "-Djava.class.path=/a" path-separator "/b.jar")
+                         "-Dx=1" "-Xmx64m" "-Xss1m")
+                   (gg--java-launch-options '("-Xss1m"))))
+    (setq gg-java-check-jni t)
+    (should (equal "-Xcheck:jni" (car (gg--java-launch-options nil))))))
+
+(ert-deftest jvm-cds-options ()
+  (let* ((archive (make-temp-file "gg-cds"))
+         (gg-java-cds-archive archive))
+    (unwind-protect
+        (progn
+          (should (member (concat "-XX:SharedArchiveFile=" archive) (gg--java-cds-options)))
+          (delete-file archive)
+          (should (equal (list (concat "-XX:ArchiveClassesAtExit=" archive))
+                         (gg--java-cds-options)))
+          ;; building the options has no side effects
+          (should-not (memq 'gg--stop-for-cds-archive kill-emacs-hook)))
+      (when (file-exists-p archive)
+        (delete-file archive)))))
+
+(ert-deftest jvm-cds-hook ()
+  "The JVM is stopped at exit only when it writes an archive"
+  (unwind-protect
+      (progn
+        (gg--java-cds-hook '("-Xmx64m" "-XX:SharedArchiveFile=/a.jsa"))
+        (should-not (memq 'gg--stop-for-cds-archive kill-emacs-hook))
+        (gg--java-cds-hook '("-Xmx64m" "-XX:ArchiveClassesAtExit=/a.jsa"))
+        (should (memq 'gg--stop-for-cds-archive kill-emacs-hook)))
+    (remove-hook 'kill-emacs-hook #'gg--stop-for-cds-archive)))
@@ -11,3 +11,65 @@
 		 (a-string (gg-new-string the-string))
 		 (back-to-lisp (gg-toString a-string)))
 	(should (string-equal the-string back-to-lisp))))
+
+(ert-deftest string-non-ascii ()
+  "Characters outside ASCII and the BMP survive the round trip"
+  (dolist (s (list "é€ λ" "astral \U0001F600 char" (string ?a 0 ?b) ""))
+    (let ((j (gg-new-string s)))
+      (should (string-equal s (gg-toString j)))
+      (should (eq (length (encode-coding-string s 'utf-16be))
+                  (* 2 (gg-call j 'length)))))))
+
+(ert-deftest big-string-non-ascii ()
+  "Multi-byte characters across chunk boundaries of large strings"
+  (let* ((the-string (apply #'concat (make-list 20000 "é\U0001F600x")))
+         (back-to-lisp (gg-toString (gg-new-string the-string))))
+    (should (string-equal the-string back-to-lisp))))
+
+(ert-deftest local-refs-released ()
+  "Many calls don't exhaust local references"
+  (let ((s (gg-new-string "x")))
+    (dotimes (i 100000)
+      (gg-toString s))
+    (should (string-equal "x" (gg-toString s)))))
+
+(ert-deftest object-handles ()
+  "Java objects are handles with a cached class name"
+  (let ((s (gg-new-string "x"))
+        (c (gg-find-class "java.util.ArrayList")))
+    (should (eq 'java.lang.String (gg--object-class s)))
+    (should (eq 'java.lang.Class (gg--object-class c)))
+    (should-not (gg-objectp 'java.lang.String))
+    (should-not (gg-objectp '(gg-obj nil java.lang.String)))
+    (should-error (gg-toString "x") :type 'wrong-type-argument)
+    (should (< 0 (gg--handle-count)))))
+
+(ert-deftest object-handles-collected ()
+  "Handles dropped by Lisp are released"
+  (let ((count (gg--handle-count)))
+    (dotimes (i 10000)
+      (gg-new-string "x"))
+    (garbage-collect)
+    ;; released in batches later, not by the GC
+    (should (< 0 (gg--pending-releases)))
+    (gg--drain-releases)
+    (should (eq 0 (gg--pending-releases)))
+    (should (< (gg--handle-count) (+ count 10000)))))
+
+(ert-deftest object-release-batches ()
+  "Module calls release at most `gg-release-batch-size' objects"
+  (let ((original gg-release-batch-size))
+    (customize-set-variable 'gg-release-batch-size 10)
+    (unwind-protect
+        (progn
+          (gg--drain-releases)
+          (dotimes (i 1000)
+            (gg-new-string "x"))
+          (garbage-collect)
+          (let ((pending (gg--pending-releases)))
+            (should (< 20 pending))
+            ;; two module calls
+            (gg-toString (gg-new-string "y"))
+            (should (< (gg--pending-releases) pending))
+            (should (<= (- pending 20) (gg--pending-releases)))))
+      (customize-set-variable 'gg-release-batch-size original))))
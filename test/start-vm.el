@@ -1,4 +1,5 @@
 (add-to-list 'load-path (getenv "PWD"))
 (require 'gargoyle)
 ;; VM starter for tests requiring a running VM. Never cleaned up / stopped
+(setq gg-java-check-jni t)
 (gg-java-start)